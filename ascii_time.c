@@ -1,50 +1,488 @@
+#ifdef _WIN32
 #include <windows.h>
+#include <sal.h>
+#include <fcntl.h>
+#include <io.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "winmm.lib")   // timeBeginPeriod for the seconds display
+#pragma comment(lib, "advapi32.lib") // EnumDynamicTimeZoneInformation for /zone
+#endif
+#else
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+#define _XOPEN_SOURCE 700
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+#include <wctype.h>
+#endif
+#include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <wchar.h>
 #include <time.h>
 #include <locale.h>
-#include <sal.h>
+#include <signal.h>
 #include <string.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+// POSIX stand-ins for the Win32 types and calls shared by the clock core
+typedef int BOOL;
+typedef unsigned short WORD;
+typedef unsigned long DWORD;
+typedef short SHORT;
+typedef long LONG;
+#define TRUE 1
+#define FALSE 0
+
+typedef struct {
+    SHORT Left;
+    SHORT Top;
+    SHORT Right;
+    SHORT Bottom;
+} SMALL_RECT;
+
+typedef struct {
+    WORD wYear;
+    WORD wMonth;
+    WORD wDayOfWeek;
+    WORD wDay;
+    WORD wHour;
+    WORD wMinute;
+    WORD wSecond;
+    WORD wMilliseconds;
+} SYSTEMTIME;
+
+typedef union {
+    long long QuadPart;
+} LARGE_INTEGER;
+
+#define FOREGROUND_BLUE      0x0001
+#define FOREGROUND_GREEN     0x0002
+#define FOREGROUND_RED       0x0004
+#define FOREGROUND_INTENSITY 0x0008
+#define BACKGROUND_BLUE      0x0010
+#define BACKGROUND_GREEN     0x0020
+#define BACKGROUND_RED       0x0040
+#define BACKGROUND_INTENSITY 0x0080
+
+#define UNREFERENCED_PARAMETER(P) (void)(P)
+
+// SAL annotations are MSVC-only
+#define _In_
+#define _In_z_
+#define _In_reads_(size)
+#define _Out_
+#define _Out_writes_(size)
+#define _Inout_
+#define _Success_(expr)
+#define _Ret_notnull_
+
+#define _wcsicmp wcscasecmp
+#define swscanf_s swscanf
+
+static int wcscpy_s(wchar_t* dest, size_t destSize, const wchar_t* src) {
+    if (!dest || destSize == 0) {
+        return EINVAL;
+    }
+    wcsncpy(dest, src, destSize - 1);
+    dest[destSize - 1] = L'\0';
+    return 0;
+}
+
+#define _TRUNCATE ((size_t)-1)
+
+static int wcsncpy_s(wchar_t* dest, size_t destSize, const wchar_t* src, size_t count) {
+    if (!dest || destSize == 0) {
+        return EINVAL;
+    }
+    size_t length = wcslen(src);
+    if (count != _TRUNCATE && count < length) {
+        length = count;
+    }
+    if (length >= destSize) {
+        length = destSize - 1;
+    }
+    wmemcpy(dest, src, length);
+    dest[length] = L'\0';
+    return 0;
+}
+
+static int _wfopen_s(FILE** file, const wchar_t* path, const wchar_t* mode) {
+    char pathBytes[4096];
+    char modeBytes[16];
+    
+    *file = NULL;
+    if (wcstombs(pathBytes, path, sizeof(pathBytes)) == (size_t)-1 ||
+        wcstombs(modeBytes, mode, sizeof(modeBytes)) == (size_t)-1) {
+        return EINVAL;
+    }
+    *file = fopen(pathBytes, modeBytes);
+    return *file ? 0 : errno;
+}
+
+static void GetLocalTime(SYSTEMTIME* st) {
+    struct timespec now;
+    struct tm local;
+    
+    clock_gettime(CLOCK_REALTIME, &now);
+    localtime_r(&now.tv_sec, &local);
+    st->wYear = (WORD)(local.tm_year + 1900);
+    st->wMonth = (WORD)(local.tm_mon + 1);
+    st->wDayOfWeek = (WORD)local.tm_wday;
+    st->wDay = (WORD)local.tm_mday;
+    st->wHour = (WORD)local.tm_hour;
+    st->wMinute = (WORD)local.tm_min;
+    st->wSecond = (WORD)(local.tm_sec > 59 ? 59 : local.tm_sec);
+    st->wMilliseconds = (WORD)(now.tv_nsec / 1000000);
+}
+
+static DWORD GetTickCount(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (DWORD)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+static BOOL QueryPerformanceCounter(LARGE_INTEGER* counter) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    counter->QuadPart = (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+    return TRUE;
+}
+
+static BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency) {
+    frequency->QuadPart = 1000000000LL;
+    return TRUE;
+}
+
+#define INFINITE 0xFFFFFFFFUL
+
+typedef pthread_mutex_t CRITICAL_SECTION;
+typedef pthread_cond_t CONDITION_VARIABLE;
+
+static void InitializeCriticalSection(CRITICAL_SECTION* section) {
+    pthread_mutex_init(section, NULL);
+}
+
+static void DeleteCriticalSection(CRITICAL_SECTION* section) {
+    pthread_mutex_destroy(section);
+}
+
+static void EnterCriticalSection(CRITICAL_SECTION* section) {
+    pthread_mutex_lock(section);
+}
+
+static void LeaveCriticalSection(CRITICAL_SECTION* section) {
+    pthread_mutex_unlock(section);
+}
+
+static void InitializeConditionVariable(CONDITION_VARIABLE* condition) {
+    pthread_cond_init(condition, NULL);
+}
+
+static void WakeConditionVariable(CONDITION_VARIABLE* condition) {
+    pthread_cond_signal(condition);
+}
+
+static BOOL SleepConditionVariableCS(
+    CONDITION_VARIABLE* condition,
+    CRITICAL_SECTION* section,
+    DWORD milliseconds
+) {
+    if (milliseconds == INFINITE) {
+        return pthread_cond_wait(condition, section) == 0;
+    }
+    
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += (time_t)(milliseconds / 1000);
+    deadline.tv_nsec += (long)(milliseconds % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return pthread_cond_timedwait(condition, section, &deadline) == 0;
+}
+
+static LONG InterlockedExchange(volatile LONG* target, LONG value) {
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+static LONG InterlockedCompareExchange(volatile LONG* target, LONG exchange, LONG comparand) {
+    __atomic_compare_exchange_n(target, &comparand, exchange, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comparand;
+}
+#endif
 
 // Layout constants
 #define ASCII_CHAR_WIDTH 5
 #define ASCII_CHAR_HEIGHT 7
 #define ASCII_CHAR_SPACING 6
-#define TIME_COLON_OFFSET 12
-#define TIME_AMPM_OFFSET 36
-#define DATE_DASH1_OFFSET 24
-#define DATE_DASH2_OFFSET 42
+#define TIME_COLON_SLOT 2                   // Glyph positions on the time line
+#define TIME_AMPM_SLOT 6
+#define TIME_SECONDS_COLON_SLOT 5
+#define TIME_SECONDS_SLOT 6
+#define TIME_AMPM_SECONDS_SLOT 9
+#define DATE_LAST_SLOT 9                    // YYYY-MM-DD
+#define THEME_GRADIENT_STOPS 4
+#define ALARM_FLASH_MS 500
+#define POWER_POLL_MS 5000                  // Recheck a hidden console this often
+#define POWER_PROBE_MS 1000                 // Win32 window/desktop probe at most this often
+#define VT_SGR_MAX 24                       // "\x1b[0;97;107m" and room to spare
+#define TIMER_LAST_SLOT 10                  // HH:MM:SS.cc
+#define TIMER_SLOTS (TIMER_LAST_SLOT + 1)
+#define TIMER_TICK_US 10000                 // One centisecond
+#define TIMER_FRAME_BUDGET_US 5000          // Half a tick, the rest is left to sleep
+#define TIMER_LAP_MAX 99
+#define TIMER_MAX_CS 35999999LL             // 99:59:59.99
+#define FONT_WIDTH_MAX 32
+#define FONT_HEIGHT_MAX 32
+#define FONT_GLYPH_GAP 1
+#define FONT_PATH_MAX 512
+#define FONT_CACHE_MAGIC 0x3146414CUL       // "LAF1" little-endian
+#define FNV1A64_OFFSET_BASIS 0xCBF29CE484222325ULL
+#define TIME_ROW 3
+#define GLYPH_SCALE_MAX 8
+#define WORLD_CLOCK_ROW 2
+#define ZONE_PANE_MAX 8
+#define ZONE_PANE_GAP 4
+#define LAYOUT_SIDE_GAP 4                   // Columns between time and date side by side, unscaled
+#define ZONE_NAME_LENGTH 64
+#define ZONE_ABBREV_LENGTH 32
+#define ZONE_RULE_TEXT_MAX 128
+#define ZONEINFO_DEFAULT_DIR "/usr/share/zoneinfo"
+#define ZONEINFO_PATH_MAX 512
+#define ZONEINFO_FILE_MAX (1024 * 1024)
+#define SECONDS_PER_DAY 86400LL
+#define ZONE_FOREVER 0x7FFFFFFFFFFFFFFFLL
+#define BROADCAST_MAGIC 0x3156414CUL        // "LAV1" little-endian
+#define BROADCAST_MAX_VIEWERS 32
+#define BROADCAST_PATH_MAX 108              // sockaddr_un.sun_path on Linux
+#define BROADCAST_CELL_BYTES 6              // UTF-32 character + attribute
+#define BROADCAST_ROW_MAX 256
+#define BROADCAST_PIPE_BUFFER 65536
+#define BROADCAST_ACCEPT_MS 100
+#define BROADCAST_RETRY_MS 10
+#define VIEWER_RECEIVE_BYTES 65536
+#define VIEWER_MESSAGE_MAX (16 * 1024 * 1024)
+#define CAPTURE_MAGIC 0x3143414CUL          // "LAC1" little-endian
+#define CAPTURE_TEXT_MAX 512                // Longest replayed argument or line
+#define CAPTURE_SIGNAL_RESIZE 1
+#define CAPTURE_SIGNAL_CONTINUE 2
+#define SOAK_MAX_DAYS 36500
+#define SOAK_STEP_MS 1000                   // Simulated time between main loop passes
+#define SOAK_RING_TAIL_MS 5000              // Full-intensity ringing before the soak silences it
+#define SOAK_TICK_START ((DWORD)0 - 3600000) // An hour short of the tick count wrapping
+#define SOAK_FAULT_REPORT_MAX 10
+#define SOAK_TIME_LENGTH 32
 #define CONSOLE_FALLBACK_WIDTH 80
 #define CONSOLE_FALLBACK_HEIGHT 25
-#define UPDATE_INTERVAL_MS 50
-#define RESIZE_EVENT_BUFFER_SIZE 128
+#define INPUT_EVENT_BUFFER_SIZE 128
+#define INPUT_RING_CAPACITY 256             // Power of two
+#define INPUT_STALL_RETRY_MS 1
+#define VT_ESCAPE_TIMEOUT_MS 50             // Alt+key bytes arrive together; a lone Esc does not
+#define ALARM_BEEP_INTERVAL_MS 500
+#define ALARM_TONE_DURATION_MS 200
+#define ALARM_TONE_GAP_MS 50
+#define AUDIO_QUEUE_CAPACITY 8
+#define ALARM_NAME_LENGTH 32
+#define ALARM_STATUS_UPCOMING 3
+#define ALARM_FILE_LINE_MAX 256
+#define MINUTES_PER_DAY 1440
+#define ALARM_ID_STARTUP 0x80000000UL       // Ids hashed from /alarm and alarm file entries
+#define JOURNAL_MAGIC 0x314A414CUL          // "LAJ1" little-endian
+#define JOURNAL_NAME_BYTES 96
+#define JOURNAL_PATH_MAX 512
+#define JOURNAL_COMPACT_MIN_RECORDS 256
+#define SECONDS_WAKE_LEAD_MS 4
+#define SECONDS_SPIN_LIMIT_MS 50
+#define STATS_HISTOGRAM_BUCKETS 24          // Power-of-two microsecond buckets, 1 us .. 8 s
+#define STATS_OVERLAY_ROWS 3
+#define FRAME_SPAN_MERGE_GAP 4
+#define WIDGET_TEXT_MAX 256
+#define HEADLESS_RENDER_ITERATIONS 1000
+#define BANNER_GLYPHS 19                    // YYYY-MM-DD HH:MM:SS
+#define BANNER_ROW_BYTES (ASCII_CHAR_SPACING * 3)   // One glyph row + gap, UTF-8 worst case
+#define BANNER_MAX_BYTES (ASCII_CHAR_HEIGHT * (BANNER_GLYPHS * BANNER_ROW_BYTES + 1) + 1)
+#define BANNER_INPUT_BYTES (256 * 1024)
+#define BANNER_OUTPUT_BYTES (256 * 1024)
+#define BANNER_LINE_MAX 64
+#define PROMPT_INPUT_MAX_BYTES 256
+
+// Glyph atlas indices
+typedef enum {
+    GLYPH_DIGIT_0 = 0,
+    GLYPH_DIGIT_9 = 9,
+    GLYPH_COLON,
+    GLYPH_SPACE,
+    GLYPH_DASH,
+    GLYPH_A,
+    GLYPH_M,
+    GLYPH_P,
+    GLYPH_DOT,
+    GLYPH_COUNT
+} GlyphId;
+
+// Precompiled glyph: one fixed-width span per row, no newline scanning.
+// Rows are sized exactly ASCII_CHAR_WIDTH with no terminator, so a row that
+// is too wide is a compile error instead of an overrun into the next cell.
+typedef struct {
+    wchar_t rows[ASCII_CHAR_HEIGHT][ASCII_CHAR_WIDTH];
+} AsciiGlyph;
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable: 4295) // Rows intentionally have no null terminator
+#endif
+
+// One scale's worth of enlarged glyphs, built on first use and kept for the run.
+// Glyph g occupies (g_font.width * scale) x (g_font.height * scale)
+// cells starting at cells + g * width * height, row-major.
+typedef struct {
+    wchar_t* cells;
+} ScaledGlyphSet;
+
+// Glyph cells the clock draws with: the built-in atlas or a /font file,
+// compiled to GLYPH_COUNT same-size cells so every glyph blits alike.
+// Glyph g's rows start at cells + g * width * height.
+typedef struct {
+    int width;
+    int height;
+    int spacing;                    // Cell width plus the gap to the next glyph
+    wchar_t* cells;
+} GlyphFont;
+
+// Compiled font cache file header; the cells follow as UTF-32 values.
+// The CRC covers the cells.
+typedef struct {
+    uint32_t magic;
+    uint32_t crc;
+    uint64_t key;
+    uint16_t width;
+    uint16_t height;
+    uint16_t spacing;
+    uint16_t glyphCount;
+} FontCacheHeader;
+
+// One glyph row pre-encoded as UTF-8, spacing column included. bytes is
+// padded with blanks so it can always be copied whole.
+typedef struct {
+    unsigned char length;
+    char bytes[BANNER_ROW_BYTES];
+} BannerRow;
 
 // ASCII art definitions
-static const wchar_t* g_asciiDigits[10] = {
-    L" ███ \n██ ██\n██ ██\n██ ██\n██ ██\n ███ \n     ",
-    L"  ██ \n ███ \n  ██ \n  ██ \n  ██ \n█████\n     ",
-    L"████ \n   ██\n  ██ \n ██  \n██   \n█████\n     ",
-    L"████ \n   ██\n ███ \n   ██\n   ██\n████ \n     ",
-    L"   ██\n  ███\n ██ ██\n██████\n   ██\n   ██\n     ",
-    L"█████\n██   \n████ \n   ██\n   ██\n████ \n     ",
-    L" ███ \n██   \n████ \n██ ██\n██ ██\n ███ \n     ",
-    L"█████\n   ██\n  ██ \n ██  \n ██  \n ██  \n     ",
-    L" ███ \n██ ██\n ███ \n██ ██\n██ ██\n ███ \n     ",
-    L" ███ \n██ ██\n██ ██\n ████\n   ██\n ███ \n     "
+static const AsciiGlyph g_glyphAtlas[GLYPH_COUNT] = {
+    // 0-9
+    {{ L" ███ ", L"██ ██", L"██ ██", L"██ ██", L"██ ██", L" ███ ", L"     " }},
+    {{ L"  ██ ", L" ███ ", L"  ██ ", L"  ██ ", L"  ██ ", L"█████", L"     " }},
+    {{ L"████ ", L"   ██", L"  ██ ", L" ██  ", L"██   ", L"█████", L"     " }},
+    {{ L"████ ", L"   ██", L" ███ ", L"   ██", L"   ██", L"████ ", L"     " }},
+    {{ L"   ██", L"  ███", L" █ ██", L"█████", L"   ██", L"   ██", L"     " }},
+    {{ L"█████", L"██   ", L"████ ", L"   ██", L"   ██", L"████ ", L"     " }},
+    {{ L" ███ ", L"██   ", L"████ ", L"██ ██", L"██ ██", L" ███ ", L"     " }},
+    {{ L"█████", L"   ██", L"  ██ ", L" ██  ", L" ██  ", L" ██  ", L"     " }},
+    {{ L" ███ ", L"██ ██", L" ███ ", L"██ ██", L"██ ██", L" ███ ", L"     " }},
+    {{ L" ███ ", L"██ ██", L"██ ██", L" ████", L"   ██", L" ███ ", L"     " }},
+    // Colon
+    {{ L"     ", L"     ", L"  ██ ", L"     ", L"  ██ ", L"     ", L"     " }},
+    // Space
+    {{ L"     ", L"     ", L"     ", L"     ", L"     ", L"     ", L"     " }},
+    // Dash
+    {{ L"     ", L"     ", L"     ", L"█████", L"     ", L"     ", L"     " }},
+    // A
+    {{ L"  ██ ", L" ████", L"██ ██", L"█████", L"██ ██", L"██ ██", L"     " }},
+    // M
+    {{ L"█   █", L"██ ██", L"█████", L"██ ██", L"██ ██", L"██ ██", L"     " }},
+    // P
+    {{ L"████ ", L"██ ██", L"██ ██", L"████ ", L"██   ", L"██   ", L"     " }},
+    // Dot
+    {{ L"     ", L"     ", L"     ", L"     ", L"     ", L" ██  ", L"     " }}
+};
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+// Digit colors. A plain theme draws everything in the console's own
+// colors; the others grade the time digits from top to bottom, dim the
+// date, and flash the time red while an alarm rings.
+typedef struct {
+    const wchar_t* name;
+    BOOL colored;
+    WORD gradient[THEME_GRADIENT_STOPS];    // Foregrounds, top row to bottom
+    WORD date;
+    WORD flash[2];                          // Alarm ringing, by flash phase
+} ClockTheme;
+
+static const ClockTheme g_themes[] = {
+    { L"plain", FALSE, { 0 }, 0, { 0 } },
+    {
+        L"sunset", TRUE,
+        {
+            FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY,
+            FOREGROUND_RED | FOREGROUND_GREEN,
+            FOREGROUND_RED | FOREGROUND_INTENSITY,
+            FOREGROUND_RED
+        },
+        FOREGROUND_INTENSITY,
+        { FOREGROUND_RED | FOREGROUND_INTENSITY, FOREGROUND_RED }
+    },
+    {
+        L"ocean", TRUE,
+        {
+            FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY,
+            FOREGROUND_GREEN | FOREGROUND_BLUE,
+            FOREGROUND_BLUE | FOREGROUND_INTENSITY,
+            FOREGROUND_BLUE
+        },
+        FOREGROUND_INTENSITY,
+        { FOREGROUND_RED | FOREGROUND_INTENSITY, FOREGROUND_RED }
+    },
+    {
+        L"forest", TRUE,
+        {
+            FOREGROUND_GREEN | FOREGROUND_INTENSITY,
+            FOREGROUND_GREEN | FOREGROUND_INTENSITY,
+            FOREGROUND_GREEN,
+            FOREGROUND_GREEN
+        },
+        FOREGROUND_INTENSITY,
+        { FOREGROUND_RED | FOREGROUND_INTENSITY, FOREGROUND_RED }
+    }
 };
 
-static const wchar_t* g_asciiColon = 
-    L"     \n     \n  ██ \n     \n  ██ \n     \n     ";
-static const wchar_t* g_asciiSpace = 
-    L"     \n     \n     \n     \n     \n     \n     ";
-static const wchar_t* g_asciiDash = 
-    L"     \n     \n     \n█████\n     \n     \n     ";
-static const wchar_t* g_asciiA = 
-    L"  ██ \n ████\n██ ██\n█████\n██ ██\n██ ██\n     ";
-static const wchar_t* g_asciiM = 
-    L"█   █\n██ ██\n█████\n██ ██\n██ ██\n██ ██\n     ";
-static const wchar_t* g_asciiP = 
-    L"████ \n██ ██\n██ ██\n████ \n██   \n██   \n     ";
+// Flag recorded into a capture, and whether a value follows it
+typedef struct {
+    const wchar_t* name;
+    BOOL takesValue;
+} CaptureFlag;
+
+// The flags that change what is drawn. A capture keeps only these; journals,
+// sockets and logs are never touched by a replay, and alarms are stored as
+// they were scheduled rather than re-read from wherever they came from.
+static const CaptureFlag g_captureFlags[] = {
+    { L"/seconds", FALSE },
+    { L"/zone", TRUE },
+    { L"/layout", TRUE },
+    { L"/theme", TRUE },
+    { L"/center", FALSE },
+    { L"/stopwatch", FALSE },
+    { L"/countdown", TRUE },
+    { L"/font", TRUE }
+};
 
 // Alarm ramp speed enumeration
 typedef enum {
@@ -53,24 +491,142 @@ typedef enum {
     ALARM_RAMP_SLOW = 2        // 60 seconds
 } AlarmRampSpeed;
 
-// Alarm state structure
+// One scheduled alarm
 typedef struct {
-    BOOL isActive;
+    DWORD id;
     WORD hour;
     WORD minute;
     BOOL repeatDaily;
     AlarmRampSpeed rampSpeed;
+    wchar_t name[ALARM_NAME_LENGTH];
+    long long nextFire;     // Local wall-clock minutes since 1970-01-01
+    int heapIndex;          // Position in the scheduler heap, for O(log n) removal
+} AlarmEntry;
+
+// Open-addressed set of alarm ids; 0 marks an empty slot
+typedef struct {
+    DWORD* slots;
+    int capacity;
+    int count;
+} AlarmIdSet;
+
+// Alarms ordered by next fire time in a binary min-heap
+typedef struct {
+    AlarmEntry** heap;
+    int count;
+    int capacity;
+    DWORD nextId;               // Highest id handed out by AddAlarm
+    AlarmIdSet restoredIds;     // Startup alarms restored from the journal
+    AlarmIdSet startupIds;      // Startup alarm ids claimed this run
+} AlarmScheduler;
+
+// State of the alarm that is currently ringing
+typedef struct {
     BOOL isRinging;
+    AlarmRampSpeed rampSpeed;
     DWORD ringStartTime;
-    DWORD lastBeepTime;
+    wchar_t name[ALARM_NAME_LENGTH];
 } AlarmState;
 
+// Commands accepted by the audio worker
+typedef enum {
+    AUDIO_CMD_START_RAMP,
+    AUDIO_CMD_STOP,
+    AUDIO_CMD_SET_RAMP,
+    AUDIO_CMD_QUIT
+} AudioCommandType;
+
+typedef struct {
+    AudioCommandType type;
+    AlarmRampSpeed rampSpeed;
+    DWORD ringStartTime;
+} AudioCommand;
+
+// Command queue shared between the main loop and the audio worker
+typedef struct {
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE wake;
+    AudioCommand commands[AUDIO_QUEUE_CAPACITY];
+    int head;
+    int count;
+    BOOL running;
+} AudioQueue;
+
+// Worker-side view of the ringing alarm; owned by the audio thread only
+typedef struct {
+    BOOL ringing;
+    AlarmRampSpeed rampSpeed;
+    DWORD ringStartTime;
+    DWORD burstStartTime;
+    DWORD lastToneTime;
+    DWORD toneDelayMs;
+    DWORD frequency;
+    int tonesLeft;
+} AudioRampState;
+
+#ifdef _WIN32
+typedef HANDLE JournalFile;
+#define JOURNAL_INVALID_FILE INVALID_HANDLE_VALUE
+#else
+typedef int JournalFile;
+#define JOURNAL_INVALID_FILE (-1)
+#endif
+
+// Alarm journal record types
+typedef enum {
+    JOURNAL_RECORD_ADD = 1,
+    JOURNAL_RECORD_REMOVE = 2,
+    JOURNAL_RECORD_FIRED = 3        // A daily alarm fired; carries its next fire time
+} JournalRecordType;
+
+#define JOURNAL_FLAG_REPEAT 0x0001
+
+// One fixed-size journal record as stored on disk. Every field is naturally
+// aligned, so the layout has no padding; the CRC covers everything before it.
+typedef struct {
+    uint32_t magic;
+    uint32_t id;
+    int64_t nextFire;
+    uint16_t type;
+    uint16_t hour;
+    uint16_t minute;
+    uint16_t flags;
+    uint16_t rampSpeed;
+    uint16_t reserved;
+    char name[JOURNAL_NAME_BYTES];      // UTF-8, NUL terminated
+    uint32_t crc;
+} JournalRecord;
+
+// Append-only alarm journal. The main loop only queues records; a writer
+// thread appends them, syncs, and compacts the file when it grows stale.
+typedef struct {
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE wake;
+    JournalRecord* pending;         // Queued by the main loop
+    int pendingCount;
+    int pendingCapacity;
+    JournalRecord* writing;         // Batch being written by the writer
+    int writingCapacity;
+    BOOL quit;
+    BOOL running;
+    BOOL failed;
+    // Owned by the writer once it has started
+    JournalFile file;
+    wchar_t path[JOURNAL_PATH_MAX];
+    JournalRecord* live;            // ADD records still in effect, sorted by id
+    int liveCount;
+    int liveCapacity;
+    DWORD recordCount;              // Records currently in the file
+} AlarmJournal;
+
 // State tracking structure
 typedef struct {
     int hourTens;
     int hourOnes;
     int minuteTens;
     int minuteOnes;
+    int secondTens;
+    int secondOnes;
     BOOL isPM;
     int yearThousands;
     int yearHundreds;
@@ -83,74 +639,1084 @@ typedef struct {
     BOOL initialized;
 } DisplayState;
 
+// How a recurring rule names its transition day
+typedef enum {
+    ZONE_DATE_MONTH_WEEK,           // Mm.w.d: weekday d of week w (5 = last) of month m
+    ZONE_DATE_JULIAN,               // Jn: day 1..365, February 29 never counted
+    ZONE_DATE_ORDINAL               // n: day 0..365, February 29 counted
+} ZoneDateKind;
+
+typedef struct {
+    ZoneDateKind kind;
+    int month;
+    int week;
+    int weekday;
+    int day;
+    long time;                      // Seconds after local midnight, may be < 0 or > 24h
+} ZoneRuleDate;
+
+// Recurring daylight saving rule from a POSIX TZ string or the Windows registry.
+// DST starts at a local standard time and ends at a local daylight time.
+typedef struct {
+    long stdOffset;                 // Seconds east of UTC
+    long dstOffset;
+    BOOL hasDst;
+    ZoneRuleDate start;
+    ZoneRuleDate end;
+    wchar_t stdAbbrev[ZONE_ABBREV_LENGTH];
+    wchar_t dstAbbrev[ZONE_ABBREV_LENGTH];
+} ZoneRule;
+
+// One local time type from a TZif file
+typedef struct {
+    long offset;
+    BOOL isDst;
+    wchar_t abbrev[ZONE_ABBREV_LENGTH];
+} ZoneType;
+
+// A time zone: recorded transitions, then a rule for everything after them
+typedef struct {
+    long long* transitions;         // UTC seconds, ascending
+    unsigned char* transitionTypes;
+    int transitionCount;
+    ZoneType* types;
+    int typeCount;
+    BOOL hasRule;
+    ZoneRule rule;
+#ifdef _WIN32
+    BOOL isDynamic;                 // Rule is re-read from the registry per year
+    DYNAMIC_TIME_ZONE_INFORMATION dynamic;
+#endif
+} ZoneTable;
+
+// One world-clock pane. The offset is cached until the next transition, so
+// converting a tick is an add rather than a table search.
+typedef struct {
+    wchar_t label[ZONE_NAME_LENGTH];
+    ZoneTable table;
+    long long cacheStart;           // Cached offset is valid for [cacheStart, cacheEnd)
+    long long cacheEnd;
+    long cacheOffset;
+    wchar_t cacheAbbrev[ZONE_ABBREV_LENGTH];
+    DisplayState state;
+} ZonePane;
+
+// How the time and date share the screen
+typedef enum {
+    LAYOUT_AUTO = 0,                    // Side by side only when it allows larger digits
+    LAYOUT_STACKED,                     // Date below the time
+    LAYOUT_SIDE_BY_SIDE                 // Date to the right of the time
+} LayoutArrangement;
+
+// Screen region in cells; a region with no width or height is not drawn
+typedef struct {
+    SHORT x;
+    SHORT y;
+    SHORT width;
+    SHORT height;
+} LayoutRect;
+
+// Every region the clock draws, computed by ComputeLayout once per resize
+typedef struct {
+    SHORT width;                        // Console size the layout was computed for
+    SHORT height;
+    int scale;
+    LayoutArrangement arrangement;      // Never LAYOUT_AUTO once computed
+    LayoutRect title;
+    LayoutRect time;                    // Empty in world-clock mode
+    LayoutRect date;
+    LayoutRect panes[ZONE_PANE_MAX];
+    LayoutRect status;
+    LayoutRect overlay;                 // Alt+I stats rows, clipped above the prompt
+    LayoutRect prompt;                  // Alarm prompt row
+    SHORT glyphSpacing;                 // Time-line offsets, already scaled
+    SHORT colonOffset;
+    SHORT secondsColonOffset;
+    SHORT secondsOffset;
+    SHORT ampmOffset;
+} Layout;
+
+// Frame buffer cell (character plus console attribute)
+typedef struct {
+    wchar_t ch;
+    WORD attr;
+} FrameCell;
+
+// Run of changed cells on one row
+typedef struct {
+    SHORT x;
+    SHORT y;
+    SHORT length;
+} FrameSpan;
+
+#ifdef _WIN32
+typedef HANDLE BroadcastHandle;
+#define BROADCAST_INVALID_HANDLE INVALID_HANDLE_VALUE
+#else
+typedef int BroadcastHandle;
+#define BROADCAST_INVALID_HANDLE (-1)
+#endif
+
+// Frame message types sent from /serve to /view
+typedef enum {
+    BROADCAST_KEYFRAME = 1,             // Resets the viewer's mirror to width x height
+    BROADCAST_DIFF = 2
+} BroadcastMessageType;
+
+// Frame message header. spanCount spans follow, each x, y, length as uint16
+// and then length cells of UTF-32 character (uint32) and attribute (uint16).
+// Both ends run on the same machine, so fields are in native byte order.
+typedef struct {
+    uint32_t magic;
+    uint16_t type;
+    uint16_t spanCount;
+    uint16_t width;
+    uint16_t height;
+    uint32_t length;                    // Bytes after the header
+} BroadcastHeader;
+
+// One connected viewer. Changes pile up as a per-row dirty column range
+// while the previous message drains, so a slow viewer gets one coalesced
+// diff when it catches up instead of an ever-growing backlog.
+typedef struct {
+    BroadcastHandle handle;
+    unsigned char* pending;             // Message being written, owned by the worker
+    size_t pendingLength;
+    size_t pendingSent;
+    SHORT* dirtyLeft;                   // Per row; left > right means clean
+    SHORT* dirtyRight;
+    BOOL dirty;
+    BOOL needsKeyframe;
+} BroadcastViewer;
+
+// Frame server for /serve. FlushFrame copies changed cells into the
+// snapshot and marks viewers dirty; a worker thread accepts viewers and
+// writes to whichever can take data without blocking.
+typedef struct {
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE wake;
+    BroadcastHandle listener;
+#ifdef _WIN32
+    wchar_t pipeName[BROADCAST_PATH_MAX];
+#else
+    char socketPath[BROADCAST_PATH_MAX];
+#endif
+    FrameCell* cells;                   // Last flushed frame
+    SHORT width;
+    SHORT height;
+    BroadcastViewer viewers[BROADCAST_MAX_VIEWERS];
+    int viewerCount;
+    BOOL quit;
+    BOOL running;
+    DWORD viewersServed;
+    DWORD messagesSent;
+    DWORD framesCoalesced;              // Frame changes folded into an unsent diff
+    BOOL stopped;                       // Stopped with its report still to print
+} BroadcastServer;
+
+// What a /record or /replay run is doing with its capture
+typedef enum {
+    CAPTURE_OFF,
+    CAPTURE_RECORD,
+    CAPTURE_REPLAY
+} CaptureMode;
+
+// Capture records. Every outside input the main thread reads is one record,
+// in the order it was read, and a replay hands each back at the same call
+// site. Integers are stored as zigzag varint deltas from the previous value
+// of their type; bytes and text carry a varint length.
+typedef enum {
+    CAPTURE_LOCAL_TIME = 1,             // Bytes: SYSTEMTIME
+    CAPTURE_UTC,                        // Integer: seconds since 1970
+    CAPTURE_COUNTER,                    // Integer: performance counter
+    CAPTURE_TICKS,                      // Integer: millisecond tick count
+    CAPTURE_SIGNALS,                    // Integer: CAPTURE_SIGNAL_* bits
+    CAPTURE_INPUT,                      // Integer: event type << 32 | key, 0 ends a batch
+    CAPTURE_GEOMETRY,                   // Bytes: ConsoleGeometry
+    CAPTURE_HIDDEN,                     // Integer: display hidden
+    CAPTURE_OVERLAY,                    // Integer: overlay fits the timer budget
+    CAPTURE_TEXT,                       // Varint present, then text: prompt or overlay line
+    CAPTURE_FRAME,                      // Varint span count; x, y, length, then cells
+    CAPTURE_TYPE_COUNT
+} CaptureRecordType;
+
+// Capture file header. argCount recorded flags follow as text, then
+// alarmCount alarms as varint id, hour, minute, repeat, ramp and next fire
+// time plus the name. Text is a varint length and UTF-16 units; cells are
+// a UTF-16 character and an attribute. Fields are in native byte order.
+typedef struct {
+    uint32_t magic;
+    uint16_t argCount;
+    uint16_t alarmCount;
+    int64_t frequency;                  // Performance counter, must match on replay
+} CaptureHeader;
+
+// /record writes the capture as the clock runs; /replay reads it whole and
+// drives the main loop from it against the headless backend
+typedef struct {
+    CaptureMode mode;
+    FILE* file;
+    unsigned char* data;
+    size_t length;
+    size_t offset;
+    long long last[CAPTURE_TYPE_COUNT]; // Integer deltas are per type
+    wchar_t** args;                     // Replayed flags, kept for g_fontPath and the like
+    int argCount;
+    DWORD records;
+    DWORD frames;
+    DWORD framesDiverged;
+    BOOL finished;
+    BOOL lostStep;
+    long long replayStart;
+} CaptureState;
+
+// Where the clock reads the time. The system source asks the OS; the
+// simulated one runs on virtual time that /soak advances as fast as it can.
+typedef struct {
+    const wchar_t* name;
+    void (*GetLocal)(_Out_ SYSTEMTIME* st);
+    long long (*GetUtc)(void);
+    long long (*GetCounter)(void);
+    DWORD (*GetTicks)(void);
+} ClockSource;
+
+// Virtual time behind the simulated clock source. Local time is a fixed
+// offset from UTC, so every simulated day is 1440 minutes long.
+typedef struct {
+    long long startMs;                  // Local milliseconds since 1970 at the start
+    long long elapsedMs;
+    long long utcOffset;                // Seconds, local minus UTC
+    DWORD tickStart;                    // Tick count at the start
+} SimulatedTime;
+
+// /soak bookkeeping for one alarm: the occurrence it owes next
+typedef struct {
+    DWORD id;
+    BOOL repeatDaily;
+    long long expected;                 // Minute stamp, LLONG_MAX once a one-shot fired
+    DWORD fires;
+} SoakAlarm;
+
+// /soak: the scheduler and the alarm ramp on simulated time, checked for
+// every occurrence firing exactly once, in its own minute
+typedef struct {
+    BOOL running;
+    SoakAlarm* alarms;
+    int alarmCount;
+    AudioRampState ramp;                // Plays the audio worker's part, silently
+    AlarmRampSpeed burstSpeed;
+    DWORD burstFrequency;               // Last burst's pitch, 0 at ring start
+    BOOL reachedFull;                   // Current ring has had a full-intensity burst
+    DWORD fullSince;
+    DWORD fires;
+    DWORD missed;
+    DWORD late;
+    DWORD early;
+    DWORD rings;
+    DWORD bursts;
+    DWORD tones;
+    DWORD rampFaults;
+    DWORD faultsReported;
+} AlarmSoak;
+
+// /view side: the server's frame as last received, plus unparsed input
+typedef struct {
+    FrameCell* mirror;
+    SHORT width;
+    SHORT height;
+    unsigned char* buffer;
+    size_t length;
+    size_t capacity;
+} ViewerState;
+
+// Off-screen frame composed during a tick and flushed with one bulk write.
+// 'shown' mirrors what the console currently displays; the flush diffs
+// 'cells' against it so only changed runs are written.
+typedef struct {
+    SHORT width;
+    SHORT height;
+    FrameCell* cells;
+    FrameCell* shown;
+    FrameSpan* spans;
+    int spanCount;
+    int spanCapacity;
+    SMALL_RECT dirty;
+    BOOL isDirty;
+} FrameBuffer;
+
+// Retained text rows, in the order they are composed: a later widget covers
+// an earlier one where they overlap
+typedef enum {
+    WIDGET_TITLE,
+    WIDGET_STATUS,
+    WIDGET_PROMPT,                      // The status row itself on a short console
+    WIDGET_COUNT
+} WidgetId;
+
+// A row that keeps its content and is only composed into the frame when
+// that content, its placement or whatever it covered changes
+typedef struct {
+    LayoutRect rect;                    // Where it goes; empty when it does not fit
+    LayoutRect drawn;                   // Where it was last composed, empty if nowhere
+    WORD fillAttribute;
+    WORD textAttribute;
+    wchar_t text[WIDGET_TEXT_MAX];
+    BOOL visible;
+    BOOL dirty;
+} RowWidget;
+
+// Console geometry cached by the renderer; refreshed only on resize
+typedef struct {
+    SHORT bufferWidth;
+    SHORT bufferHeight;
+    SHORT windowWidth;
+    SHORT windowHeight;
+    SHORT windowBottom;
+    WORD attributes;
+    BOOL valid;
+} ConsoleGeometry;
+
+// What the last flush sent to the console
+typedef struct {
+    DWORD frameNumber;
+    DWORD consoleQueries;
+    DWORD spans;
+    DWORD cellsChanged;
+    DWORD cellsWritten;
+    DWORD bytesWritten;
+    DWORD paintLatencyUs;       // Second boundary to flush complete, 0 if not a tick
+} FrameStats;
+
+// Latency histogram; bucket i counts samples below 2^(i+1) microseconds
+typedef struct {
+    DWORD buckets[STATS_HISTOGRAM_BUCKETS];
+    DWORD count;
+    unsigned long long sumUs;
+    DWORD minUs;
+    DWORD maxUs;
+} StatsHistogram;
+
+// Whole-run render instrumentation, shown by Alt+I and dumped by /stats
+typedef struct {
+    LARGE_INTEGER frequency;
+    unsigned long long consoleCalls;    // Output and geometry calls made by the backend
+    unsigned long long cellsWritten;
+    unsigned long long bytesWritten;
+    DWORD framesRendered;
+    DWORD framesSkipped;                // Flushes with nothing changed
+    DWORD loopWakeups;
+    DWORD inputEvents;                  // Hotkeys and resizes
+    DWORD glyphBlits;                   // UpdateCharPosition calls
+    DWORD widgetPaints;                 // Title, status and prompt rows composed
+    DWORD zoneLookups;                  // World-clock offset cache misses
+    StatsHistogram frameTime;           // Main loop pass: compose and flush
+    StatsHistogram timeCompose;         // PrintTimeAscii
+    StatsHistogram dateCompose;         // PrintDateAscii
+    StatsHistogram inputToPaint;        // First unpainted input to flush complete
+    long long inputPending;             // Counter value of that input, 0 if none
+    long long inputArrival;             // Reader timestamp of the event being dispatched
+    DWORD fontLoadUs;                   // /font: open to compiled cells
+    const wchar_t* fontSource;          // "parsed" or "cache"; NULL for the built-in font
+} RenderStats;
+
+// Second-boundary timing for the HH:MM:SS display
+typedef struct {
+    LARGE_INTEGER frequency;
+    long long boundary;             // Counter value of the boundary being painted, 0 if none
+    WORD shownSecond;               // Second currently on screen, 0xFFFF before the first tick
+    DWORD ticks;
+    unsigned long long latencySumUs;
+    DWORD latencyMaxUs;
+} SecondTicker;
+
+// Stopwatch or countdown in place of the wall clock
+typedef enum {
+    TIMER_OFF = 0,
+    TIMER_STOPWATCH,
+    TIMER_COUNTDOWN
+} TimerMode;
+
+// /stopwatch and /countdown state. Elapsed time comes from the performance
+// counter, never the wall clock, so clock adjustments cannot move it.
+typedef struct {
+    TimerMode mode;
+    BOOL running;
+    BOOL expired;                       // Countdown reached zero; Alt+R rearms it
+    long long startCount;               // Counter value at the last start
+    long long accumulated;              // Counter ticks run before that start
+    long long lapStart;                 // Elapsed ticks at the last lap mark
+    long long countdownCs;              // Countdown length in centiseconds
+    long long laps[TIMER_LAP_MAX];      // Lap lengths in centiseconds, a ring
+    int lapCount;
+    long long shownCs;                  // Elapsed centisecond on screen, -1 if none
+    GlyphId totalGlyphs[TIMER_SLOTS];   // Glyph in each slot on screen
+    GlyphId lapGlyphs[TIMER_SLOTS];
+    DWORD frames;                       // Frames that showed a new centisecond
+    DWORD skippedTicks;                 // Centiseconds never shown while running
+    DWORD overBudget;                   // Frames longer than TIMER_FRAME_BUDGET_US
+} TimerState;
+
+// Drawing is suspended while nobody can see the clock; alarms keep running
+typedef struct {
+    BOOL suspended;
+    BOOL resumePending;                 // Repaint the whole console on the next pass
+    const wchar_t* reason;              // Why the last suspension happened
+    DWORD suspensions;
+    long long suspendedSince;           // StatsNow() at the current suspension
+    unsigned long long suspendedUs;     // Completed suspensions
+    BOOL probeDue;                      // A focus or resize event asks for a fresh probe
+    BOOL probed;
+    DWORD lastProbeTime;                // GetTickCount() at the last Win32 probe
+    const wchar_t* probedReason;        // What that probe found
+} DisplayPower;
+
+// Per-row glyph attributes for the current layout, theme and flash phase
+typedef struct {
+    WORD time[FONT_HEIGHT_MAX * GLYPH_SCALE_MAX];
+    WORD date[FONT_HEIGHT_MAX * GLYPH_SCALE_MAX];      // Date, and a timer's lap line
+    int flashPhase;                     // -1 unless a ringing alarm is flashing
+} ThemeAttributes;
+
+// Rendering backend: the only code that talks to a real console or terminal.
+// Drawing functions compose into the frame buffer; FlushFrame hands the
+// changed spans to the active backend.
+typedef struct {
+    const wchar_t* name;
+    void (*QueryGeometry)(_Out_ ConsoleGeometry* geometry);
+    void (*WriteSpans)(_In_ const FrameBuffer* frame, _Inout_ FrameStats* stats);
+    void (*SetCursor)(_In_ SHORT x, _In_ SHORT y);
+    void (*ShowCursor)(_In_ BOOL visible);
+    void (*ClearScreen)(_In_ const ConsoleGeometry* geometry);
+} RenderBackend;
+
+#ifndef _WIN32
+// VT input decoder state (Alt+key arrives as ESC followed by the key)
+typedef enum {
+    VT_INPUT_NORMAL = 0,
+    VT_INPUT_ESCAPE,
+    VT_INPUT_SEQUENCE
+} VtInputState;
+#endif
+
+// Console input decoded by the input thread
+typedef enum {
+    INPUT_EVENT_HOTKEY = 1,
+    INPUT_EVENT_RESIZE,
+    INPUT_EVENT_FOCUS                   // Only wakes the main loop to recheck visibility
+} InputEventType;
+
+typedef struct {
+    InputEventType type;
+    wchar_t key;                        // Alt+key for INPUT_EVENT_HOTKEY
+    long long timestamp;                // StatsNow() when the reader decoded it
+} InputEvent;
+
+// Single-producer/single-consumer ring from the input thread to the main
+// loop. Only the reader writes tail and only the main loop writes head; each
+// publishes its index with an interlocked store after touching the slot, so
+// neither side ever takes a lock. One slot stays empty to tell full from empty.
+typedef struct {
+    InputEvent events[INPUT_RING_CAPACITY];
+    volatile LONG head;
+    volatile LONG tail;
+} InputRing;
+
+// Input thread state. The lock only guards the pause/quit handshake used
+// while a prompt reads the console itself; events never go through it.
+typedef struct {
+    InputRing ring;
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE changed;
+    BOOL pauseRequested;
+    BOOL paused;
+    BOOL quit;
+    BOOL running;
+#ifdef _WIN32
+    HANDLE control;                     // Manual-reset: pause or quit requested
+    HANDLE ready;                       // Auto-reset: events queued for the main loop
+#else
+    int controlPipe[2];                 // Pause or quit requested
+#endif
+    DWORD highWater;                    // Most events queued at once
+    DWORD stalls;                       // Times the reader waited on a full ring
+} InputReader;
+
+// In-memory grid standing in for the console in headless rendering
+typedef struct {
+    SHORT width;
+    SHORT height;
+    FrameCell* cells;
+    SHORT cursorX;
+    SHORT cursorY;
+} HeadlessScreen;
+
 // Global variables
 static SHORT g_lastConsoleWidth = 0;
 static SHORT g_lastConsoleHeight = 0;
 static DisplayState g_displayState = { 0 };
+#ifdef _WIN32
 static HANDLE g_hConsole = INVALID_HANDLE_VALUE;
 static HANDLE g_hInput = INVALID_HANDLE_VALUE;
+#endif
+static BOOL g_hasConsoleInput = FALSE;
+static volatile sig_atomic_t g_quitRequested = 0;
 static AlarmState g_alarmState = { 0 };
+static AlarmScheduler g_alarms = { 0 };
+static AlarmJournal g_journal = { 0 };
+#ifdef _WIN32
+static HANDLE g_journalThread = NULL;
+#else
+static pthread_t g_journalThread;
+#endif
+static AudioQueue g_audioQueue = { 0 };
+static InputReader g_input = { 0 };
+#ifdef _WIN32
+static HANDLE g_inputThread = NULL;
+#else
+static pthread_t g_inputThread;
+#endif
+static BroadcastServer g_broadcast = { 0 };
+#ifdef _WIN32
+static HANDLE g_broadcastThread = NULL;
+#else
+static pthread_t g_broadcastThread;
+#endif
+static const wchar_t* g_servePath = NULL;
+static const wchar_t* g_viewPath = NULL;
+static CaptureState g_capture = { 0 };
+static const wchar_t* g_recordPath = NULL;
+static const wchar_t* g_replayPath = NULL;
+static SimulatedTime g_simulatedTime = { 0 };
+static AlarmSoak g_soak = { 0 };
+static int g_soakDays = 0;
+#ifdef _WIN32
+static HANDLE g_audioThread = NULL;
+#else
+static pthread_t g_audioThread;
+#endif
+static FrameBuffer g_frame = { 0 };
+static RowWidget g_widgets[WIDGET_COUNT] = { 0 };
+static WORD g_contentAttribute = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+static FrameStats g_lastFrameStats = { 0 };
+static ConsoleGeometry g_geometry = { 0 };
+static DWORD g_consoleQueryCount = 0;
+#ifdef _WIN32
+static CHAR_INFO* g_win32Output = NULL;
+static size_t g_win32OutputSize = 0;
+#else
+static char* g_vtOutput = NULL;
+static size_t g_vtOutputSize = 0;
+static size_t g_vtOutputLength = 0;
+static struct termios g_originalTermios;
+static struct termios g_rawTermios;
+static BOOL g_termiosSaved = FALSE;
+static int g_wakePipe[2] = { -1, -1 };
+static volatile sig_atomic_t g_resizePending = 0;
+static volatile sig_atomic_t g_continuePending = 0;
+static BOOL g_vtIsTerminal = FALSE;
+static VtInputState g_vtInputState = VT_INPUT_NORMAL;
+#endif
+static HeadlessScreen g_headless = { CONSOLE_FALLBACK_WIDTH, CONSOLE_FALLBACK_HEIGHT, NULL, 0, 0 };
+static BOOL g_renderRequested = FALSE;
+static SYSTEMTIME g_renderTime = { 0 };
+static FILE* g_frameLog = NULL;
+static BOOL g_showSeconds = FALSE;
+static Layout g_layout = { 0 };
+static LayoutArrangement g_layoutArrangement = LAYOUT_AUTO;
+static BOOL g_layoutCentered = FALSE;
+static const ClockTheme* g_theme = &g_themes[0];
+static ThemeAttributes g_themeAttributes = { { 0 }, { 0 }, -1 };
+static ScaledGlyphSet g_scaledGlyphs[GLYPH_SCALE_MAX + 1] = { 0 };
+static wchar_t g_builtinFontCells[GLYPH_COUNT * ASCII_CHAR_WIDTH * ASCII_CHAR_HEIGHT];
+static GlyphFont g_font = { 0 };
+static const wchar_t* g_fontPath = NULL;
+static ZonePane g_zonePanes[ZONE_PANE_MAX];
+static BannerRow g_bannerRows[GLYPH_COUNT][ASCII_CHAR_HEIGHT];
+static BOOL g_bannerMode = FALSE;
+static int g_zonePaneCount = 0;
+static RenderStats g_renderStats = { 0 };
+static BOOL g_statsOverlay = FALSE;
+static const wchar_t* g_statsPath = NULL;
+static SecondTicker g_secondTicker = { 0 };
+static TimerState g_timer = { 0 };
+static DisplayPower g_power = { 0 };
 
 // Function declarations
-_Success_(return != NULL)
-_Ret_notnull_
-static const wchar_t* GetAsciiDigit(_In_ int digit);
+static GlyphId GetAsciiDigit(_In_ int digit);
+static BOOL ValidateGlyphAtlas(void);
+static const wchar_t* GetScaledGlyph(_In_ GlyphId id, _In_ int scale);
+static void FreeScaledGlyphs(void);
+static void UseBuiltinFont(void);
+static uint64_t Fnv1a64(_In_reads_(length) const void* data, _In_ size_t length, _In_ uint64_t hash);
+static size_t DecodeFontChar(_In_reads_(length) const unsigned char* bytes, _In_ size_t length, _Out_ wchar_t* ch);
+static BOOL ParseFontNumber(_Inout_ const unsigned char** cursor, _In_ const unsigned char* end, _Out_ int* value);
+static BOOL ParseFigletFont(
+    _In_reads_(size) const unsigned char* data,
+    _In_ size_t size,
+    _Out_ GlyphFont* font
+);
+static BOOL LoadFontCache(_In_z_ const wchar_t* cachePath, _In_ uint64_t key, _Out_ GlyphFont* font);
+static void SaveFontCache(_In_z_ const wchar_t* cachePath, _In_ uint64_t key, _In_ const GlyphFont* font);
+static BOOL LoadFont(_In_z_ const wchar_t* path);
+static void FreeFont(void);
+static int GetTimeWidth(void);
+static LayoutRect MakeLayoutRect(_In_ int x, _In_ int y, _In_ int width, _In_ int height);
+static BOOL BuildLayout(
+    _In_ LayoutArrangement arrangement,
+    _In_ int scale,
+    _Out_ Layout* layout
+);
+static void ComputeLayout(void);
+static BOOL ParseLayoutName(_In_z_ const wchar_t* text, _Out_ LayoutArrangement* arrangement);
+static BOOL ParseThemeName(_In_z_ const wchar_t* text, _Out_ const ClockTheme** theme);
+static int GetAlarmFlashPhase(void);
+static DWORD GetAlarmFlashDelayMs(void);
+static void BuildThemeAttributes(void);
+static BOOL UpdateThemePhase(void);
+static BOOL IsInLayoutRect(_In_ const LayoutRect* rect, _In_ SHORT x, _In_ SHORT y);
 static void SetCursorPosition(_In_ SHORT x, _In_ SHORT y);
+static void GetFrameSize(_Out_ SHORT* width, _Out_ SHORT* height);
+static BOOL IsLayoutCurrent(void);
+static BOOL ResizeFrameBuffer(void);
+static void FreeFrameBuffer(void);
+static void MarkFrameDirty(
+    _In_ SHORT left,
+    _In_ SHORT top,
+    _In_ SHORT right,
+    _In_ SHORT bottom
+);
+static void FrameWriteCells(
+    _In_ SHORT x,
+    _In_ SHORT y,
+    _In_reads_(count) const wchar_t* chars,
+    _In_ int count,
+    _In_ WORD attr
+);
+static void FrameWriteText(
+    _In_ SHORT x,
+    _In_ SHORT y,
+    _In_z_ const wchar_t* text,
+    _In_ WORD attr
+);
+static void FrameFillRect(
+    _In_ SHORT x,
+    _In_ SHORT y,
+    _In_ SHORT width,
+    _In_ SHORT height,
+    _In_ wchar_t ch,
+    _In_ WORD attr
+);
+static void InvalidateFrameRect(
+    _In_ SHORT x,
+    _In_ SHORT y,
+    _In_ SHORT width,
+    _In_ SHORT height
+);
+static BOOL LayoutRectsOverlap(_In_ const LayoutRect* a, _In_ const LayoutRect* b);
+static void PlaceWidgets(void);
+static void SetWidgetText(
+    _In_ WidgetId id,
+    _In_z_ const wchar_t* text,
+    _In_ WORD fillAttribute,
+    _In_ WORD textAttribute
+);
+static void HideWidget(_In_ WidgetId id);
+static void InvalidateWidgets(void);
+static void ComposeWidgets(void);
+static void DiffFrame(void);
+static void FlushFrame(void);
 static void UpdateCharPosition(
     _In_ SHORT x, 
     _In_ SHORT y, 
-    _In_ const wchar_t* asciiChar
+    _In_ GlyphId glyph
 );
 static void UpdateCharPositionIfChanged(
     _In_ SHORT x,
     _In_ SHORT y,
-    _In_ const wchar_t* asciiChar,
-    _In_ const wchar_t* oldAsciiChar
+    _In_ GlyphId glyph,
+    _In_ GlyphId oldGlyph
 );
 static void PrintTimeAscii(
     _In_ const SYSTEMTIME* st, 
     _In_ SHORT startX, 
     _In_ SHORT startY,
-    _In_ BOOL forceRedraw
+    _In_ BOOL forceRedraw,
+    _Inout_ DisplayState* state
 );
 static void PrintDateAscii(
     _In_ const SYSTEMTIME* st, 
     _In_ SHORT startX, 
     _In_ SHORT startY,
-    _In_ BOOL forceRedraw
+    _In_ BOOL forceRedraw,
+    _Inout_ DisplayState* state
 );
-static void ClearScreenSafe(void);
 static void HideCursor(_In_ BOOL hide);
 static void PrintTitleLine(void);
 static BOOL CheckConsoleResize(void);
+static void RefreshConsoleGeometry(void);
 static void GetConsoleSize(_Out_ SHORT* width, _Out_ SHORT* height);
-static BOOL CheckForResizeEvent(void);
+static BOOL ProcessConsoleInput(void);
 static void RedrawAll(_In_ const SYSTEMTIME* st);
 static void ParseCommandLineArgs(_In_ int argc, _In_ wchar_t* argv[]);
-static void CheckKeyboardInput(void);
+static void HandleHotkey(_In_ wchar_t key);
+static BOOL InitConsole(void);
+static void ShutdownConsole(void);
+static void DiscardPendingInput(void);
+static BOOL ReadPromptLine(
+    _Out_ wchar_t* buffer,
+    _In_ DWORD capacity,
+    _Out_ DWORD* charsRead
+);
+static void PlayTone(_In_ DWORD frequency, _In_ DWORD durationMs);
+static const wchar_t* GetDisplayHiddenReason(void);
+static void RestoreConsoleModes(void);
+static BOOL UpdateDisplayPower(void);
+static DWORD GetMinuteWakeDelayMs(void);
+static DWORD GetNextWakeDelayMs(void);
+static void WaitForNextPass(void);
+static DWORD GetWallClockMicroseconds(void);
+static void SpinYield(void);
+static long long GetUtcSeconds(void);
+static long long LocalTimeToUtcSeconds(_In_ const SYSTEMTIME* st);
+static long long DaysFromCivil(_In_ int year, _In_ int month, _In_ int day);
+static void CivilFromDays(_In_ long long days, _Out_ int* year, _Out_ int* month, _Out_ int* day);
+static void SecondsToSystemTime(_In_ long long seconds, _Out_ SYSTEMTIME* st);
+static BOOL ParsePosixTzRule(_In_z_ const char* text, _Out_ ZoneRule* rule);
+static BOOL ParseZoneInfo(_In_reads_(size) const unsigned char* data, _In_ size_t size, _Inout_ ZoneTable* table);
+static BOOL GetZoneRuleForYear(_In_ ZoneTable* table, _In_ int year, _Out_ ZoneRule* rule);
+static long long GetZoneRuleTransition(_In_ const ZoneRuleDate* date, _In_ int year, _In_ long offset);
+static long long LookupZoneRule(
+    _In_ ZoneTable* table,
+    _In_ long long utc,
+    _Out_ long* offset,
+    _Out_writes_(ZONE_ABBREV_LENGTH) wchar_t* abbrev
+);
+static long long LookupZone(
+    _In_ ZoneTable* table,
+    _In_ long long utc,
+    _Out_ long* offset,
+    _Out_writes_(ZONE_ABBREV_LENGTH) wchar_t* abbrev
+);
+static BOOL LoadZoneTable(_In_z_ const wchar_t* id, _Out_ ZoneTable* table);
+static void FreeZoneTable(_Inout_ ZoneTable* table);
+static BOOL AddZonePane(_In_z_ const wchar_t* spec);
+static void FreeZonePanes(void);
+static void GetPaneLocalTime(_Inout_ ZonePane* pane, _In_ long long utc, _Out_ SYSTEMTIME* st);
+static long long GetWorldClockUtc(void);
+static void PrintWorldClock(_In_ BOOL forceRedraw);
+static void BeginSecondTicker(void);
+static void EndSecondTicker(void);
+static void WaitForSecondBoundary(void);
+static void RecordSecondLatency(void);
+static BOOL ParseTimerDuration(_In_z_ const wchar_t* text, _Out_ long long* centiseconds);
+static long long GetTimerElapsed(void);
+static long long TimerTicksToCentiseconds(_In_ long long ticks);
+static void ComposeTimerGlyphs(_In_ long long centiseconds, _Out_writes_(TIMER_SLOTS) GlyphId* glyphs);
+static void DrawTimerLine(
+    _In_ SHORT startX,
+    _In_ SHORT startY,
+    _In_ long long centiseconds,
+    _In_ BOOL forceRedraw,
+    _Inout_ GlyphId* shown
+);
+static void CheckTimerExpiry(void);
+static void PrintTimer(_In_ BOOL forceRedraw);
+static long GetTimerBudgetLeftUs(_In_ long long frameStart);
+static BOOL HandleTimerHotkey(_In_ wchar_t key);
+static void BeginTimerMode(void);
+static void EndTimerMode(void);
+static void InitRenderStats(void);
+static long long StatsNow(void);
+static void StatsRecordSince(_Inout_ StatsHistogram* histogram, _In_ long long start);
+static DWORD StatsPercentileUs(_In_ const StatsHistogram* histogram, _In_ DWORD percent);
+static void StatsMarkInput(void);
+static void StatsInputPainted(void);
+static void DrawStatsOverlay(void);
+static void ClearStatsOverlay(void);
+static void WriteStatsHistogram(
+    _In_ FILE* file,
+    _In_z_ const wchar_t* label,
+    _In_ const StatsHistogram* histogram
+);
+static void DumpRenderStats(void);
+static void WaitForNextEvent(_In_ DWORD timeoutMs);
 static void PromptForAlarm(void);
+static void ShowPromptText(_In_z_ const wchar_t* text);
+static void ClearPromptRow(void);
 static void PrintAlarmStatusLine(void);
 static void CheckAlarmTime(_In_ const SYSTEMTIME* st);
-static void TriggerAlarm(void);
-static void UpdateAlarmBeep(void);
+static void TriggerAlarm(_In_ const AlarmEntry* entry);
+static long long GetLocalMinuteStamp(_In_ const SYSTEMTIME* st);
+static BOOL AlarmFiresBefore(_In_ const AlarmEntry* a, _In_ const AlarmEntry* b);
+static void AlarmHeapSwap(_In_ int i, _In_ int j);
+static void AlarmHeapSiftUp(_In_ int index);
+static void AlarmHeapSiftDown(_In_ int index);
+static BOOL AlarmIdSetFind(_In_ const AlarmIdSet* set, _In_ DWORD id);
+static BOOL AlarmIdSetAdd(_Inout_ AlarmIdSet* set, _In_ DWORD id);
+static void AlarmIdSetFree(_Inout_ AlarmIdSet* set);
+static AlarmEntry* AddAlarm(
+    _In_ WORD hour,
+    _In_ WORD minute,
+    _In_ BOOL repeatDaily,
+    _In_ AlarmRampSpeed rampSpeed,
+    _In_z_ const wchar_t* name
+);
+static void AddStartupAlarm(
+    _In_ WORD hour,
+    _In_ WORD minute,
+    _In_ BOOL repeatDaily,
+    _In_ AlarmRampSpeed rampSpeed,
+    _In_z_ const wchar_t* name
+);
+static AlarmEntry* InsertAlarm(
+    _In_ DWORD id,
+    _In_ WORD hour,
+    _In_ WORD minute,
+    _In_ BOOL repeatDaily,
+    _In_ AlarmRampSpeed rampSpeed,
+    _In_z_ const wchar_t* name
+);
+static void RescheduleAlarm(_Inout_ AlarmEntry* entry, _In_ long long nextFire);
+static void RemoveAlarm(_In_ AlarmEntry* entry);
+static void CancelNextAlarm(void);
+static void FreeAlarmScheduler(void);
+static int GetUpcomingAlarms(_Out_writes_(maxCount) const AlarmEntry** upcoming, _In_ int maxCount);
+static const wchar_t* GetRampName(_In_ AlarmRampSpeed speed);
+static BOOL ParseRampName(_In_z_ const wchar_t* text, _Out_ AlarmRampSpeed* speed);
+static BOOL LoadAlarmFile(_In_z_ const wchar_t* path);
+static uint32_t JournalCrc32(_In_reads_(length) const void* data, _In_ size_t length);
+static BOOL JournalRecordValid(_In_ const JournalRecord* record);
+static void JournalRecordAlarm(_In_ JournalRecordType type, _In_ const AlarmEntry* entry);
+static BOOL JournalLiveApply(_In_ const JournalRecord* record);
+static BOOL OpenAlarmJournal(_In_z_ const wchar_t* path);
+static void CloseAlarmJournal(void);
+static BOOL CompactAlarmJournal(void);
+static void RunJournalWriter(void);
+static JournalFile JournalFileOpen(_In_z_ const wchar_t* path, _In_ BOOL truncate);
+static const unsigned char* JournalFileMap(_In_ JournalFile file, _Out_ size_t* size);
+static void JournalFileUnmap(_In_ const unsigned char* view, _In_ size_t size);
+static BOOL JournalFileSetLength(_In_ JournalFile file, _In_ size_t length);
+static BOOL JournalFileWrite(_In_ JournalFile file, _In_reads_(length) const void* data, _In_ size_t length);
+static BOOL JournalFileSync(_In_ JournalFile file);
+static void JournalFileClose(_In_ JournalFile file);
+static BOOL JournalFileReplace(_In_z_ const wchar_t* source, _In_z_ const wchar_t* target);
+static JournalFile FontFileOpen(_In_z_ const wchar_t* path);
+static BOOL FontFileIdentity(_In_ JournalFile file, _Out_ uint64_t* size, _Out_ uint64_t* modified);
+static BOOL GetFontCachePath(_In_ uint64_t key, _Out_writes_(capacity) wchar_t* path, _In_ size_t capacity);
+static void DeleteFontCacheFile(_In_z_ const wchar_t* path);
 static DWORD GetRampDurationMs(_In_ AlarmRampSpeed speed);
+static void ComputeAlarmBurst(
+    _In_ DWORD elapsedMs,
+    _In_ AlarmRampSpeed speed,
+    _Out_ DWORD* frequency,
+    _Out_ int* toneCount
+);
+static void PutBroadcastUint16(_Inout_ unsigned char** cursor, _In_ uint16_t value);
+static void PutBroadcastUint32(_Inout_ unsigned char** cursor, _In_ uint32_t value);
+static void MarkViewerKeyframe(_Inout_ BroadcastViewer* viewer);
+static BOOL ResizeViewerRows(_Inout_ BroadcastViewer* viewer);
+static void DropViewer(_In_ int index);
+static BOOL StartBroadcastServer(_In_z_ const wchar_t* path);
+static void StopBroadcastServer(void);
+static void ReportBroadcastServer(void);
+static void BroadcastFrame(void);
+static BOOL BuildViewerMessage(_Inout_ BroadcastViewer* viewer);
+static void RunBroadcastServer(void);
+static BOOL ApplyBroadcastMessage(
+    _Inout_ ViewerState* viewer,
+    _In_ const BroadcastHeader* header,
+    _In_reads_(header->length) const unsigned char* body
+);
+static void BlitViewerMirror(_In_ const ViewerState* viewer);
+static int RunViewer(void);
+#ifdef _WIN32
+static DWORD WINAPI BroadcastThreadMain(_In_ LPVOID param);
+#else
+static void* BroadcastThreadMain(void* param);
+#endif
+static BroadcastHandle BroadcastListen(_In_z_ const wchar_t* path);
+static BroadcastHandle BroadcastAccept(void);
+static long BroadcastSend(_In_ BroadcastHandle handle, _In_reads_(length) const void* data, _In_ size_t length);
+static void BroadcastCloseListener(void);
+static BroadcastHandle BroadcastConnect(_In_z_ const wchar_t* path);
+static long BroadcastReceive(
+    _In_ BroadcastHandle handle,
+    _Out_writes_(size) void* data,
+    _In_ size_t size,
+    _In_ DWORD timeoutMs
+);
+static void BroadcastClose(_In_ BroadcastHandle handle);
+static void CapturePutByte(_In_ unsigned char value);
+static void CapturePutVarint(_In_ uint64_t value);
+static void CapturePutText(_In_reads_(length) const wchar_t* text, _In_ size_t length);
+static BOOL CaptureGetVarint(_Out_ uint64_t* value);
+static BOOL CaptureGetText(_Out_writes_(capacity) wchar_t* text, _In_ size_t capacity, _Out_ size_t* length);
+static void StopReplay(_In_z_ const wchar_t* problem);
+static BOOL CaptureNextRecord(_In_ CaptureRecordType type);
+static long long CaptureInteger(_In_ CaptureRecordType type, _In_ long long value);
+static void CaptureBytes(_In_ CaptureRecordType type, _Inout_ void* data, _In_ size_t size);
+static BOOL CaptureText(_Inout_ wchar_t* text, _In_ size_t capacity, _Inout_ size_t* length, _In_ BOOL present);
+static void CaptureFrame(void);
+static BOOL PopCapturedInputEvent(_Out_ InputEvent* event);
+static BOOL ReadPromptInput(_Out_writes_(capacity) wchar_t* buffer, _In_ DWORD capacity, _Out_ DWORD* charsRead);
+static void ReadLocalTime(_Out_ SYSTEMTIME* st);
+static long long ReadUtcSeconds(void);
+static long long ReadCounter(void);
+static DWORD ReadTickCount(void);
+static const CaptureFlag* FindCaptureFlag(_In_z_ const wchar_t* arg);
+static BOOL StartCaptureRecording(_In_z_ const wchar_t* path, _In_ int argc, _In_reads_(argc) wchar_t* argv[]);
+static BOOL OpenCaptureReplay(_In_z_ const wchar_t* path);
+static BOOL EndCapture(void);
+static void SystemClockLocal(_Out_ SYSTEMTIME* st);
+static long long SystemClockUtc(void);
+static long long SystemClockCounter(void);
+static DWORD SystemClockTicks(void);
+static void SimulatedClockLocal(_Out_ SYSTEMTIME* st);
+static long long SimulatedClockUtc(void);
+static long long SimulatedClockCounter(void);
+static DWORD SimulatedClockTicks(void);
+static void StartSimulatedClock(void);
+static void FormatSoakMinute(_In_ long long stamp, _Out_writes_(SOAK_TIME_LENGTH) wchar_t* text);
+static BOOL SoakShouldReport(void);
+static void SoakRecordFire(_In_ const AlarmEntry* entry, _In_ long long now);
+static void SoakAudioCommand(_In_ const AudioCommand* command);
+static void SoakAdvanceRamp(void);
+static void AddSoakAlarms(void);
+static int RunAlarmSoak(void);
+static BOOL StartAudioWorker(void);
+static void StopAudioWorker(void);
+static void PostAudioCommand(_In_ AudioCommandType type);
+static void ApplyAudioCommand(_Inout_ AudioRampState* ramp, _In_ const AudioCommand* command);
+static DWORD NextAlarmTone(_Inout_ AudioRampState* ramp, _In_ DWORD currentTime);
+static void PlayNextAlarmTone(_Inout_ AudioRampState* ramp);
+static void RunAudioWorker(void);
+#ifdef _WIN32
+static DWORD WINAPI InputThreadMain(_In_ LPVOID param);
+#else
+static void* InputThreadMain(void* param);
+#endif
+static BOOL StartInputReader(void);
+static void StopInputReader(void);
+static void PauseInputReader(void);
+static void ResumeInputReader(void);
+static BOOL InputReaderCheckpoint(void);
+static void SignalInputReader(void);
+static void WakeMainLoop(void);
+static BOOL PushInputEvent(_In_ const InputEvent* event);
+static BOOL PopInputEvent(_Out_ InputEvent* event);
+static void RunInputReader(void);
+#ifdef _WIN32
+static void Win32QueryGeometry(_Out_ ConsoleGeometry* geometry);
+static void Win32WriteSpans(_In_ const FrameBuffer* frame, _Inout_ FrameStats* stats);
+static void Win32SetCursor(_In_ SHORT x, _In_ SHORT y);
+static void Win32ShowCursor(_In_ BOOL visible);
+static void Win32ClearScreen(_In_ const ConsoleGeometry* geometry);
+#else
+static void VtQueryGeometry(_Out_ ConsoleGeometry* geometry);
+static void VtWriteSpans(_In_ const FrameBuffer* frame, _Inout_ FrameStats* stats);
+static void VtSetCursor(_In_ SHORT x, _In_ SHORT y);
+static void VtShowCursor(_In_ BOOL visible);
+static void VtClearScreen(_In_ const ConsoleGeometry* geometry);
+static BOOL VtAppend(_In_reads_(length) const char* bytes, _In_ size_t length);
+static void VtAppendAttribute(_In_ WORD attr);
+static void VtFlushOutput(void);
+static void VtSignalHandler(int signalNumber);
+static void VtDecodeInput(
+    _In_reads_(length) const unsigned char* bytes,
+    _In_ size_t length,
+    _In_ long long timestamp
+);
+#endif
+static void HeadlessQueryGeometry(_Out_ ConsoleGeometry* geometry);
+static void HeadlessWriteSpans(_In_ const FrameBuffer* frame, _Inout_ FrameStats* stats);
+static void HeadlessSetCursor(_In_ SHORT x, _In_ SHORT y);
+static void HeadlessShowCursor(_In_ BOOL visible);
+static void HeadlessClearScreen(_In_ const ConsoleGeometry* geometry);
+static int RunHeadlessRender(void);
+static size_t EncodeUtf8(_In_ wchar_t ch, _Out_writes_(3) char* bytes);
+static void BuildBannerRows(void);
+static BOOL ParseBannerDigits(_In_reads_(count) const char* text, _In_ int count, _Out_ int* value);
+static BOOL ParseBannerTimestamp(
+    _In_reads_(length) const char* text,
+    _In_ size_t length,
+    _Out_ SYSTEMTIME* st
+);
+static char* AppendBanner(_Out_writes_(BANNER_MAX_BYTES) char* cursor, _In_ const SYSTEMTIME* st);
+static BOOL WriteBannerOutput(_In_reads_(length) const char* bytes, _In_ size_t length);
+static int RunBannerMode(void);
+
+// Render backends
+#ifdef _WIN32
+static const RenderBackend g_win32Backend = {
+    L"win32",
+    Win32QueryGeometry,
+    Win32WriteSpans,
+    Win32SetCursor,
+    Win32ShowCursor,
+    Win32ClearScreen
+};
+#else
+static const RenderBackend g_vtBackend = {
+    L"vt",
+    VtQueryGeometry,
+    VtWriteSpans,
+    VtSetCursor,
+    VtShowCursor,
+    VtClearScreen
+};
+#endif
+
+static const RenderBackend g_headlessBackend = {
+    L"headless",
+    HeadlessQueryGeometry,
+    HeadlessWriteSpans,
+    HeadlessSetCursor,
+    HeadlessShowCursor,
+    HeadlessClearScreen
+};
+
+#ifdef _WIN32
+static const RenderBackend* g_backend = &g_win32Backend;
+#else
+static const RenderBackend* g_backend = &g_vtBackend;
+#endif
+
+// Clock sources
+static const ClockSource g_systemClock = {
+    L"system",
+    SystemClockLocal,
+    SystemClockUtc,
+    SystemClockCounter,
+    SystemClockTicks
+};
+
+static const ClockSource g_simulatedClock = {
+    L"simulated",
+    SimulatedClockLocal,
+    SimulatedClockUtc,
+    SimulatedClockCounter,
+    SimulatedClockTicks
+};
+
+static const ClockSource* g_clock = &g_systemClock;
+
+// Query the console once and cache its geometry for all draw paths
+static void RefreshConsoleGeometry(void) {
+    g_consoleQueryCount++;
+    g_backend->QueryGeometry(&g_geometry);
+    CaptureBytes(CAPTURE_GEOMETRY, &g_geometry, sizeof(g_geometry));
+}
 
-// Get current console size
+// Get console window size from the cached geometry
 static void GetConsoleSize(_Out_ SHORT* width, _Out_ SHORT* height) {
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    
-    if (GetConsoleScreenBufferInfo(g_hConsole, &csbi)) {
-        *width = csbi.srWindow.Right - csbi.srWindow.Left + 1;
-        *height = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
-    } else {
-        *width = CONSOLE_FALLBACK_WIDTH;
-        *height = CONSOLE_FALLBACK_HEIGHT;
-    }
+    *width = g_geometry.windowWidth;
+    *height = g_geometry.windowHeight;
 }
 
-// Check if console has been resized
+// Re-read the console geometry and check if it has been resized
 static BOOL CheckConsoleResize(void) {
     SHORT currentWidth, currentHeight;
+    RefreshConsoleGeometry();
     GetConsoleSize(&currentWidth, &currentHeight);
     
     if (g_lastConsoleWidth == 0 && g_lastConsoleHeight == 0) {
@@ -169,801 +1735,7526 @@ static BOOL CheckConsoleResize(void) {
     return FALSE;
 }
 
-// Fast check for resize events
-static BOOL CheckForResizeEvent(void) {
-    HANDLE hInput = GetStdHandle(STD_INPUT_HANDLE);
-    if (hInput == INVALID_HANDLE_VALUE) {
-        return FALSE;
-    }
-    
-    INPUT_RECORD irInBuf[RESIZE_EVENT_BUFFER_SIZE];
-    DWORD cNumRead;
+#ifdef _WIN32
+// Input thread: block on the console and queue every key and resize record.
+// Each batch ReadConsoleInput returns is decoded in full, so keys that
+// arrive alongside a resize are never discarded.
+static void RunInputReader(void) {
+    HANDLE handles[2] = { g_hInput, g_input.control };
+    INPUT_RECORD records[INPUT_EVENT_BUFFER_SIZE];
     
-    if (!PeekConsoleInput(hInput, irInBuf, RESIZE_EVENT_BUFFER_SIZE, &cNumRead)) {
-        return FALSE;
-    }
-    
-    for (DWORD i = 0; i < cNumRead; i++) {
-        if (irInBuf[i].EventType == WINDOW_BUFFER_SIZE_EVENT) {
-            ReadConsoleInput(hInput, irInBuf, cNumRead, &cNumRead);
-            return TRUE;
+    while (InputReaderCheckpoint()) {
+        DWORD signaled = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+        if (signaled == WAIT_OBJECT_0 + 1) {
+            continue;   // Pause or quit; the checkpoint handles both
+        }
+        
+        DWORD pending = 0;
+        DWORD count = 0;
+        if (signaled != WAIT_OBJECT_0 || 
+            !GetNumberOfConsoleInputEvents(g_hInput, &pending)) {
+            break;
+        }
+        if (pending == 0) {
+            continue;
+        }
+        if (!ReadConsoleInput(g_hInput, records, INPUT_EVENT_BUFFER_SIZE, &count)) {
+            break;
+        }
+        
+        InputEvent event;
+        LONG tail = g_input.ring.tail;
+        event.timestamp = StatsNow();
+        for (DWORD i = 0; i < count; i++) {
+            if (records[i].EventType == WINDOW_BUFFER_SIZE_EVENT) {
+                event.type = INPUT_EVENT_RESIZE;
+                event.key = 0;
+            } else if (records[i].EventType == FOCUS_EVENT) {
+                // Restoring a minimized console focuses it
+                event.type = INPUT_EVENT_FOCUS;
+                event.key = 0;
+            } else if (records[i].EventType == KEY_EVENT &&
+                       records[i].Event.KeyEvent.bKeyDown &&
+                       (records[i].Event.KeyEvent.dwControlKeyState & 
+                        (LEFT_ALT_PRESSED | RIGHT_ALT_PRESSED))) {
+                event.type = INPUT_EVENT_HOTKEY;
+                event.key = (wchar_t)records[i].Event.KeyEvent.wVirtualKeyCode;
+            } else {
+                continue;
+            }
+            PushInputEvent(&event);
+        }
+        
+        if (g_input.ring.tail != tail) {
+            WakeMainLoop();
         }
     }
-    
-    return FALSE;
-}
-
-// Get ASCII art representation of a digit
-_Success_(return != NULL)
-_Ret_notnull_
-static const wchar_t* GetAsciiDigit(_In_ int digit) {
-    if (digit < 0 || digit > 9) {
-        return g_asciiSpace;
-    }
-    return g_asciiDigits[digit];
 }
 
-// Position cursor at specific coordinates
-static void SetCursorPosition(_In_ SHORT x, _In_ SHORT y) {
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    
-    if (!GetConsoleScreenBufferInfo(g_hConsole, &csbi)) {
+// Ask the input thread to look at its pause/quit flags
+static void SignalInputReader(void) {
+    SetEvent(g_input.control);
+}
+
+// Wake the main loop out of WaitForNextEvent
+static void WakeMainLoop(void) {
+    SetEvent(g_input.ready);
+}
+
+// Block until the timeout elapses or the input thread queues an event
+static void WaitForNextEvent(_In_ DWORD timeoutMs) {
+    if (timeoutMs == 0) {
         return;
     }
     
-    if (x < 0) x = 0;
-    if (y < 0) y = 0;
-    if (x >= csbi.dwSize.X) x = csbi.dwSize.X - 1;
-    if (y >= csbi.dwSize.Y) y = csbi.dwSize.Y - 1;
-    
-    COORD cursorPos = { x, y };
-    SetConsoleCursorPosition(g_hConsole, cursorPos);
+    if (g_input.running) {
+        WaitForSingleObject(g_input.ready, timeoutMs);
+    } else {
+        Sleep(timeoutMs);
+    }
 }
 
-// Hide or show the cursor
-static void HideCursor(_In_ BOOL hide) {
-    CONSOLE_CURSOR_INFO cursorInfo;
+// Why nobody can see the console, or NULL if someone might: redirected,
+// minimized or locked. A window that is merely covered cannot be told apart
+// cheaply, so it still draws. The probe costs several calls, so it runs at
+// most once per POWER_PROBE_MS unless a focus or resize event came in.
+static const wchar_t* GetDisplayHiddenReason(void) {
+    DWORD now = GetTickCount();
+    if (g_power.probed && !g_power.probeDue && now - g_power.lastProbeTime < POWER_PROBE_MS) {
+        return g_power.probedReason;
+    }
+    g_power.probed = TRUE;
+    g_power.probeDue = FALSE;
+    g_power.lastProbeTime = now;
     
-    if (!GetConsoleCursorInfo(g_hConsole, &cursorInfo)) {
-        return;
+    DWORD mode;
+    HWND window = GetConsoleWindow();
+    HDESK desktop;
+    if (!GetConsoleMode(g_hConsole, &mode)) {
+        g_power.probedReason = L"redirected";
+    } else if (window && IsIconic(window)) {
+        g_power.probedReason = L"minimized";
+    } else if ((desktop = OpenInputDesktop(0, FALSE, DESKTOP_SWITCHDESKTOP)) == NULL) {
+        // The input desktop belongs to Winlogon while the session is locked
+        g_power.probedReason = L"locked";
+    } else {
+        CloseDesktop(desktop);
+        g_power.probedReason = NULL;
+    }
+    return g_power.probedReason;
+}
+
+// Console modes survive minimizing and locking; nothing to put back
+static void RestoreConsoleModes(void) {
+}
+
+// Acquire the console handles and enable window (resize) input
+static BOOL InitConsole(void) {
+    g_hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (g_hConsole == INVALID_HANDLE_VALUE) {
+        fwprintf(
+            stderr, 
+            L"Error: Could not get console handle (error %lu)\n", 
+            GetLastError()
+        );
+        return FALSE;
+    }
+
+    g_hInput = GetStdHandle(STD_INPUT_HANDLE);
+    if (g_hInput != INVALID_HANDLE_VALUE) {
+        DWORD mode;
+        if (GetConsoleMode(g_hInput, &mode)) {
+            SetConsoleMode(g_hInput, mode | ENABLE_WINDOW_INPUT | ENABLE_PROCESSED_INPUT);
+            g_hasConsoleInput = TRUE;
+        }
     }
     
-    cursorInfo.bVisible = !hide;
-    SetConsoleCursorInfo(g_hConsole, &cursorInfo);
+    return TRUE;
 }
 
-// Update a single character position (direct overwrite, no clearing)
-static void UpdateCharPosition(
-    _In_ SHORT x, 
-    _In_ SHORT y, 
-    _In_ const wchar_t* asciiChar
+// Release console resources
+static void ShutdownConsole(void) {
+    free(g_win32Output);
+    g_win32Output = NULL;
+    g_win32OutputSize = 0;
+}
+
+// Drop any input typed before the clock started
+static void DiscardPendingInput(void) {
+    if (g_hasConsoleInput) {
+        FlushConsoleInputBuffer(g_hInput);
+    }
+}
+
+// Read one line of echoed input for a prompt
+static BOOL ReadPromptLine(
+    _Out_ wchar_t* buffer,
+    _In_ DWORD capacity,
+    _Out_ DWORD* charsRead
 ) {
-    if (!asciiChar) return;
+    *charsRead = 0;
+    return ReadConsoleW(g_hInput, buffer, capacity, charsRead, NULL);
+}
+
+// Sound one alarm tone
+static void PlayTone(_In_ DWORD frequency, _In_ DWORD durationMs) {
+    Beep(frequency, durationMs);
+}
+
+// Microseconds into the current wall-clock second, from the precise
+// system time (GetLocalTime only moves once per timer tick)
+static DWORD GetWallClockMicroseconds(void) {
+    FILETIME now;
+    GetSystemTimePreciseAsFileTime(&now);
     
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
+    ULARGE_INTEGER ticks;
+    ticks.LowPart = now.dwLowDateTime;
+    ticks.HighPart = now.dwHighDateTime;
+    return (DWORD)((ticks.QuadPart % 10000000ULL) / 10);
+}
+
+// Give up the rest of the time slice while spinning towards a boundary
+static void SpinYield(void) {
+    Sleep(0);
+}
+
+// Seconds since the Unix epoch, UTC
+static long long GetUtcSeconds(void) {
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
     
-    if (!GetConsoleScreenBufferInfo(g_hConsole, &csbi)) {
-        return;
-    }
+    ULARGE_INTEGER ticks;
+    ticks.LowPart = now.dwLowDateTime;
+    ticks.HighPart = now.dwHighDateTime;
+    return (long long)((ticks.QuadPart - 116444736000000000ULL) / 10000000ULL);
+}
+
+// Convert a local wall time (the /render time) to seconds since the epoch
+static long long LocalTimeToUtcSeconds(_In_ const SYSTEMTIME* st) {
+    SYSTEMTIME utc;
+    FILETIME fileTime;
     
-    if (x < 0 || y < 0 || x >= csbi.dwSize.X || y >= csbi.dwSize.Y) {
-        return;
+    if (!TzSpecificLocalTimeToSystemTime(NULL, st, &utc) || 
+        !SystemTimeToFileTime(&utc, &fileTime)) {
+        return 0;
     }
     
-    for (int line = 0; line < ASCII_CHAR_HEIGHT; line++) {
-        SHORT currentY = (SHORT)(y + line);
-        
-        if (currentY >= csbi.dwSize.Y) {
+    ULARGE_INTEGER ticks;
+    ticks.LowPart = fileTime.dwLowDateTime;
+    ticks.HighPart = fileTime.dwHighDateTime;
+    return (long long)((ticks.QuadPart - 116444736000000000ULL) / 10000000ULL);
+}
+#else
+// Input thread: block on the terminal and queue decoded hotkeys. Resizes
+// arrive as SIGWINCH, which the main loop sees directly.
+static void RunInputReader(void) {
+    struct pollfd fds[2];
+    unsigned char bytes[INPUT_EVENT_BUFFER_SIZE];
+    
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[1].fd = g_input.controlPipe[0];
+    fds[1].events = POLLIN;
+    
+    while (InputReaderCheckpoint()) {
+        // A batch that ended inside an escape gets a moment to finish it;
+        // after that it was a lone Esc and the next key is just a key
+        int timeoutMs = g_vtInputState == VT_INPUT_NORMAL ? -1 : VT_ESCAPE_TIMEOUT_MS;
+        int ready = poll(fds, 2, timeoutMs);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             break;
         }
-        
-        SetCursorPosition(x, currentY);
-        
-        const wchar_t* current = asciiChar;
-        for (int i = 0; i < line && *current; i++) {
-            while (*current && *current != L'\n') {
-                current++;
-            }
-            if (*current == L'\n') {
-                current++;
+        if (ready == 0) {
+            g_vtInputState = VT_INPUT_NORMAL;
+            continue;
+        }
+        if (fds[1].revents) {
+            continue;   // Pause or quit; the checkpoint handles both
+        }
+        if (!(fds[0].revents & POLLIN)) {
+            if (fds[0].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+                break;
             }
+            continue;
         }
         
-        if (*current) {
-            const wchar_t* end = current;
-            while (*end && *end != L'\n') {
-                end++;
-            }
-            
-            int charsToWrite = (int)(end - current);
-            if (x + charsToWrite > csbi.dwSize.X) {
-                charsToWrite = csbi.dwSize.X - x;
-            }
-            
-            if (charsToWrite > 0) {
-                // Use WriteConsoleOutputCharacterW for direct, unbuffered output
-                COORD writePos = { x, currentY };
-                DWORD charsWritten;
-                WriteConsoleOutputCharacterW(
-                    g_hConsole,
-                    current,
-                    charsToWrite,
-                    writePos,
-                    &charsWritten
-                );
+        // Raw mode uses VMIN=0/VTIME=0, so this never blocks
+        ssize_t bytesRead = read(STDIN_FILENO, bytes, sizeof(bytes));
+        if (bytesRead <= 0) {
+            if (bytesRead < 0 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
             }
+            break;  // Terminal hung up
+        }
+        
+        LONG tail = g_input.ring.tail;
+        VtDecodeInput(bytes, (size_t)bytesRead, StatsNow());
+        if (g_input.ring.tail != tail) {
+            WakeMainLoop();
+        }
     }
-    fflush(stdout);
+}
 
-// Update character position only if it has changed
-static void UpdateCharPositionIfChanged(
-    _In_ SHORT x,
-    _In_ SHORT y,
-    _In_ const wchar_t* asciiChar,
-    _In_ const wchar_t* oldAsciiChar
+// Ask the input thread to look at its pause/quit flags
+static void SignalInputReader(void) {
+    ssize_t ignored = write(g_input.controlPipe[1], "", 1);
+    (void)ignored;
+}
+
+// Wake the main loop out of WaitForNextEvent
+static void WakeMainLoop(void) {
+    if (g_wakePipe[1] >= 0) {
+        ssize_t ignored = write(g_wakePipe[1], "", 1);
+        (void)ignored;
+    }
+}
+
+// Turn raw terminal bytes into queued hotkeys. Alt+key arrives as ESC key;
+// CSI/SS3 sequences (arrows, function keys) are skipped.
+static void VtDecodeInput(
+    _In_reads_(length) const unsigned char* bytes,
+    _In_ size_t length,
+    _In_ long long timestamp
 ) {
-    if (asciiChar != oldAsciiChar) {
-        UpdateCharPosition(x, y, asciiChar);
+    InputEvent event;
+    event.type = INPUT_EVENT_HOTKEY;
+    event.timestamp = timestamp;
+    
+    for (size_t i = 0; i < length; i++) {
+        unsigned char byte = bytes[i];
+        
+        switch (g_vtInputState) {
+            case VT_INPUT_NORMAL:
+                if (byte == 0x1B) {
+                    g_vtInputState = VT_INPUT_ESCAPE;
+                }
+                break;
+            case VT_INPUT_ESCAPE:
+                if (byte == '[' || byte == 'O') {
+                    g_vtInputState = VT_INPUT_SEQUENCE;
+                } else if (byte != 0x1B) {
+                    g_vtInputState = VT_INPUT_NORMAL;
+                    event.key = (wchar_t)byte;
+                    PushInputEvent(&event);
+                }
+                break;
+            case VT_INPUT_SEQUENCE:
+                if (byte >= 0x40 && byte <= 0x7E) {
+                    g_vtInputState = VT_INPUT_NORMAL;
+                }
+                break;
+        }
     }
 }
 
-// Print the title line
-static void PrintTitleLine(void) {
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    if (!GetConsoleScreenBufferInfo(g_hConsole, &csbi)) {
+// Block until the timeout elapses, the input thread queues an event or a
+// signal wakes us. Both write the wake pipe.
+static void WaitForNextEvent(_In_ DWORD timeoutMs) {
+    if (timeoutMs == 0) {
         return;
     }
     
-    const WORD titleBackgroundAttribute = BACKGROUND_RED | BACKGROUND_GREEN | 
-                                          BACKGROUND_BLUE | BACKGROUND_INTENSITY;
-    const WORD titleTextAttribute = FOREGROUND_BLUE;
-    const WORD normalAttribute = FOREGROUND_RED | FOREGROUND_GREEN | 
-                                 FOREGROUND_BLUE;
+    struct pollfd fds[1];
+    nfds_t count = 0;
     
-    SetConsoleTextAttribute(g_hConsole, titleBackgroundAttribute);
+    if (g_wakePipe[0] >= 0) {
+        fds[count].fd = g_wakePipe[0];
+        fds[count].events = POLLIN;
+        count++;
+    }
     
-    DWORD cCharsWritten;
-    COORD coord = { 0, 0 };
-    SHORT lineWidth = csbi.dwSize.X;
+    // EINTR just means a signal arrived; the loop re-checks everything
+    poll(fds, count, timeoutMs > 0x7FFFFFFF ? 0x7FFFFFFF : (int)timeoutMs);
+}
+
+// SIGWINCH marks a resize, SIGCONT a return from being stopped;
+// termination signals request a clean exit
+static void VtSignalHandler(int signalNumber) {
+    int savedErrno = errno;
     
-    FillConsoleOutputCharacterW(
-        g_hConsole, L' ', lineWidth, coord, &cCharsWritten
-    );
-    FillConsoleOutputAttribute(
-        g_hConsole, titleBackgroundAttribute, lineWidth, coord, &cCharsWritten
-    );
+    if (signalNumber == SIGWINCH) {
+        g_resizePending = 1;
+    } else if (signalNumber == SIGCONT) {
+        g_continuePending = 1;
+    } else {
+        g_quitRequested = 1;
+    }
     
-    SetCursorPosition(0, 0);
-    SetConsoleTextAttribute(g_hConsole, titleBackgroundAttribute | titleTextAttribute);
-    wprintf(L"Lou32 Visual Time & Date System Display Utility Apparatus");
-    fflush(stdout);
+    if (g_wakePipe[1] >= 0) {
+        ssize_t ignored = write(g_wakePipe[1], "", 1);
+        (void)ignored;
+    }
     
-    SetConsoleTextAttribute(g_hConsole, normalAttribute);
+    errno = savedErrno;
 }
 
-// Print time with smart updates
-static void PrintTimeAscii(
-    _In_ const SYSTEMTIME* st, 
-    _In_ SHORT startX, 
-    _In_ SHORT startY,
-    _In_ BOOL forceRedraw
-) {
-    int hour12 = st->wHour % 12;
-    if (hour12 == 0) {
-        hour12 = 12;
+// Why nobody can see the terminal, or NULL if someone might: output
+// redirected, or our process group moved to the background
+static const wchar_t* GetDisplayHiddenReason(void) {
+    if (!g_vtIsTerminal) {
+        return L"redirected";
     }
     
-    BOOL isPM = (st->wHour >= 12);
+    pid_t foreground = tcgetpgrp(STDOUT_FILENO);
+    if (foreground != -1 && foreground != getpgrp()) {
+        return L"background";
+    }
+    return NULL;
+}
+
+// After a stop and continue the shell may have reset the terminal; only
+// called in the foreground, where tcsetattr cannot raise SIGTTOU
+static void RestoreConsoleModes(void) {
+    static const char enterSequence[] = "\x1b[?1049h\x1b[?7l";
     
-    int hourTens = hour12 / 10;
-    int hourOnes = hour12 % 10;
-    int minuteTens = st->wMinute / 10;
-    int minuteOnes = st->wMinute % 10;
+    if (g_termiosSaved) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &g_rawTermios);
+    }
+    VtAppend(enterSequence, sizeof(enterSequence) - 1);
+    VtFlushOutput();
+}
 
-    if (forceRedraw || !g_displayState.initialized) {
-        // Full redraw
-        UpdateCharPosition(startX, startY, GetAsciiDigit(hourTens));
-        UpdateCharPosition(
-            (SHORT)(startX + ASCII_CHAR_SPACING), startY, GetAsciiDigit(hourOnes)
-        );
-        UpdateCharPosition(
-            (SHORT)(startX + TIME_COLON_OFFSET), startY, g_asciiColon
-        );
-        UpdateCharPosition(
-            (SHORT)(startX + TIME_COLON_OFFSET + ASCII_CHAR_SPACING), 
-            startY, 
-            GetAsciiDigit(minuteTens)
-        );
-        UpdateCharPosition(
-            (SHORT)(startX + TIME_COLON_OFFSET + ASCII_CHAR_SPACING * 2), 
-            startY, 
-            GetAsciiDigit(minuteOnes)
-        );
-        
-        SHORT ampmX = (SHORT)(startX + TIME_AMPM_OFFSET);
-        const wchar_t* ampmChar = isPM ? g_asciiP : g_asciiA;
-        UpdateCharPosition(ampmX, startY, ampmChar);
-        UpdateCharPosition((SHORT)(ampmX + ASCII_CHAR_SPACING), startY, g_asciiM);
+// Put the terminal in raw mode on the alternate screen
+static BOOL InitConsole(void) {
+    // Redirected output still runs the alarms, it just never draws
+    g_vtIsTerminal = isatty(STDOUT_FILENO);
+    if (!g_vtIsTerminal) {
+        fwprintf(stderr, L"Warning: Standard output is not a terminal, only alarms will run\n");
+    }
+    
+    if (pipe(g_wakePipe) == 0) {
+        for (int i = 0; i < 2; i++) {
+            fcntl(g_wakePipe[i], F_SETFL, fcntl(g_wakePipe[i], F_GETFL) | O_NONBLOCK);
+            fcntl(g_wakePipe[i], F_SETFD, FD_CLOEXEC);
+        }
     } else {
-        // Smart update - only changed digits
-        UpdateCharPositionIfChanged(
-            startX, startY, 
-            GetAsciiDigit(hourTens), 
-            GetAsciiDigit(g_displayState.hourTens)
-        );
-        UpdateCharPositionIfChanged(
-            (SHORT)(startX + ASCII_CHAR_SPACING), startY, 
-            GetAsciiDigit(hourOnes), 
-            GetAsciiDigit(g_displayState.hourOnes)
-        );
-        UpdateCharPositionIfChanged(
-            (SHORT)(startX + TIME_COLON_OFFSET + ASCII_CHAR_SPACING), startY, 
-            GetAsciiDigit(minuteTens), 
-            GetAsciiDigit(g_displayState.minuteTens)
-        );
-        UpdateCharPositionIfChanged(
-            (SHORT)(startX + TIME_COLON_OFFSET + ASCII_CHAR_SPACING * 2), startY, 
-            GetAsciiDigit(minuteOnes), 
-            GetAsciiDigit(g_displayState.minuteOnes)
-        );
-        
-        if (isPM != g_displayState.isPM) {
-            SHORT ampmX = (SHORT)(startX + TIME_AMPM_OFFSET);
-            const wchar_t* ampmChar = isPM ? g_asciiP : g_asciiA;
-            UpdateCharPosition(ampmX, startY, ampmChar);
+        g_wakePipe[0] = g_wakePipe[1] = -1;
+    }
+    
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = VtSignalHandler;
+    sigemptyset(&action.sa_mask);
+    
+    // Termination signals interrupt a blocking prompt read; resizes do not
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGHUP, &action, NULL);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGWINCH, &action, NULL);
+    sigaction(SIGCONT, &action, NULL);
+    
+    if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &g_originalTermios) == 0) {
+        g_termiosSaved = TRUE;
+        g_rawTermios = g_originalTermios;
+        g_rawTermios.c_lflag &= ~(tcflag_t)(ICANON | ECHO);
+        g_rawTermios.c_iflag &= ~(tcflag_t)(IXON | ICRNL);
+        g_rawTermios.c_cc[VMIN] = 0;
+        g_rawTermios.c_cc[VTIME] = 0;
+        if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &g_rawTermios) == 0) {
+            g_hasConsoleInput = TRUE;
         }
     }
     
-    // Update state
-    g_displayState.hourTens = hourTens;
-    g_displayState.hourOnes = hourOnes;
-    g_displayState.minuteTens = minuteTens;
-    g_displayState.minuteOnes = minuteOnes;
-    g_displayState.isPM = isPM;
+    // Alternate screen, autowrap off so the bottom-right cell never scrolls
+    static const char enterSequence[] = "\x1b[?1049h\x1b[?7l";
+    VtAppend(enterSequence, sizeof(enterSequence) - 1);
+    VtFlushOutput();
+    return TRUE;
 }
 
-// Print date with smart updates
-static void PrintDateAscii(
-    _In_ const SYSTEMTIME* st, 
-    _In_ SHORT startX, 
-    _In_ SHORT startY,
-    _In_ BOOL forceRedraw
+// Restore the terminal exactly as we found it
+static void ShutdownConsole(void) {
+    static const char leaveSequence[] = "\x1b[0m\x1b[?7h\x1b[?25h\x1b[?1049l";
+    VtAppend(leaveSequence, sizeof(leaveSequence) - 1);
+    VtFlushOutput();
+    
+    if (g_termiosSaved) {
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &g_originalTermios);
+        g_termiosSaved = FALSE;
+    }
+    
+    for (int i = 0; i < 2; i++) {
+        if (g_wakePipe[i] >= 0) {
+            close(g_wakePipe[i]);
+            g_wakePipe[i] = -1;
+        }
+    }
+    
+    free(g_vtOutput);
+    g_vtOutput = NULL;
+    g_vtOutputSize = 0;
+    g_vtOutputLength = 0;
+}
+
+// Drop any input typed before the clock started
+static void DiscardPendingInput(void) {
+    if (g_hasConsoleInput) {
+        tcflush(STDIN_FILENO, TCIFLUSH);
+    }
+}
+
+// Read one line of echoed input for a prompt (cooked mode for the duration)
+static BOOL ReadPromptLine(
+    _Out_ wchar_t* buffer,
+    _In_ DWORD capacity,
+    _Out_ DWORD* charsRead
 ) {
-    int yearThousands = st->wYear / 1000;
-    int yearHundreds = (st->wYear % 1000) / 100;
-    int yearTens = (st->wYear % 100) / 10;
-    int yearOnes = st->wYear % 10;
-    int monthTens = st->wMonth / 10;
-    int monthOnes = st->wMonth % 10;
-    int dayTens = st->wDay / 10;
-    int dayOnes = st->wDay % 10;
+    *charsRead = 0;
+    if (!g_hasConsoleInput) {
+        return FALSE;
+    }
+    
+    char bytes[PROMPT_INPUT_MAX_BYTES];
+    tcsetattr(STDIN_FILENO, TCSANOW, &g_originalTermios);
+    ssize_t bytesRead = read(STDIN_FILENO, bytes, sizeof(bytes) - 1);
+    tcsetattr(STDIN_FILENO, TCSANOW, &g_rawTermios);
+    
+    if (bytesRead <= 0) {
+        return FALSE;
+    }
+    bytes[bytesRead] = '\0';
+    
+    size_t converted = mbstowcs(buffer, bytes, capacity);
+    if (converted == (size_t)-1) {
+        return FALSE;
+    }
+    
+    *charsRead = (DWORD)converted;
+    return TRUE;
+}
 
-    if (forceRedraw || !g_displayState.initialized) {
-        // Full redraw
-        SHORT currentX = startX;
-        UpdateCharPosition(currentX, startY, GetAsciiDigit(yearThousands));
-        currentX = (SHORT)(currentX + ASCII_CHAR_SPACING);
-        UpdateCharPosition(currentX, startY, GetAsciiDigit(yearHundreds));
-        currentX = (SHORT)(currentX + ASCII_CHAR_SPACING);
-        UpdateCharPosition(currentX, startY, GetAsciiDigit(yearTens));
-        currentX = (SHORT)(currentX + ASCII_CHAR_SPACING);
-        UpdateCharPosition(currentX, startY, GetAsciiDigit(yearOnes));
-        currentX = (SHORT)(currentX + ASCII_CHAR_SPACING);
-        UpdateCharPosition(currentX, startY, g_asciiDash);
-        currentX = (SHORT)(currentX + ASCII_CHAR_SPACING);
-        UpdateCharPosition(currentX, startY, GetAsciiDigit(monthTens));
-        currentX = (SHORT)(currentX + ASCII_CHAR_SPACING);
-        UpdateCharPosition(currentX, startY, GetAsciiDigit(monthOnes));
-        currentX = (SHORT)(currentX + ASCII_CHAR_SPACING);
-        UpdateCharPosition(currentX, startY, g_asciiDash);
-        currentX = (SHORT)(currentX + ASCII_CHAR_SPACING);
-        UpdateCharPosition(currentX, startY, GetAsciiDigit(dayTens));
-        currentX = (SHORT)(currentX + ASCII_CHAR_SPACING);
-        UpdateCharPosition(currentX, startY, GetAsciiDigit(dayOnes));
-    } else {
-        // Smart update - only changed digits
-        SHORT currentX = startX;
-        
-        UpdateCharPositionIfChanged(
-            currentX, startY, 
-            GetAsciiDigit(yearThousands), 
-            GetAsciiDigit(g_displayState.yearThousands)
-        );
-        currentX = (SHORT)(currentX + ASCII_CHAR_SPACING);
-        
-        UpdateCharPositionIfChanged(
-            currentX, startY, 
-            GetAsciiDigit(yearHundreds), 
-            GetAsciiDigit(g_displayState.yearHundreds)
-        );
-        currentX = (SHORT)(currentX + ASCII_CHAR_SPACING);
-        
-        UpdateCharPositionIfChanged(
-            currentX, startY, 
-            GetAsciiDigit(yearTens), 
-            GetAsciiDigit(g_displayState.yearTens)
-        );
-        currentX = (SHORT)(currentX + ASCII_CHAR_SPACING);
-        
-        UpdateCharPositionIfChanged(
-            currentX, startY, 
-            GetAsciiDigit(yearOnes), 
-            GetAsciiDigit(g_displayState.yearOnes)
-        );
-        currentX = (SHORT)(currentX + ASCII_CHAR_SPACING * 2); // Skip dash
-        
-        UpdateCharPositionIfChanged(
-            currentX, startY, 
-            GetAsciiDigit(monthTens), 
-            GetAsciiDigit(g_displayState.monthTens)
-        );
-        currentX = (SHORT)(currentX + ASCII_CHAR_SPACING);
-        
-        UpdateCharPositionIfChanged(
-            currentX, startY, 
-            GetAsciiDigit(monthOnes), 
-            GetAsciiDigit(g_displayState.monthOnes)
-        );
-        currentX = (SHORT)(currentX + ASCII_CHAR_SPACING * 2); // Skip dash
-        
-        UpdateCharPositionIfChanged(
-            currentX, startY, 
-            GetAsciiDigit(dayTens), 
-            GetAsciiDigit(g_displayState.dayTens)
-        );
-        currentX = (SHORT)(currentX + ASCII_CHAR_SPACING);
-        
-        UpdateCharPositionIfChanged(
-            currentX, startY, 
-            GetAsciiDigit(dayOnes), 
-            GetAsciiDigit(g_displayState.dayOnes)
-        );
+// Sound one alarm tone (terminals only have a bell, so the pitch is lost).
+// Called from the audio worker, so it bypasses the render output buffer;
+// the worker itself waits out the tone duration.
+static void PlayTone(_In_ DWORD frequency, _In_ DWORD durationMs) {
+    UNREFERENCED_PARAMETER(frequency);
+    UNREFERENCED_PARAMETER(durationMs);
+    
+    ssize_t written = write(STDOUT_FILENO, "\a", 1);
+    (void)written;
+}
+
+// Microseconds into the current wall-clock second
+static DWORD GetWallClockMicroseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (DWORD)(now.tv_nsec / 1000);
+}
+
+// Give up the rest of the time slice while spinning towards a boundary
+static void SpinYield(void) {
+    sched_yield();
+}
+
+// Seconds since the Unix epoch, UTC
+static long long GetUtcSeconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (long long)now.tv_sec;
+}
+
+// Convert a local wall time (the /render time) to seconds since the epoch
+static long long LocalTimeToUtcSeconds(_In_ const SYSTEMTIME* st) {
+    struct tm local = { 0 };
+    
+    local.tm_year = st->wYear - 1900;
+    local.tm_mon = st->wMonth - 1;
+    local.tm_mday = st->wDay;
+    local.tm_hour = st->wHour;
+    local.tm_min = st->wMinute;
+    local.tm_sec = st->wSecond;
+    local.tm_isdst = -1;
+    return (long long)mktime(&local);
+}
+#endif
+
+// Get the glyph for a digit (blank if out of range)
+static GlyphId GetAsciiDigit(_In_ int digit) {
+    if (digit < 0 || digit > 9) {
+        return GLYPH_SPACE;
+    }
+    return (GlyphId)(GLYPH_DIGIT_0 + digit);
+}
+
+// Verify every glyph row is fully populated (short rows leave null cells)
+static BOOL ValidateGlyphAtlas(void) {
+    for (int glyph = 0; glyph < GLYPH_COUNT; glyph++) {
+        for (int line = 0; line < ASCII_CHAR_HEIGHT; line++) {
+            for (int col = 0; col < ASCII_CHAR_WIDTH; col++) {
+                if (g_glyphAtlas[glyph].rows[line][col] == L'\0') {
+                    fwprintf(
+                        stderr,
+                        L"Error: Glyph %d row %d is narrower than %d cells\n",
+                        glyph,
+                        line,
+                        ASCII_CHAR_WIDTH
+                    );
+                    return FALSE;
+                }
+            }
+        }
+    }
+    return TRUE;
+}
+
+// Get a glyph of the active font enlarged by an integer scale (scale 1 is
+// the font itself), building that scale's set on the first request.
+// Returns NULL if the set could not be allocated.
+static const wchar_t* GetScaledGlyph(_In_ GlyphId id, _In_ int scale) {
+    if (scale < 1 || scale > GLYPH_SCALE_MAX) {
+        return NULL;
+    }
+    if (id < 0 || id >= GLYPH_COUNT) {
+        id = GLYPH_SPACE;
+    }
+    if (scale == 1) {
+        return g_font.cells + (size_t)id * g_font.width * g_font.height;
     }
     
-    // Update state
-    g_displayState.yearThousands = yearThousands;
-    g_displayState.yearHundreds = yearHundreds;
-    g_displayState.yearTens = yearTens;
-    g_displayState.yearOnes = yearOnes;
-    g_displayState.monthTens = monthTens;
-    g_displayState.monthOnes = monthOnes;
-    g_displayState.dayTens = dayTens;
-    g_displayState.dayOnes = dayOnes;
-}
-
-// Optimized screen clear - only clears content area, not title or alarm status
-static void ClearScreenSafe(void) {
-    if (g_hConsole == INVALID_HANDLE_VALUE) {
-        return;
+    int width = g_font.width * scale;
+    int height = g_font.height * scale;
+    size_t glyphCells = (size_t)width * (size_t)height;
+    ScaledGlyphSet* set = &g_scaledGlyphs[scale];
+    
+    if (!set->cells) {
+        set->cells = (wchar_t*)malloc(glyphCells * GLYPH_COUNT * sizeof(wchar_t));
+        if (!set->cells) {
+            return NULL;
+        }
+        
+        for (int glyph = 0; glyph < GLYPH_COUNT; glyph++) {
+            wchar_t* target = set->cells + glyphCells * glyph;
+            for (int y = 0; y < height; y++) {
+                const wchar_t* source = 
+                    g_font.cells + ((size_t)glyph * g_font.height + y / scale) * g_font.width;
+                for (int x = 0; x < width; x++) {
+                    target[y * width + x] = source[x / scale];
+                }
+            }
+        }
     }
+    
+    return set->cells + glyphCells * id;
+}
 
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    if (!GetConsoleScreenBufferInfo(g_hConsole, &csbi)) {
-        return;
+// Release every cached glyph scale
+static void FreeScaledGlyphs(void) {
+    for (int scale = 0; scale <= GLYPH_SCALE_MAX; scale++) {
+        free(g_scaledGlyphs[scale].cells);
+        g_scaledGlyphs[scale].cells = NULL;
     }
+}
 
-    // Clear from row 1 up to (but not including) the alarm status row
-    // Alarm status is at row 21, so we clear rows 1-20
-    const SHORT dateStartY = 12;
-    const SHORT alarmStatusRow = dateStartY + ASCII_CHAR_HEIGHT + 2; // row 21
-    
-    // Only clear if alarm status row is within console bounds
-    if (alarmStatusRow < csbi.dwSize.Y) {
-        SHORT rowsToClear = alarmStatusRow - 1; // Clear rows 1 to 20
-        if (rowsToClear > 0) {
-            DWORD dwConSize = csbi.dwSize.X * rowsToClear;
-            COORD coordScreen = { 0, 1 };
-            DWORD cCharsWritten;
-
-            FillConsoleOutputCharacterW(
-                g_hConsole, 
-                L' ', 
-                dwConSize, 
-                coordScreen, 
-                &cCharsWritten
-            );
-            FillConsoleOutputAttribute(
-                g_hConsole, 
-                csbi.wAttributes, 
-                dwConSize, 
-                coordScreen, 
-                &cCharsWritten
+// Compile the built-in atlas into the active font
+static void UseBuiltinFont(void) {
+    for (int glyph = 0; glyph < GLYPH_COUNT; glyph++) {
+        for (int line = 0; line < ASCII_CHAR_HEIGHT; line++) {
+            wmemcpy(
+                g_builtinFontCells + ((size_t)glyph * ASCII_CHAR_HEIGHT + line) * ASCII_CHAR_WIDTH,
+                g_glyphAtlas[glyph].rows[line],
+                ASCII_CHAR_WIDTH
             );
         }
-    } else {
-        // Fallback: clear all except title and bottom row
-        DWORD dwConSize = csbi.dwSize.X * (csbi.dwSize.Y - 2);
-        COORD coordScreen = { 0, 1 };
-        DWORD cCharsWritten;
-
-        FillConsoleOutputCharacterW(
-            g_hConsole, 
-            L' ', 
-            dwConSize, 
-            coordScreen, 
-            &cCharsWritten
-        );
-        FillConsoleOutputAttribute(
-            g_hConsole, 
-            csbi.wAttributes, 
-            dwConSize, 
-            coordScreen, 
-            &cCharsWritten
-        );
     }
+    
+    g_font.width = ASCII_CHAR_WIDTH;
+    g_font.height = ASCII_CHAR_HEIGHT;
+    g_font.spacing = ASCII_CHAR_SPACING;
+    g_font.cells = g_builtinFontCells;
 }
 
-// Get ramp duration in milliseconds
-static DWORD GetRampDurationMs(_In_ AlarmRampSpeed speed) {
-    switch (speed) {
-        case ALARM_RAMP_FAST:
-            return 10000;      // 10 seconds
-        case ALARM_RAMP_MODERATE:
-            return 30000;      // 30 seconds
-        case ALARM_RAMP_SLOW:
-            return 60000;      // 60 seconds
-        default:
-            return 30000;
+// FNV-1a, 64-bit; chain calls by passing the previous result as hash
+static uint64_t Fnv1a64(_In_reads_(length) const void* data, _In_ size_t length, _In_ uint64_t hash) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
     }
+    return hash;
 }
 
-// Print alarm status line 2 lines below date display
-static void PrintAlarmStatusLine(void) {
-    if (g_hConsole == INVALID_HANDLE_VALUE) {
-        return;
-    }
+// Decode one character of a font line: UTF-8 when well formed, otherwise
+// the byte as Latin-1 (older .flf files). Returns the bytes consumed.
+static size_t DecodeFontChar(_In_reads_(length) const unsigned char* bytes, _In_ size_t length, _Out_ wchar_t* ch) {
+    unsigned int lead = bytes[0];
+    size_t extra = 0;
     
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    if (!GetConsoleScreenBufferInfo(g_hConsole, &csbi)) {
-        return;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        extra = 1;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        extra = 2;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        extra = 3;
+    }
+    if (extra == 0 || extra >= length) {
+        *ch = (wchar_t)lead;
+        return 1;
     }
     
-    // Date display starts at y=12, has height 7, so ends at y=18
-    // Alarm status goes 2 lines below that: 12 + 7 + 2 = 21
-    const SHORT dateStartY = 12;
-    const SHORT statusRow = dateStartY + ASCII_CHAR_HEIGHT + 2;
+    unsigned int code = lead & (0x3Fu >> extra);
+    for (size_t i = 1; i <= extra; i++) {
+        if ((bytes[i] & 0xC0) != 0x80) {
+            *ch = (wchar_t)bytes[0];
+            return 1;
+        }
+        code = (code << 6) | (bytes[i] & 0x3F);
+    }
+    *ch = (wchar_t)(code > 0xFFFF && sizeof(wchar_t) == 2 ? L'?' : code);
+    return extra + 1;
+}
+
+// Read a decimal header field, skipping leading blanks
+static BOOL ParseFontNumber(_Inout_ const unsigned char** cursor, _In_ const unsigned char* end, _Out_ int* value) {
+    const unsigned char* p = *cursor;
+    int result = 0;
+    int digits = 0;
+    BOOL negative = FALSE;
     
-    // Ensure status row is within console bounds
-    if (statusRow >= csbi.dwSize.Y) {
-        return;
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    if (p < end && *p == '-') {
+        negative = TRUE;
+        p++;
+    }
+    while (p < end && *p >= '0' && *p <= '9' && digits < 9) {
+        result = result * 10 + (*p++ - '0');
+        digits++;
     }
     
-    COORD coord = { 0, statusRow };
-    DWORD cCharsWritten;
+    *cursor = p;
+    *value = negative ? -result : result;
+    return digits > 0;
+}
+
+// Parse a FIGlet .flf font in one pass over the mapped file. Characters
+// are stored from 32 upwards, so parsing stops at 'P', the last one the
+// clock draws; the rest of the file (accents, code-tagged blocks) is never
+// touched. Needed glyphs are padded to the widest of them, centered, and
+// compiled into font->cells.
+static BOOL ParseFigletFont(
+    _In_reads_(size) const unsigned char* data,
+    _In_ size_t size,
+    _Out_ GlyphFont* font
+) {
+    static const char glyphChars[GLYPH_COUNT] = {
+        '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', ':', ' ', '-', 'A', 'M', 'P', '.'
+    };
+    const unsigned char* end = data + size;
+    const unsigned char* cursor = data;
+    int height, baseline, maxLength, oldLayout, commentLines;
     
-    // Clear ONLY this specific line without affecting anything above
-    FillConsoleOutputCharacterW(
-        g_hConsole, L' ', csbi.dwSize.X, coord, &cCharsWritten
-    );
+    memset(font, 0, sizeof(*font));
+    if (size < 6 || memcmp(data, "flf2a", 5) != 0) {
+        return FALSE;
+    }
+    unsigned char hardblank = data[5];
+    cursor += 6;
+    if (!ParseFontNumber(&cursor, end, &height) || !ParseFontNumber(&cursor, end, &baseline) ||
+        !ParseFontNumber(&cursor, end, &maxLength) || !ParseFontNumber(&cursor, end, &oldLayout) ||
+        !ParseFontNumber(&cursor, end, &commentLines) ||
+        height < 1 || height > FONT_HEIGHT_MAX || commentLines < 0) {
+        return FALSE;
+    }
     
-    // Set normal attribute for clearing attributes
-    WORD normalAttribute = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
-    FillConsoleOutputAttribute(
-        g_hConsole, normalAttribute, csbi.dwSize.X, coord, &cCharsWritten
-    );
+    // Glyph rows as read, before padding: FONT_WIDTH_MAX cells each
+    wchar_t* rows = (wchar_t*)malloc((size_t)GLYPH_COUNT * height * FONT_WIDTH_MAX * sizeof(wchar_t));
+    int widths[GLYPH_COUNT] = { 0 };
+    if (!rows) {
+        return FALSE;
+    }
+    wmemset(rows, L' ', (size_t)GLYPH_COUNT * height * FONT_WIDTH_MAX);
     
-    if (g_alarmState.isActive || g_alarmState.isRinging) {
-        // Set yellow foreground for alarm status
-        WORD alarmAttribute = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY;
-        SetConsoleTextAttribute(g_hConsole, alarmAttribute);
-        
-        SetCursorPosition(0, statusRow);
+    // Skip the rest of the header line and the comments
+    for (int skip = 0; skip <= commentLines && cursor < end; skip++) {
+        const unsigned char* newline = (const unsigned char*)memchr(cursor, '\n', (size_t)(end - cursor));
+        cursor = newline ? newline + 1 : end;
+    }
+    
+    BOOL complete = FALSE;
+    for (int code = ' '; code <= 'P' && cursor < end; code++) {
+        const char* wanted = (const char*)memchr(glyphChars, code, GLYPH_COUNT);
+        int glyph = wanted ? (int)(wanted - glyphChars) : -1;
         
-        if (g_alarmState.isRinging) {
-            wprintf(L"ALARM RINGING - Press Alt+X to stop");
-        } else {
-            wchar_t rampStr[16] = L"";
-            switch (g_alarmState.rampSpeed) {
-                case ALARM_RAMP_FAST:
-                    wcscpy_s(rampStr, 16, L"fast");
-                    break;
-                case ALARM_RAMP_MODERATE:
-                    wcscpy_s(rampStr, 16, L"moderate");
-                    break;
-                case ALARM_RAMP_SLOW:
-                    wcscpy_s(rampStr, 16, L"slow");
-                    break;
+        for (int line = 0; line < height; line++) {
+            if (cursor >= end) {
+                break;
             }
+            const unsigned char* newline = (const unsigned char*)memchr(cursor, '\n', (size_t)(end - cursor));
+            const unsigned char* lineEnd = newline ? newline : end;
+            const unsigned char* next = newline ? newline + 1 : end;
             
-            wprintf(L"ALARM SET: %02d:%02d", g_alarmState.hour, g_alarmState.minute);
-            if (g_alarmState.repeatDaily) {
-                wprintf(L" [REPEAT]");
+            if (glyph >= 0) {
+                // Drop the CR, then every trailing endmark (the line's last character)
+                if (lineEnd > cursor && lineEnd[-1] == '\r') {
+                    lineEnd--;
+                }
+                if (lineEnd > cursor) {
+                    unsigned char endmark = lineEnd[-1];
+                    while (lineEnd > cursor && lineEnd[-1] == endmark) {
+                        lineEnd--;
+                    }
+                }
+                
+                wchar_t* row = rows + ((size_t)glyph * height + line) * FONT_WIDTH_MAX;
+                int width = 0;
+                const unsigned char* p = cursor;
+                while (p < lineEnd && width < FONT_WIDTH_MAX) {
+                    wchar_t ch;
+                    p += DecodeFontChar(p, (size_t)(lineEnd - p), &ch);
+                    row[width++] = (ch == hardblank) ? L' ' : ch;
+                }
+                if (width > widths[glyph]) {
+                    widths[glyph] = width;
+                }
             }
-            wprintf(L" [RAMP: %ls]", rampStr);
+            cursor = next;
+            if (code == 'P' && line == height - 1) {
+                complete = TRUE;
+            }
+        }
+    }
+    
+    if (!complete) {
+        free(rows);
+        return FALSE;
+    }
+    
+    // The clock wants a blank space glyph whatever the font draws for it
+    int cellWidth = 1;
+    for (int glyph = 0; glyph < GLYPH_COUNT; glyph++) {
+        if (glyph != GLYPH_SPACE && widths[glyph] > cellWidth) {
+            cellWidth = widths[glyph];
+        }
+    }
+    
+    font->cells = (wchar_t*)malloc((size_t)GLYPH_COUNT * height * cellWidth * sizeof(wchar_t));
+    if (!font->cells) {
+        free(rows);
+        return FALSE;
+    }
+    wmemset(font->cells, L' ', (size_t)GLYPH_COUNT * height * cellWidth);
+    
+    for (int glyph = 0; glyph < GLYPH_COUNT; glyph++) {
+        if (glyph == GLYPH_SPACE) {
+            continue;
+        }
+        int padding = (cellWidth - widths[glyph]) / 2;
+        for (int line = 0; line < height; line++) {
+            wmemcpy(
+                font->cells + ((size_t)glyph * height + line) * cellWidth + padding,
+                rows + ((size_t)glyph * height + line) * FONT_WIDTH_MAX,
+                (size_t)widths[glyph]
+            );
         }
-        fflush(stdout);
+    }
+    free(rows);
+    
+    font->width = cellWidth;
+    font->height = height;
+    font->spacing = cellWidth + FONT_GLYPH_GAP;
+    return TRUE;
+}
+
+// Try the compiled copy of a font from the cache. The key covers the font's
+// path, size and modification time, so an edited font is parsed again.
+static BOOL LoadFontCache(_In_z_ const wchar_t* cachePath, _In_ uint64_t key, _Out_ GlyphFont* font) {
+    memset(font, 0, sizeof(*font));
+    
+    JournalFile file = FontFileOpen(cachePath);
+    if (file == JOURNAL_INVALID_FILE) {
+        return FALSE;
+    }
+    
+    size_t size = 0;
+    const unsigned char* view = JournalFileMap(file, &size);
+    BOOL loaded = FALSE;
+    
+    if (view && size >= sizeof(FontCacheHeader)) {
+        FontCacheHeader header;
+        memcpy(&header, view, sizeof(header));
+        size_t cellCount = (size_t)GLYPH_COUNT * header.width * header.height;
         
-        SetConsoleTextAttribute(g_hConsole, normalAttribute);
+        if (header.magic == FONT_CACHE_MAGIC && header.key == key &&
+            header.glyphCount == GLYPH_COUNT &&
+            header.width >= 1 && header.width <= FONT_WIDTH_MAX &&
+            header.height >= 1 && header.height <= FONT_HEIGHT_MAX &&
+            size == sizeof(header) + cellCount * sizeof(uint32_t) &&
+            header.crc == JournalCrc32(view + sizeof(header), cellCount * sizeof(uint32_t))) {
+            font->cells = (wchar_t*)malloc(cellCount * sizeof(wchar_t));
+            if (font->cells) {
+                for (size_t i = 0; i < cellCount; i++) {
+                    uint32_t ch;
+                    memcpy(&ch, view + sizeof(header) + i * sizeof(uint32_t), sizeof(ch));
+                    font->cells[i] = (wchar_t)ch;
+                }
+                font->width = header.width;
+                font->height = header.height;
+                font->spacing = header.spacing;
+                loaded = TRUE;
+            }
+        }
+    }
+    
+    if (view) {
+        JournalFileUnmap(view, size);
     }
+    JournalFileClose(file);
+    return loaded;
 }
 
-// Interactive prompt for alarm settings
-static void PromptForAlarm(void) {
-    if (g_hConsole == INVALID_HANDLE_VALUE || g_hInput == INVALID_HANDLE_VALUE) {
+// Store a compiled font; written to a temporary file and renamed into place
+// so a concurrent start never maps half a cache file
+static void SaveFontCache(_In_z_ const wchar_t* cachePath, _In_ uint64_t key, _In_ const GlyphFont* font) {
+    wchar_t tempPath[FONT_PATH_MAX];
+    size_t cellCount = (size_t)GLYPH_COUNT * font->width * font->height;
+    uint32_t* cells = (uint32_t*)malloc(cellCount * sizeof(uint32_t));
+    
+    if (!cells || swprintf(tempPath, FONT_PATH_MAX, L"%ls.tmp", cachePath) < 0) {
+        free(cells);
         return;
     }
+    for (size_t i = 0; i < cellCount; i++) {
+        cells[i] = (uint32_t)font->cells[i];
+    }
     
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    if (!GetConsoleScreenBufferInfo(g_hConsole, &csbi)) {
-        return;
+    FontCacheHeader header;
+    header.magic = FONT_CACHE_MAGIC;
+    header.crc = JournalCrc32(cells, cellCount * sizeof(uint32_t));
+    header.key = key;
+    header.width = (uint16_t)font->width;
+    header.height = (uint16_t)font->height;
+    header.spacing = (uint16_t)font->spacing;
+    header.glyphCount = GLYPH_COUNT;
+    
+    JournalFile file = JournalFileOpen(tempPath, TRUE);
+    if (file != JOURNAL_INVALID_FILE) {
+        BOOL written = JournalFileWrite(file, &header, sizeof(header)) &&
+                       JournalFileWrite(file, cells, cellCount * sizeof(uint32_t));
+        JournalFileClose(file);
+        if (!written || !JournalFileReplace(tempPath, cachePath)) {
+            DeleteFontCacheFile(tempPath);
+        }
     }
+    free(cells);
+}
+
+// /font: make a FIGlet font the active font, from the cache when it holds a
+// compiled copy of this exact file. Keeps the built-in font on any failure.
+static BOOL LoadFont(_In_z_ const wchar_t* path) {
+    long long loadStart = StatsNow();
     
-    // Use bottom row for prompts, ensuring it doesn't interfere with display
-    // Make sure it's below the alarm status row (row 21)
-    const SHORT dateStartY = 12;
-    const SHORT alarmStatusRow = dateStartY + ASCII_CHAR_HEIGHT + 2; // row 21
-    SHORT bottomRow = csbi.dwSize.Y - 1;
+    JournalFile file = FontFileOpen(path);
+    if (file == JOURNAL_INVALID_FILE) {
+        fwprintf(stderr, L"Warning: Could not open font %ls, using the built-in font\n", path);
+        return FALSE;
+    }
     
-    // If console is too small and bottom row would overlap with alarm status,
-    // use the alarm status row itself (it will be redrawn after prompt)
-    if (bottomRow <= alarmStatusRow) {
-        // Console too small - use alarm status row, will be restored after
-        bottomRow = alarmStatusRow;
+    uint64_t identity[2];
+    if (!FontFileIdentity(file, &identity[0], &identity[1])) {
+        identity[0] = identity[1] = 0;
     }
+    uint64_t key = Fnv1a64(path, wcslen(path) * sizeof(wchar_t), FNV1A64_OFFSET_BASIS);
+    key = Fnv1a64(identity, sizeof(identity), key);
     
-    WORD normalAttribute = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+    wchar_t cachePath[FONT_PATH_MAX];
+    BOOL haveCachePath = GetFontCachePath(key, cachePath, FONT_PATH_MAX);
+    GlyphFont font;
+    BOOL loaded = haveCachePath && LoadFontCache(cachePath, key, &font);
     
-    // Show cursor for input
-    HideCursor(FALSE);
+    if (loaded) {
+        g_renderStats.fontSource = L"cache";
+    } else {
+        size_t size = 0;
+        const unsigned char* view = JournalFileMap(file, &size);
+        loaded = view && ParseFigletFont(view, size, &font);
+        if (view) {
+            JournalFileUnmap(view, size);
+        }
+        if (!loaded) {
+            JournalFileClose(file);
+            fwprintf(stderr, L"Warning: %ls is not a usable FIGlet font, using the built-in font\n", path);
+            return FALSE;
+        }
+        if (haveCachePath) {
+            SaveFontCache(cachePath, key, &font);
+        }
+        g_renderStats.fontSource = L"parsed";
+    }
+    JournalFileClose(file);
     
-    // Clear ONLY the bottom line and move cursor there
-    // This will not affect anything above
-    COORD coord = { 0, bottomRow };
-    DWORD cCharsWritten;
-    FillConsoleOutputCharacterW(
-        g_hConsole, L' ', csbi.dwSize.X, coord, &cCharsWritten
-    );
-    FillConsoleOutputAttribute(
-        g_hConsole, normalAttribute, csbi.dwSize.X, coord, &cCharsWritten
+    g_font = font;
+    g_renderStats.fontLoadUs = (DWORD)((StatsNow() - loadStart) * 1000000 / g_renderStats.frequency.QuadPart);
+    return TRUE;
+}
+
+// Release a loaded font (the built-in one lives in static storage)
+static void FreeFont(void) {
+    if (g_font.cells != g_builtinFontCells) {
+        free(g_font.cells);
+        UseBuiltinFont();
+    }
+}
+
+// Columns the time line spans at scale 1 (HH:MM AM, HH:MM:SS AM, or
+// HH:MM:SS.cc for a timer)
+static int GetTimeWidth(void) {
+    if (g_timer.mode != TIMER_OFF) {
+        return TIMER_LAST_SLOT * g_font.spacing + g_font.width;
+    }
+    int ampmSlot = g_showSeconds ? TIME_AMPM_SECONDS_SLOT : TIME_AMPM_SLOT;
+    return (ampmSlot + 1) * g_font.spacing + g_font.width;
+}
+
+static LayoutRect MakeLayoutRect(_In_ int x, _In_ int y, _In_ int width, _In_ int height) {
+    LayoutRect rect;
+    rect.x = (SHORT)x;
+    rect.y = (SHORT)y;
+    rect.width = (SHORT)(width > 0 ? width : 0);
+    rect.height = (SHORT)(height > 0 ? height : 0);
+    return rect;
+}
+
+// Place every region for one arrangement and scale on the current frame.
+// Returns TRUE if the clock and the alarm status line fit.
+static BOOL BuildLayout(
+    _In_ LayoutArrangement arrangement,
+    _In_ int scale,
+    _Out_ Layout* layout
+) {
+    const int width = g_frame.width;
+    const int height = g_frame.height;
+    const int timeWidth = GetTimeWidth() * scale;
+    const int dateWidth = g_timer.mode != TIMER_OFF ? timeWidth :
+                          (DATE_LAST_SLOT * g_font.spacing + g_font.width) * scale;
+    const int glyphHeight = g_font.height * scale;
+    int blockWidth;
+    int blockHeight;
+    int top;
+    int statusGap;
+    int columns = 1;
+    
+    memset(layout, 0, sizeof(*layout));
+    layout->width = g_frame.width;
+    layout->height = g_frame.height;
+    layout->scale = scale;
+    layout->arrangement = arrangement;
+    layout->glyphSpacing = (SHORT)(g_font.spacing * scale);
+    layout->colonOffset = (SHORT)(TIME_COLON_SLOT * layout->glyphSpacing);
+    layout->secondsColonOffset = (SHORT)(TIME_SECONDS_COLON_SLOT * layout->glyphSpacing);
+    layout->secondsOffset = (SHORT)(TIME_SECONDS_SLOT * layout->glyphSpacing);
+    layout->ampmOffset = (SHORT)((g_showSeconds ? TIME_AMPM_SECONDS_SLOT : TIME_AMPM_SLOT) * layout->glyphSpacing);
+    
+    // Block size: panes flow left to right then down (each is a label line,
+    // digits and a gap); otherwise the date sits below or beside the time
+    if (g_zonePaneCount > 0) {
+        columns = (width + ZONE_PANE_GAP) / (timeWidth + ZONE_PANE_GAP);
+        if (columns < 1) {
+            columns = 1;
+        }
+        if (columns > g_zonePaneCount) {
+            columns = g_zonePaneCount;
+        }
+        int rows = (g_zonePaneCount + columns - 1) / columns;
+        blockWidth = columns * timeWidth + (columns - 1) * ZONE_PANE_GAP;
+        blockHeight = rows * (glyphHeight + 2);
+        top = WORLD_CLOCK_ROW;
+        statusGap = 1;
+    } else if (arrangement == LAYOUT_SIDE_BY_SIDE) {
+        blockWidth = timeWidth + LAYOUT_SIDE_GAP * scale + dateWidth;
+        blockHeight = glyphHeight;
+        top = TIME_ROW;
+        statusGap = 2;
+    } else {
+        blockWidth = timeWidth > dateWidth ? timeWidth : dateWidth;
+        blockHeight = glyphHeight * 2 + 2 * scale;
+        top = TIME_ROW;
+        statusGap = 2;
+    }
+    
+    int left = 0;
+    if (g_layoutCentered) {
+        int centeredTop = (height - (blockHeight + statusGap + 1)) / 2;
+        if (centeredTop > top) {
+            top = centeredTop;
+        }
+        if (blockWidth < width) {
+            left = (width - blockWidth) / 2;
+        }
+    }
+    
+    layout->title = MakeLayoutRect(0, 0, width, 1);
+    if (g_zonePaneCount > 0) {
+        for (int i = 0; i < g_zonePaneCount; i++) {
+            layout->panes[i] = MakeLayoutRect(
+                left + (i % columns) * (timeWidth + ZONE_PANE_GAP),
+                top + (i / columns) * (glyphHeight + 2),
+                timeWidth,
+                glyphHeight + 1
+            );
+        }
+    } else if (arrangement == LAYOUT_SIDE_BY_SIDE) {
+        layout->time = MakeLayoutRect(left, top, timeWidth, glyphHeight);
+        layout->date = MakeLayoutRect(left + timeWidth + LAYOUT_SIDE_GAP * scale, top, dateWidth, glyphHeight);
+    } else {
+        layout->time = MakeLayoutRect(left, top, timeWidth, glyphHeight);
+        layout->date = MakeLayoutRect(left, top + glyphHeight + 2 * scale, dateWidth, glyphHeight);
+    }
+    
+    // Alarm status two rows below the clock (one below world-clock panes),
+    // the Alt+I overlay under it down to the row above the prompt, prompts
+    // on the bottom row (which is the status row itself on a console too
+    // short for both)
+    int statusRow = top + blockHeight + statusGap;
+    int overlayRows = (height - 1) - (statusRow + 1);
+    if (overlayRows > STATS_OVERLAY_ROWS) {
+        overlayRows = STATS_OVERLAY_ROWS;
+    }
+    layout->status = MakeLayoutRect(0, statusRow, width, statusRow < height ? 1 : 0);
+    layout->overlay = MakeLayoutRect(0, statusRow + 1, width, overlayRows);
+    layout->prompt = MakeLayoutRect(0, height - 1, width, 1);
+    
+    return blockWidth <= width && statusRow < height;
+}
+
+// Work out every region for the current console size. Called once per
+// resize; drawing only reads g_layout. Picks the largest scale that fits,
+// and with /layout auto prefers side by side only when that scale is larger.
+static void ComputeLayout(void) {
+    Layout best;
+    Layout candidate;
+    BOOL bestFits = FALSE;
+    
+    BuildLayout(
+        g_layoutArrangement == LAYOUT_SIDE_BY_SIDE ? LAYOUT_SIDE_BY_SIDE : LAYOUT_STACKED, 
+        1, 
+        &best
     );
     
-    SetCursorPosition(0, bottomRow);
-    SetConsoleTextAttribute(g_hConsole, normalAttribute);
-    wprintf(L"Enter alarm time (HH:MM): ");
-    fflush(stdout);
+    for (int i = 0; i < 2; i++) {
+        LayoutArrangement arrangement = i == 0 ? LAYOUT_STACKED : LAYOUT_SIDE_BY_SIDE;
+        if (g_layoutArrangement != LAYOUT_AUTO && g_layoutArrangement != arrangement) {
+            continue;
+        }
+        for (int scale = 1; scale <= GLYPH_SCALE_MAX; scale++) {
+            if (!BuildLayout(arrangement, scale, &candidate)) {
+                break;
+            }
+            if (!bestFits || candidate.scale > best.scale) {
+                best = candidate;
+                bestFits = TRUE;
+            }
+        }
+    }
     
-    // Read time input
-    wchar_t timeInput[32] = L"";
-    DWORD charsRead = 0;
-    if (ReadConsoleW(g_hInput, timeInput, 31, &charsRead, NULL) && charsRead > 1) {
-        // Clear the prompt line immediately after reading
-        FillConsoleOutputCharacterW(
-            g_hConsole, L' ', csbi.dwSize.X, coord, &cCharsWritten
-        );
-        FillConsoleOutputAttribute(
-            g_hConsole, normalAttribute, csbi.dwSize.X, coord, &cCharsWritten
-        );
-        
-        // Remove newline
-        if (charsRead > 0 && timeInput[charsRead - 1] == L'\n') {
-            timeInput[charsRead - 1] = L'\0';
-            charsRead--;
+    // Fall back to the unscaled atlas if the larger set cannot be allocated
+    if (best.scale > 1 && !GetScaledGlyph(GLYPH_SPACE, best.scale)) {
+        fwprintf(stderr, L"Warning: Out of memory for %dx glyphs\n", best.scale);
+        BuildLayout(best.arrangement, 1, &best);
+    }
+    
+    g_layout = best;
+}
+
+// Parse a /layout value
+static BOOL ParseLayoutName(_In_z_ const wchar_t* text, _Out_ LayoutArrangement* arrangement) {
+    if (_wcsicmp(text, L"auto") == 0) {
+        *arrangement = LAYOUT_AUTO;
+    } else if (_wcsicmp(text, L"stacked") == 0) {
+        *arrangement = LAYOUT_STACKED;
+    } else if (_wcsicmp(text, L"side") == 0) {
+        *arrangement = LAYOUT_SIDE_BY_SIDE;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Parse a /theme value
+static BOOL ParseThemeName(_In_z_ const wchar_t* text, _Out_ const ClockTheme** theme) {
+    for (size_t i = 0; i < sizeof(g_themes) / sizeof(g_themes[0]); i++) {
+        if (_wcsicmp(text, g_themes[i].name) == 0) {
+            *theme = &g_themes[i];
+            return TRUE;
         }
-        if (charsRead > 0 && timeInput[charsRead - 1] == L'\r') {
-            timeInput[charsRead - 1] = L'\0';
-            charsRead--;
+    }
+    *theme = &g_themes[0];
+    return FALSE;
+}
+
+// Flash phase (0 or 1) of the ringing alarm, -1 when nothing flashes
+static int GetAlarmFlashPhase(void) {
+    if (!g_alarmState.isRinging || !g_theme->colored) {
+        return -1;
+    }
+    return (int)((ReadTickCount() - g_alarmState.ringStartTime) / ALARM_FLASH_MS % 2);
+}
+
+// Milliseconds until the ringing alarm's flash changes phase
+static DWORD GetAlarmFlashDelayMs(void) {
+    if (GetAlarmFlashPhase() < 0) {
+        return INFINITE;
+    }
+    return ALARM_FLASH_MS - (ReadTickCount() - g_alarmState.ringStartTime) % ALARM_FLASH_MS;
+}
+
+// Work out the attribute of every glyph row for the current layout, theme
+// and flash phase. Blits then just copy them next to the characters.
+static void BuildThemeAttributes(void) {
+    int rows = g_font.height * g_layout.scale;
+    WORD background = (WORD)(g_contentAttribute & 0xF0);
+    
+    for (int line = 0; line < rows; line++) {
+        if (!g_theme->colored) {
+            g_themeAttributes.time[line] = g_contentAttribute;
+            g_themeAttributes.date[line] = g_contentAttribute;
+            continue;
+        }
+        
+        WORD foreground = g_themeAttributes.flashPhase >= 0 ? 
+            g_theme->flash[g_themeAttributes.flashPhase] :
+            g_theme->gradient[line * THEME_GRADIENT_STOPS / rows];
+        g_themeAttributes.time[line] = (WORD)(background | foreground);
+        g_themeAttributes.date[line] = (WORD)(background | g_theme->date);
+    }
+}
+
+// Follow the ringing alarm's flash. Returns TRUE when the time digits
+// changed color and must be blitted again.
+static BOOL UpdateThemePhase(void) {
+    int phase = GetAlarmFlashPhase();
+    if (phase == g_themeAttributes.flashPhase) {
+        return FALSE;
+    }
+    
+    g_themeAttributes.flashPhase = phase;
+    BuildThemeAttributes();
+    return TRUE;
+}
+
+static BOOL IsInLayoutRect(_In_ const LayoutRect* rect, _In_ SHORT x, _In_ SHORT y) {
+    return x >= rect->x && x < rect->x + rect->width && y >= rect->y && y < rect->y + rect->height;
+}
+
+// Position cursor at specific coordinates
+static void SetCursorPosition(_In_ SHORT x, _In_ SHORT y) {
+    if (!g_geometry.valid) {
+        return;
+    }
+    
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (x >= g_geometry.bufferWidth) x = g_geometry.bufferWidth - 1;
+    if (y >= g_geometry.bufferHeight) y = g_geometry.bufferHeight - 1;
+    
+    g_backend->SetCursor(x, y);
+}
+
+// Hide or show the cursor
+static void HideCursor(_In_ BOOL hide) {
+    g_backend->ShowCursor(!hide);
+}
+
+// Frame size for the cached geometry: the buffer's visible rows
+static void GetFrameSize(_Out_ SHORT* width, _Out_ SHORT* height) {
+    *width = g_geometry.bufferWidth;
+    *height = (SHORT)(g_geometry.windowBottom + 1);
+    if (*height > g_geometry.bufferHeight) {
+        *height = g_geometry.bufferHeight;
+    }
+}
+
+// Whether g_layout was computed for the frame size the console now has
+static BOOL IsLayoutCurrent(void) {
+    SHORT width, height;
+    GetFrameSize(&width, &height);
+    return g_frame.cells && width == g_layout.width && height == g_layout.height;
+}
+
+// (Re)allocate the frame buffer to match the visible console rows
+static BOOL ResizeFrameBuffer(void) {
+    SHORT width, height;
+    GetFrameSize(&width, &height);
+    
+    if (width <= 0 || height <= 0) {
+        return FALSE;
+    }
+    
+    if (width != g_frame.width || height != g_frame.height || !g_frame.cells) {
+        size_t cellCount = (size_t)width * (size_t)height;
+        int spanCapacity = height * ((width + 1) / 2);
+        FrameCell* cells = (FrameCell*)malloc(cellCount * sizeof(FrameCell));
+        FrameCell* shown = (FrameCell*)malloc(cellCount * sizeof(FrameCell));
+        FrameSpan* spans = (FrameSpan*)malloc((size_t)spanCapacity * sizeof(FrameSpan));
+        
+        if (!cells || !shown || !spans) {
+            free(cells);
+            free(shown);
+            free(spans);
+            return FALSE;
+        }
+        
+        FreeFrameBuffer();
+        g_frame.cells = cells;
+        g_frame.shown = shown;
+        g_frame.spans = spans;
+        g_frame.spanCapacity = spanCapacity;
+        g_frame.width = width;
+        g_frame.height = height;
+        
+        // The console contents are unknown after a resize, so repaint everything
+        FrameFillRect(0, 0, g_frame.width, g_frame.height, L' ', g_contentAttribute);
+        InvalidateFrameRect(0, 0, g_frame.width, g_frame.height);
+        InvalidateWidgets();
+    }
+    return TRUE;
+}
+
+// Release frame buffer memory
+static void FreeFrameBuffer(void) {
+    free(g_frame.cells);
+    free(g_frame.shown);
+    free(g_frame.spans);
+    g_frame.cells = NULL;
+    g_frame.shown = NULL;
+    g_frame.spans = NULL;
+    g_frame.spanCount = 0;
+    g_frame.spanCapacity = 0;
+    g_frame.width = 0;
+    g_frame.height = 0;
+    g_frame.isDirty = FALSE;
+}
+
+// Grow the dirty rectangle to include the given (inclusive) region
+static void MarkFrameDirty(
+    _In_ SHORT left,
+    _In_ SHORT top,
+    _In_ SHORT right,
+    _In_ SHORT bottom
+) {
+    if (!g_frame.isDirty) {
+        g_frame.dirty.Left = left;
+        g_frame.dirty.Top = top;
+        g_frame.dirty.Right = right;
+        g_frame.dirty.Bottom = bottom;
+        g_frame.isDirty = TRUE;
+        return;
+    }
+    
+    if (left < g_frame.dirty.Left) g_frame.dirty.Left = left;
+    if (top < g_frame.dirty.Top) g_frame.dirty.Top = top;
+    if (right > g_frame.dirty.Right) g_frame.dirty.Right = right;
+    if (bottom > g_frame.dirty.Bottom) g_frame.dirty.Bottom = bottom;
+}
+
+// Copy a run of characters into one frame row, clipped to the frame
+static void FrameWriteCells(
+    _In_ SHORT x,
+    _In_ SHORT y,
+    _In_reads_(count) const wchar_t* chars,
+    _In_ int count,
+    _In_ WORD attr
+) {
+    if (!g_frame.cells || y < 0 || y >= g_frame.height || x >= g_frame.width) {
+        return;
+    }
+    
+    if (x < 0) {
+        chars -= x;
+        count += x;
+        x = 0;
+    }
+    if (x + count > g_frame.width) {
+        count = g_frame.width - x;
+    }
+    if (count <= 0) {
+        return;
+    }
+    
+    FrameCell* row = g_frame.cells + (size_t)y * g_frame.width + x;
+    for (int i = 0; i < count; i++) {
+        row[i].ch = chars[i];
+        row[i].attr = attr;
+    }
+    
+    MarkFrameDirty(x, y, (SHORT)(x + count - 1), y);
+}
+
+// Write a null-terminated string into one frame row
+static void FrameWriteText(
+    _In_ SHORT x,
+    _In_ SHORT y,
+    _In_z_ const wchar_t* text,
+    _In_ WORD attr
+) {
+    FrameWriteCells(x, y, text, (int)wcslen(text), attr);
+}
+
+// Fill a rectangle of the frame with one character and attribute
+static void FrameFillRect(
+    _In_ SHORT x,
+    _In_ SHORT y,
+    _In_ SHORT width,
+    _In_ SHORT height,
+    _In_ wchar_t ch,
+    _In_ WORD attr
+) {
+    if (!g_frame.cells) {
+        return;
+    }
+    
+    SHORT right = (SHORT)(x + width);
+    SHORT bottom = (SHORT)(y + height);
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (right > g_frame.width) right = g_frame.width;
+    if (bottom > g_frame.height) bottom = g_frame.height;
+    if (x >= right || y >= bottom) {
+        return;
+    }
+    
+    for (SHORT row = y; row < bottom; row++) {
+        FrameCell* cell = g_frame.cells + (size_t)row * g_frame.width;
+        for (SHORT col = x; col < right; col++) {
+            cell[col].ch = ch;
+            cell[col].attr = attr;
+        }
+    }
+    
+    MarkFrameDirty(x, y, (SHORT)(right - 1), (SHORT)(bottom - 1));
+}
+
+// Forget what the console shows in a region (e.g. after echoed input),
+// forcing the next flush to rewrite it
+static void InvalidateFrameRect(
+    _In_ SHORT x,
+    _In_ SHORT y,
+    _In_ SHORT width,
+    _In_ SHORT height
+) {
+    if (!g_frame.shown) {
+        return;
+    }
+    
+    SHORT right = (SHORT)(x + width);
+    SHORT bottom = (SHORT)(y + height);
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (right > g_frame.width) right = g_frame.width;
+    if (bottom > g_frame.height) bottom = g_frame.height;
+    if (x >= right || y >= bottom) {
+        return;
+    }
+    
+    // Composed cells never hold L'\0', so this never compares equal
+    for (SHORT row = y; row < bottom; row++) {
+        FrameCell* cell = g_frame.shown + (size_t)row * g_frame.width;
+        for (SHORT col = x; col < right; col++) {
+            cell[col].ch = L'\0';
+            cell[col].attr = 0;
+        }
+    }
+    
+    MarkFrameDirty(x, y, (SHORT)(right - 1), (SHORT)(bottom - 1));
+}
+
+// Whether two layout regions share any cell
+static BOOL LayoutRectsOverlap(_In_ const LayoutRect* a, _In_ const LayoutRect* b) {
+    return a->width > 0 && a->height > 0 && b->width > 0 && b->height > 0 &&
+           a->x < b->x + b->width && b->x < a->x + a->width &&
+           a->y < b->y + b->height && b->y < a->y + a->height;
+}
+
+// Give each widget its region of the current layout; a widget that moves
+// is composed again
+static void PlaceWidgets(void) {
+    const LayoutRect* rects[WIDGET_COUNT] = { &g_layout.title, &g_layout.status, &g_layout.prompt };
+    
+    for (int i = 0; i < WIDGET_COUNT; i++) {
+        RowWidget* widget = &g_widgets[i];
+        if (memcmp(&widget->rect, rects[i], sizeof(LayoutRect)) != 0) {
+            widget->rect = *rects[i];
+            widget->dirty = TRUE;
+        }
+    }
+}
+
+// Set a widget's content and show it. Setting what it already shows is free.
+static void SetWidgetText(
+    _In_ WidgetId id,
+    _In_z_ const wchar_t* text,
+    _In_ WORD fillAttribute,
+    _In_ WORD textAttribute
+) {
+    RowWidget* widget = &g_widgets[id];
+    if (widget->visible && widget->fillAttribute == fillAttribute &&
+        widget->textAttribute == textAttribute &&
+        wcsncmp(widget->text, text, WIDGET_TEXT_MAX - 1) == 0) {
+        return;
+    }
+    
+    wcsncpy_s(widget->text, WIDGET_TEXT_MAX, text, _TRUNCATE);
+    widget->fillAttribute = fillAttribute;
+    widget->textAttribute = textAttribute;
+    widget->visible = TRUE;
+    widget->dirty = TRUE;
+}
+
+// Take a widget off the screen; whatever it covered is composed again
+static void HideWidget(_In_ WidgetId id) {
+    if (g_widgets[id].visible) {
+        g_widgets[id].visible = FALSE;
+        g_widgets[id].dirty = TRUE;
+    }
+}
+
+// The frame was refilled, so nothing a widget composed is there any more
+static void InvalidateWidgets(void) {
+    for (int i = 0; i < WIDGET_COUNT; i++) {
+        memset(&g_widgets[i].drawn, 0, sizeof(LayoutRect));
+        g_widgets[i].dirty = TRUE;
+    }
+}
+
+// Compositor pass, once per flush: blank what dirty widgets left behind,
+// then compose the dirty ones in order. Anything uncovered or overdrawn on
+// the way is composed again, so overlapping rows stay correctly stacked.
+static void ComposeWidgets(void) {
+    const WORD normalAttribute = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+    
+    for (int i = 0; i < WIDGET_COUNT; i++) {
+        RowWidget* widget = &g_widgets[i];
+        if (!widget->dirty || widget->drawn.width == 0 || widget->drawn.height == 0) {
+            continue;
+        }
+        
+        FrameFillRect(
+            widget->drawn.x, widget->drawn.y, widget->drawn.width, widget->drawn.height, L' ', normalAttribute
+        );
+        for (int j = 0; j < WIDGET_COUNT; j++) {
+            if (j != i && g_widgets[j].visible && LayoutRectsOverlap(&g_widgets[j].rect, &widget->drawn)) {
+                g_widgets[j].dirty = TRUE;
+            }
+        }
+        memset(&widget->drawn, 0, sizeof(LayoutRect));
+    }
+    
+    for (int i = 0; i < WIDGET_COUNT; i++) {
+        RowWidget* widget = &g_widgets[i];
+        if (!widget->dirty) {
+            continue;
+        }
+        widget->dirty = FALSE;
+        if (!widget->visible || widget->rect.width == 0 || widget->rect.height == 0) {
+            continue;
+        }
+        
+        const LayoutRect* rect = &widget->rect;
+        int length = (int)wcslen(widget->text);
+        FrameFillRect(rect->x, rect->y, rect->width, rect->height, L' ', widget->fillAttribute);
+        FrameWriteCells(
+            rect->x, rect->y, widget->text, length < rect->width ? length : rect->width, widget->textAttribute
+        );
+        widget->drawn = *rect;
+        g_renderStats.widgetPaints++;
+        
+        for (int j = i + 1; j < WIDGET_COUNT; j++) {
+            if (g_widgets[j].visible && LayoutRectsOverlap(&g_widgets[j].rect, rect)) {
+                g_widgets[j].dirty = TRUE;
+            }
+        }
+    }
+}
+
+// Compare the dirty region against what is shown and collect changed runs.
+// Runs on the same row separated by a few unchanged cells are merged, since
+// re-sending a short gap is cheaper than starting a new write.
+static void DiffFrame(void) {
+    g_frame.spanCount = 0;
+    
+    if (!g_frame.isDirty || !g_frame.cells) {
+        return;
+    }
+    
+    SMALL_RECT region = g_frame.dirty;
+    
+    for (SHORT row = region.Top; row <= region.Bottom; row++) {
+        const FrameCell* cells = g_frame.cells + (size_t)row * g_frame.width;
+        const FrameCell* shown = g_frame.shown + (size_t)row * g_frame.width;
+        FrameSpan* last = NULL;
+        
+        for (SHORT col = region.Left; col <= region.Right; col++) {
+            if (cells[col].ch == shown[col].ch && cells[col].attr == shown[col].attr) {
+                continue;
+            }
+            
+            if (last && col - (last->x + last->length) <= FRAME_SPAN_MERGE_GAP) {
+                last->length = (SHORT)(col - last->x + 1);
+            } else if (g_frame.spanCount < g_frame.spanCapacity) {
+                last = &g_frame.spans[g_frame.spanCount++];
+                last->x = col;
+                last->y = row;
+                last->length = 1;
+            }
+        }
+    }
+}
+
+// Hand the changed runs of the frame to the backend
+static void FlushFrame(void) {
+    ComposeWidgets();
+    DiffFrame();
+    g_frame.isDirty = FALSE;
+    CaptureFrame();
+    
+    if (g_frame.spanCount == 0) {
+        g_renderStats.framesSkipped++;
+        return;
+    }
+    
+    DWORD cellsChanged = 0;
+    for (int i = 0; i < g_frame.spanCount; i++) {
+        const FrameSpan* span = &g_frame.spans[i];
+        size_t offset = (size_t)span->y * g_frame.width + span->x;
+        
+        memcpy(g_frame.shown + offset, g_frame.cells + offset, span->length * sizeof(FrameCell));
+        cellsChanged += span->length;
+    }
+    
+    g_lastFrameStats.frameNumber++;
+    g_lastFrameStats.consoleQueries = g_consoleQueryCount;
+    g_consoleQueryCount = 0;
+    g_lastFrameStats.spans = (DWORD)g_frame.spanCount;
+    g_lastFrameStats.cellsChanged = cellsChanged;
+    g_lastFrameStats.cellsWritten = 0;
+    g_lastFrameStats.bytesWritten = 0;
+    g_lastFrameStats.paintLatencyUs = 0;
+    
+    g_backend->WriteSpans(&g_frame, &g_lastFrameStats);
+    g_renderStats.framesRendered++;
+    g_renderStats.cellsWritten += g_lastFrameStats.cellsWritten;
+    g_renderStats.bytesWritten += g_lastFrameStats.bytesWritten;
+    
+    if (g_broadcast.running) {
+        BroadcastFrame();
+    }
+    
+    if (g_secondTicker.boundary != 0) {
+        RecordSecondLatency();
+    }
+    
+    if (g_frameLog) {
+        fwprintf(
+            g_frameLog,
+            L"frame %lu: console queries %lu, spans %lu, cells changed %lu, "
+            L"cells written %lu, bytes %lu",
+            g_lastFrameStats.frameNumber,
+            g_lastFrameStats.consoleQueries,
+            g_lastFrameStats.spans,
+            g_lastFrameStats.cellsChanged,
+            g_lastFrameStats.cellsWritten,
+            g_lastFrameStats.bytesWritten
+        );
+        if (g_lastFrameStats.paintLatencyUs != 0) {
+            fwprintf(g_frameLog, L", paint latency %lu us", g_lastFrameStats.paintLatencyUs);
+        }
+        fwprintf(g_frameLog, L"\n");
+        fflush(g_frameLog);
+    }
+}
+
+#ifdef _WIN32
+// Win32: read the console screen buffer geometry
+static void Win32QueryGeometry(_Out_ ConsoleGeometry* geometry) {
+    CONSOLE_SCREEN_BUFFER_INFO csbi;
+    
+    g_renderStats.consoleCalls++;
+    if (GetConsoleScreenBufferInfo(g_hConsole, &csbi)) {
+        geometry->bufferWidth = csbi.dwSize.X;
+        geometry->bufferHeight = csbi.dwSize.Y;
+        geometry->windowWidth = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+        geometry->windowHeight = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+        geometry->windowBottom = csbi.srWindow.Bottom;
+        geometry->attributes = csbi.wAttributes;
+        geometry->valid = TRUE;
+    } else {
+        geometry->bufferWidth = CONSOLE_FALLBACK_WIDTH;
+        geometry->bufferHeight = CONSOLE_FALLBACK_HEIGHT;
+        geometry->windowWidth = CONSOLE_FALLBACK_WIDTH;
+        geometry->windowHeight = CONSOLE_FALLBACK_HEIGHT;
+        geometry->windowBottom = CONSOLE_FALLBACK_HEIGHT - 1;
+        geometry->attributes = g_contentAttribute;
+        geometry->valid = FALSE;
+    }
+}
+
+// Win32: one WriteConsoleOutputW per band of consecutive changed rows,
+// covering just that band's spans. Unchanged rows between two bands (the
+// digits and the status line, say) are never rewritten.
+static void Win32WriteSpans(_In_ const FrameBuffer* frame, _Inout_ FrameStats* stats) {
+    size_t cellCount = (size_t)frame->width * (size_t)frame->height;
+    
+    if (cellCount > g_win32OutputSize) {
+        CHAR_INFO* output = (CHAR_INFO*)realloc(g_win32Output, cellCount * sizeof(CHAR_INFO));
+        if (!output) {
+            return;
+        }
+        g_win32Output = output;
+        g_win32OutputSize = cellCount;
+    }
+    
+    DWORD cellsWritten = 0;
+    COORD bufferSize = { frame->width, frame->height };
+    
+    // Spans come in row order, so a band ends at the first skipped row
+    int first = 0;
+    while (first < frame->spanCount) {
+        SMALL_RECT region = { frame->width, frame->spans[first].y, 0, frame->spans[first].y };
+        int next = first;
+        for (; next < frame->spanCount; next++) {
+            const FrameSpan* span = &frame->spans[next];
+            SHORT spanRight = (SHORT)(span->x + span->length - 1);
+            
+            if (span->y > region.Bottom + 1) {
+                break;
+            }
+            if (span->x < region.Left) region.Left = span->x;
+            if (spanRight > region.Right) region.Right = spanRight;
+            region.Bottom = span->y;
+        }
+        
+        for (SHORT row = region.Top; row <= region.Bottom; row++) {
+            size_t offset = (size_t)row * frame->width;
+            for (SHORT col = region.Left; col <= region.Right; col++) {
+                g_win32Output[offset + col].Char.UnicodeChar = frame->cells[offset + col].ch;
+                g_win32Output[offset + col].Attributes = frame->cells[offset + col].attr;
+            }
+        }
+        
+        cellsWritten += (DWORD)(region.Right - region.Left + 1) * 
+                        (DWORD)(region.Bottom - region.Top + 1);
+        
+        COORD bufferCoord = { region.Left, region.Top };
+        WriteConsoleOutputW(g_hConsole, g_win32Output, bufferSize, bufferCoord, &region);
+        g_renderStats.consoleCalls++;
+        first = next;
+    }
+    
+    stats->cellsWritten = cellsWritten;
+    stats->bytesWritten = cellsWritten * (DWORD)sizeof(CHAR_INFO);
+}
+
+// Win32: move the console cursor
+static void Win32SetCursor(_In_ SHORT x, _In_ SHORT y) {
+    COORD cursorPos = { x, y };
+    SetConsoleCursorPosition(g_hConsole, cursorPos);
+    g_renderStats.consoleCalls++;
+}
+
+// Win32: show or hide the console cursor
+static void Win32ShowCursor(_In_ BOOL visible) {
+    CONSOLE_CURSOR_INFO cursorInfo;
+    
+    g_renderStats.consoleCalls++;
+    if (!GetConsoleCursorInfo(g_hConsole, &cursorInfo)) {
+        return;
+    }
+    
+    cursorInfo.bVisible = visible;
+    SetConsoleCursorInfo(g_hConsole, &cursorInfo);
+    g_renderStats.consoleCalls++;
+}
+
+// Win32: clear the whole screen buffer, including rows the frame never covers
+static void Win32ClearScreen(_In_ const ConsoleGeometry* geometry) {
+    if (!geometry->valid) {
+        return;
+    }
+    
+    DWORD dwConSize = (DWORD)geometry->bufferWidth * (DWORD)geometry->bufferHeight;
+    COORD coordScreen = { 0, 0 };
+    DWORD cCharsWritten;
+    
+    FillConsoleOutputCharacterW(
+        g_hConsole, 
+        L' ', 
+        dwConSize, 
+        coordScreen, 
+        &cCharsWritten
+    );
+    FillConsoleOutputAttribute(
+        g_hConsole, 
+        geometry->attributes, 
+        dwConSize, 
+        coordScreen, 
+        &cCharsWritten
+    );
+    g_renderStats.consoleCalls += 2;
+}
+
+#else
+// VT: the terminal window is the whole screen; there is no scrollback buffer
+static void VtQueryGeometry(_Out_ ConsoleGeometry* geometry) {
+    struct winsize size;
+    
+    g_renderStats.consoleCalls++;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0 && size.ws_row > 0) {
+        geometry->bufferWidth = (SHORT)size.ws_col;
+        geometry->bufferHeight = (SHORT)size.ws_row;
+        geometry->valid = TRUE;
+    } else {
+        geometry->bufferWidth = CONSOLE_FALLBACK_WIDTH;
+        geometry->bufferHeight = CONSOLE_FALLBACK_HEIGHT;
+        geometry->valid = FALSE;
+    }
+    
+    geometry->windowWidth = geometry->bufferWidth;
+    geometry->windowHeight = geometry->bufferHeight;
+    geometry->windowBottom = (SHORT)(geometry->bufferHeight - 1);
+    geometry->attributes = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+}
+
+// VT: append bytes to the pending output buffer
+static BOOL VtAppend(_In_reads_(length) const char* bytes, _In_ size_t length) {
+    if (g_vtOutputLength + length > g_vtOutputSize) {
+        size_t newSize = g_vtOutputSize ? g_vtOutputSize * 2 : 4096;
+        while (newSize < g_vtOutputLength + length) {
+            newSize *= 2;
+        }
+        
+        char* output = (char*)realloc(g_vtOutput, newSize);
+        if (!output) {
+            return FALSE;
+        }
+        g_vtOutput = output;
+        g_vtOutputSize = newSize;
+    }
+    
+    memcpy(g_vtOutput + g_vtOutputLength, bytes, length);
+    g_vtOutputLength += length;
+    return TRUE;
+}
+
+// VT: append an SGR sequence for a Win32-style console attribute.
+// Plain white-on-black maps to the terminal's default colors.
+static void VtAppendAttribute(_In_ WORD attr) {
+    // Win32 color bits are BGR, ANSI color indexes are RGB
+    static const int ansiColor[8] = { 0, 4, 2, 6, 1, 5, 3, 7 };
+    // Encoded once per attribute; themed frames change color every row
+    static char sequences[256][VT_SGR_MAX];
+    static unsigned char lengths[256];
+    unsigned int index = attr & 0xFF;
+    
+    if (lengths[index] != 0) {
+        VtAppend(sequences[index], lengths[index]);
+        return;
+    }
+    
+    int foreground = attr & (FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE);
+    int background = (attr & (BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE)) >> 4;
+    char* sequence = sequences[index];
+    int length = snprintf(sequence, VT_SGR_MAX, "\x1b[0");
+    
+    if (foreground != 7 || (attr & FOREGROUND_INTENSITY)) {
+        length += snprintf(
+            sequence + length,
+            VT_SGR_MAX - length,
+            ";%d",
+            ((attr & FOREGROUND_INTENSITY) ? 90 : 30) + ansiColor[foreground]
+        );
+    }
+    if (background != 0 || (attr & BACKGROUND_INTENSITY)) {
+        length += snprintf(
+            sequence + length,
+            VT_SGR_MAX - length,
+            ";%d",
+            ((attr & BACKGROUND_INTENSITY) ? 100 : 40) + ansiColor[background]
+        );
+    }
+    sequence[length++] = 'm';
+    lengths[index] = (unsigned char)length;
+    
+    VtAppend(sequence, (size_t)length);
+}
+
+// VT: write the pending output buffer to the terminal
+static void VtFlushOutput(void) {
+    size_t offset = 0;
+    
+    // Never write escape sequences into a redirected file
+    if (!g_vtIsTerminal) {
+        g_vtOutputLength = 0;
+        return;
+    }
+    
+    while (offset < g_vtOutputLength) {
+        ssize_t written = write(STDOUT_FILENO, g_vtOutput + offset, g_vtOutputLength - offset);
+        g_renderStats.consoleCalls++;
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        offset += (size_t)written;
+    }
+    
+    g_vtOutputLength = 0;
+}
+
+// VT: encode every span (cursor move, color changes, UTF-8 text) into one write()
+static void VtWriteSpans(_In_ const FrameBuffer* frame, _Inout_ FrameStats* stats) {
+    DWORD currentAttr = 0xFFFFFFFF;
+    
+    g_vtOutputLength = 0;
+    
+    for (int i = 0; i < frame->spanCount; i++) {
+        const FrameSpan* span = &frame->spans[i];
+        const FrameCell* cells = frame->cells + (size_t)span->y * frame->width + span->x;
+        char sequence[24];
+        int length = snprintf(sequence, sizeof(sequence), "\x1b[%d;%dH", span->y + 1, span->x + 1);
+        VtAppend(sequence, (size_t)length);
+        
+        for (int col = 0; col < span->length; col++) {
+            if (cells[col].attr != currentAttr) {
+                VtAppendAttribute(cells[col].attr);
+                currentAttr = cells[col].attr;
+            }
+            
+            // UTF-8 encode; the glyph set never leaves the BMP
+            unsigned long codePoint = (unsigned long)cells[col].ch;
+            char utf8[4];
+            size_t utf8Length;
+            if (codePoint < 0x80) {
+                utf8[0] = (char)codePoint;
+                utf8Length = 1;
+            } else if (codePoint < 0x800) {
+                utf8[0] = (char)(0xC0 | (codePoint >> 6));
+                utf8[1] = (char)(0x80 | (codePoint & 0x3F));
+                utf8Length = 2;
+            } else if (codePoint < 0x10000) {
+                utf8[0] = (char)(0xE0 | (codePoint >> 12));
+                utf8[1] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+                utf8[2] = (char)(0x80 | (codePoint & 0x3F));
+                utf8Length = 3;
+            } else {
+                utf8[0] = (char)(0xF0 | (codePoint >> 18));
+                utf8[1] = (char)(0x80 | ((codePoint >> 12) & 0x3F));
+                utf8[2] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+                utf8[3] = (char)(0x80 | (codePoint & 0x3F));
+                utf8Length = 4;
+            }
+            VtAppend(utf8, utf8Length);
+        }
+        
+        stats->cellsWritten += (DWORD)span->length;
+    }
+    
+    // Leave default colors behind for echoed prompt input
+    VtAppend("\x1b[0m", 4);
+    stats->bytesWritten = (DWORD)g_vtOutputLength;
+    VtFlushOutput();
+}
+
+// VT: move the cursor
+static void VtSetCursor(_In_ SHORT x, _In_ SHORT y) {
+    char sequence[24];
+    int length = snprintf(sequence, sizeof(sequence), "\x1b[%d;%dH", y + 1, x + 1);
+    VtAppend(sequence, (size_t)length);
+    VtFlushOutput();
+}
+
+// VT: show or hide the cursor
+static void VtShowCursor(_In_ BOOL visible) {
+    VtAppend(visible ? "\x1b[?25h" : "\x1b[?25l", 6);
+    VtFlushOutput();
+}
+
+// VT: clear the whole screen to default colors
+static void VtClearScreen(_In_ const ConsoleGeometry* geometry) {
+    static const char clearSequence[] = "\x1b[0m\x1b[2J\x1b[H";
+    UNREFERENCED_PARAMETER(geometry);
+    
+    VtAppend(clearSequence, sizeof(clearSequence) - 1);
+    VtFlushOutput();
+}
+#endif
+
+// Headless: geometry is whatever size the in-memory screen was given
+static void HeadlessQueryGeometry(_Out_ ConsoleGeometry* geometry) {
+    geometry->bufferWidth = g_headless.width;
+    geometry->bufferHeight = g_headless.height;
+    geometry->windowWidth = g_headless.width;
+    geometry->windowHeight = g_headless.height;
+    geometry->windowBottom = (SHORT)(g_headless.height - 1);
+    geometry->attributes = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+    geometry->valid = TRUE;
+}
+
+// Headless: copy changed spans into the in-memory screen
+static void HeadlessWriteSpans(_In_ const FrameBuffer* frame, _Inout_ FrameStats* stats) {
+    if (!g_headless.cells) {
+        return;
+    }
+    
+    for (int i = 0; i < frame->spanCount; i++) {
+        const FrameSpan* span = &frame->spans[i];
+        if (span->y >= g_headless.height || span->x >= g_headless.width) {
+            continue;
+        }
+        
+        int length = span->length;
+        if (span->x + length > g_headless.width) {
+            length = g_headless.width - span->x;
+        }
+        
+        memcpy(
+            g_headless.cells + (size_t)span->y * g_headless.width + span->x,
+            frame->cells + (size_t)span->y * frame->width + span->x,
+            length * sizeof(FrameCell)
+        );
+        stats->cellsWritten += (DWORD)length;
+    }
+    
+    stats->bytesWritten = stats->cellsWritten * (DWORD)sizeof(FrameCell);
+}
+
+// Headless: remember the cursor position
+static void HeadlessSetCursor(_In_ SHORT x, _In_ SHORT y) {
+    g_headless.cursorX = x;
+    g_headless.cursorY = y;
+}
+
+// Headless: there is no cursor to show
+static void HeadlessShowCursor(_In_ BOOL visible) {
+    UNREFERENCED_PARAMETER(visible);
+}
+
+// Headless: (re)allocate the in-memory screen and blank it
+static void HeadlessClearScreen(_In_ const ConsoleGeometry* geometry) {
+    size_t cellCount = (size_t)g_headless.width * (size_t)g_headless.height;
+    
+    if (!g_headless.cells) {
+        g_headless.cells = (FrameCell*)malloc(cellCount * sizeof(FrameCell));
+        if (!g_headless.cells) {
+            return;
+        }
+    }
+    
+    for (size_t i = 0; i < cellCount; i++) {
+        g_headless.cells[i].ch = L' ';
+        g_headless.cells[i].attr = geometry->attributes;
+    }
+}
+
+// Render a fixed time into the headless screen, print it and time redraws
+static int RunHeadlessRender(void) {
+    g_backend = &g_headlessBackend;
+    
+    CheckConsoleResize();
+    g_contentAttribute = g_geometry.attributes;
+    g_backend->ClearScreen(&g_geometry);
+    if (!g_headless.cells) {
+        fwprintf(stderr, L"Error: Could not allocate headless screen\n");
+        return 1;
+    }
+    
+    RedrawAll(&g_renderTime);
+    FlushFrame();
+    
+    // Measure the cost of a full redraw without a console attached
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+    for (int i = 0; i < HEADLESS_RENDER_ITERATIONS; i++) {
+        RedrawAll(&g_renderTime);
+        FlushFrame();
+    }
+    QueryPerformanceCounter(&end);
+    
+    wchar_t* line = (wchar_t*)malloc(((size_t)g_headless.width + 1) * sizeof(wchar_t));
+    if (!line) {
+        return 1;
+    }
+    
+    // One line per row, trailing blanks trimmed so frames diff cleanly
+    for (SHORT row = 0; row < g_headless.height; row++) {
+        const FrameCell* cells = g_headless.cells + (size_t)row * g_headless.width;
+        int length = g_headless.width;
+        while (length > 0 && cells[length - 1].ch == L' ') {
+            length--;
+        }
+        for (int col = 0; col < length; col++) {
+            line[col] = cells[col].ch;
+        }
+        line[length] = L'\0';
+        fwprintf(stdout, L"%ls\n", line);
+    }
+    
+    double elapsedUs = (double)(end.QuadPart - start.QuadPart) * 1000000.0 / 
+                       (double)frequency.QuadPart;
+    fwprintf(
+        stderr,
+        L"Full redraw: %.2f us average over %d frames (%dx%d, %ls backend)\n",
+        elapsedUs / HEADLESS_RENDER_ITERATIONS,
+        HEADLESS_RENDER_ITERATIONS,
+        g_headless.width,
+        g_headless.height,
+        g_backend->name
+    );
+    
+    free(line);
+    free(g_headless.cells);
+    g_headless.cells = NULL;
+    FreeFrameBuffer();
+    FreeScaledGlyphs();
+    FreeFont();
+    FreeZonePanes();
+    return 0;
+}
+
+// Append one character to a buffer as UTF-8 (glyph cells are all in the BMP)
+static size_t EncodeUtf8(_In_ wchar_t ch, _Out_writes_(3) char* bytes) {
+    unsigned int code = (unsigned int)ch;
+    if (code < 0x80) {
+        bytes[0] = (char)code;
+        return 1;
+    }
+    if (code < 0x800) {
+        bytes[0] = (char)(0xC0 | (code >> 6));
+        bytes[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    }
+    bytes[0] = (char)(0xE0 | (code >> 12));
+    bytes[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+    bytes[2] = (char)(0x80 | (code & 0x3F));
+    return 3;
+}
+
+// Pre-encode every glyph row, spacing column included, as UTF-8 once
+static void BuildBannerRows(void) {
+    for (int glyph = 0; glyph < GLYPH_COUNT; glyph++) {
+        for (int line = 0; line < ASCII_CHAR_HEIGHT; line++) {
+            BannerRow* row = &g_bannerRows[glyph][line];
+            size_t length = 0;
+            
+            memset(row->bytes, ' ', sizeof(row->bytes));
+            for (int col = 0; col < ASCII_CHAR_WIDTH; col++) {
+                length += EncodeUtf8(g_glyphAtlas[glyph].rows[line][col], row->bytes + length);
+            }
+            row->length = (unsigned char)(length + ASCII_CHAR_SPACING - ASCII_CHAR_WIDTH);
+        }
+    }
+}
+
+// Read exactly count digits
+static BOOL ParseBannerDigits(_In_reads_(count) const char* text, _In_ int count, _Out_ int* value) {
+    int result = 0;
+    for (int i = 0; i < count; i++) {
+        if (text[i] < '0' || text[i] > '9') {
+            return FALSE;
+        }
+        result = result * 10 + (text[i] - '0');
+    }
+    *value = result;
+    return TRUE;
+}
+
+// Parse epoch seconds (milliseconds if 13+ digits, fraction ignored; shown
+// in UTC) or ISO 8601 YYYY-MM-DD[(T| )HH:MM[:SS[.fff]]][Z|+HH:MM] (shown
+// as the wall time written, whatever its offset)
+static BOOL ParseBannerTimestamp(
+    _In_reads_(length) const char* text,
+    _In_ size_t length,
+    _Out_ SYSTEMTIME* st
+) {
+    int year, month, day;
+    int hour = 0, minute = 0, second = 0;
+    
+    memset(st, 0, sizeof(*st));
+    while (length > 0 && (text[length - 1] == ' ' || text[length - 1] == '\t' || text[length - 1] == '\r')) {
+        length--;
+    }
+    while (length > 0 && (*text == ' ' || *text == '\t')) {
+        text++;
+        length--;
+    }
+    if (length == 0) {
+        return FALSE;
+    }
+    
+    if (length >= 10 && text[4] == '-' && text[7] == '-') {
+        if (!ParseBannerDigits(text, 4, &year) || !ParseBannerDigits(text + 5, 2, &month) ||
+            !ParseBannerDigits(text + 8, 2, &day)) {
+            return FALSE;
+        }
+        
+        size_t position = 10;
+        if (length >= 16 && (text[10] == 'T' || text[10] == ' ') && text[13] == ':') {
+            if (!ParseBannerDigits(text + 11, 2, &hour) || !ParseBannerDigits(text + 14, 2, &minute)) {
+                return FALSE;
+            }
+            position = 16;
+            if (length >= 19 && text[16] == ':') {
+                if (!ParseBannerDigits(text + 17, 2, &second)) {
+                    return FALSE;
+                }
+                position = 19;
+                if (position < length && (text[position] == '.' || text[position] == ',')) {
+                    position++;
+                    while (position < length && text[position] >= '0' && text[position] <= '9') {
+                        position++;
+                    }
+                }
+            }
+            
+            // Zone designator: accepted, the wall time is shown as written
+            if (position < length && text[position] == 'Z') {
+                position++;
+            } else if (position < length && (text[position] == '+' || text[position] == '-')) {
+                position++;
+                while (position < length && 
+                       ((text[position] >= '0' && text[position] <= '9') || text[position] == ':')) {
+                    position++;
+                }
+            }
+        }
+        
+        if (position != length || month < 1 || month > 12 || day < 1 ||
+            hour > 23 || minute > 59 || second > 60) {
+            return FALSE;
+        }
+        
+        // A day past the end of its month (2026-02-30) is not a date
+        long long nextMonth = month == 12 ? DaysFromCivil(year + 1, 1, 1) : DaysFromCivil(year, month + 1, 1);
+        if (day > nextMonth - DaysFromCivil(year, month, 1)) {
+            return FALSE;
+        }
+        
+        st->wYear = (WORD)year;
+        st->wMonth = (WORD)month;
+        st->wDay = (WORD)day;
+        st->wHour = (WORD)hour;
+        st->wMinute = (WORD)minute;
+        st->wSecond = (WORD)(second > 59 ? 59 : second);
+        return TRUE;
+    }
+    
+    // Epoch: digits, optionally a fraction
+    long long seconds = 0;
+    size_t digits = 0;
+    while (digits < length && text[digits] >= '0' && text[digits] <= '9') {
+        if (digits >= 18) {
+            return FALSE;
+        }
+        seconds = seconds * 10 + (text[digits] - '0');
+        digits++;
+    }
+    if (digits == 0) {
+        return FALSE;
+    }
+    if (digits < length) {
+        if (text[digits] != '.') {
+            return FALSE;
+        }
+        for (size_t i = digits + 1; i < length; i++) {
+            if (text[i] < '0' || text[i] > '9') {
+                return FALSE;
+            }
+        }
+    }
+    if (digits >= 13) {
+        seconds /= 1000;
+    }
+    
+    SecondsToSystemTime(seconds, st);
+    return st->wYear <= 9999;
+}
+
+// Write one 7-line banner for YYYY-MM-DD HH:MM:SS. Every glyph row is a
+// fixed-size copy (the buffer keeps BANNER_ROW_BYTES of slack past the end)
+// followed by a bump of the cursor by the row's real length.
+static char* AppendBanner(_Out_writes_(BANNER_MAX_BYTES) char* cursor, _In_ const SYSTEMTIME* st) {
+    GlyphId glyphs[BANNER_GLYPHS];
+    
+    glyphs[0] = (GlyphId)(GLYPH_DIGIT_0 + st->wYear / 1000 % 10);
+    glyphs[1] = (GlyphId)(GLYPH_DIGIT_0 + st->wYear / 100 % 10);
+    glyphs[2] = (GlyphId)(GLYPH_DIGIT_0 + st->wYear / 10 % 10);
+    glyphs[3] = (GlyphId)(GLYPH_DIGIT_0 + st->wYear % 10);
+    glyphs[4] = GLYPH_DASH;
+    glyphs[5] = (GlyphId)(GLYPH_DIGIT_0 + st->wMonth / 10);
+    glyphs[6] = (GlyphId)(GLYPH_DIGIT_0 + st->wMonth % 10);
+    glyphs[7] = GLYPH_DASH;
+    glyphs[8] = (GlyphId)(GLYPH_DIGIT_0 + st->wDay / 10);
+    glyphs[9] = (GlyphId)(GLYPH_DIGIT_0 + st->wDay % 10);
+    glyphs[10] = GLYPH_SPACE;
+    glyphs[11] = (GlyphId)(GLYPH_DIGIT_0 + st->wHour / 10);
+    glyphs[12] = (GlyphId)(GLYPH_DIGIT_0 + st->wHour % 10);
+    glyphs[13] = GLYPH_COLON;
+    glyphs[14] = (GlyphId)(GLYPH_DIGIT_0 + st->wMinute / 10);
+    glyphs[15] = (GlyphId)(GLYPH_DIGIT_0 + st->wMinute % 10);
+    glyphs[16] = GLYPH_COLON;
+    glyphs[17] = (GlyphId)(GLYPH_DIGIT_0 + st->wSecond / 10);
+    glyphs[18] = (GlyphId)(GLYPH_DIGIT_0 + st->wSecond % 10);
+    
+    for (int line = 0; line < ASCII_CHAR_HEIGHT; line++) {
+        for (int i = 0; i < BANNER_GLYPHS; i++) {
+            const BannerRow* row = &g_bannerRows[glyphs[i]][line];
+            memcpy(cursor, row->bytes, BANNER_ROW_BYTES);
+            cursor += row->length;
+        }
+        
+        // Drop the last glyph's spacing column so rows have no trailing blank
+        cursor[-1] = '\n';
+    }
+    *cursor++ = '\n';
+    return cursor;
+}
+
+static BOOL WriteBannerOutput(_In_reads_(length) const char* bytes, _In_ size_t length) {
+    return fwrite(bytes, 1, length, stdout) == length;
+}
+
+// /banner: turn a stream of timestamps on stdin into big-digit banners on
+// stdout. Lines that are not timestamps pass through untouched, so a log
+// can be piped straight through. Nothing is allocated per line.
+static int RunBannerMode(void) {
+    char* input = (char*)malloc(BANNER_INPUT_BYTES);
+    char* output = (char*)malloc(BANNER_OUTPUT_BYTES + BANNER_ROW_BYTES);
+    if (!input || !output) {
+        free(input);
+        free(output);
+        fwprintf(stderr, L"Error: Out of memory\n");
+        return 1;
+    }
+    
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    
+    BuildBannerRows();
+    
+    size_t inputLength = 0;
+    size_t outputLength = 0;
+    BOOL endOfInput = FALSE;
+    BOOL writeFailed = FALSE;
+    BOOL inLongLine = FALSE;        // Start of the current line already written
+    
+    while (!writeFailed && (!endOfInput || inputLength > 0)) {
+        if (!endOfInput && inputLength < BANNER_INPUT_BYTES) {
+            size_t got = fread(input + inputLength, 1, BANNER_INPUT_BYTES - inputLength, stdin);
+            if (got == 0) {
+                endOfInput = TRUE;
+            }
+            inputLength += got;
+        }
+        
+        size_t lineStart = 0;
+        for (;;) {
+            const char* newline = (const char*)memchr(input + lineStart, '\n', inputLength - lineStart);
+            size_t lineLength;
+            size_t next;
+            
+            if (newline) {
+                lineLength = (size_t)(newline - (input + lineStart));
+                next = lineLength + 1;
+            } else if (endOfInput) {
+                // Last line without a newline
+                lineLength = inputLength - lineStart;
+                next = lineLength;
+                if (lineLength == 0) {
+                    break;
+                }
+            } else if (lineStart == 0 && inputLength == BANNER_INPUT_BYTES) {
+                // A line longer than the buffer can only pass through; send
+                // what we have and carry on until its newline arrives
+                writeFailed = !WriteBannerOutput(output, outputLength) ||
+                              !WriteBannerOutput(input, inputLength);
+                outputLength = 0;
+                lineStart = inputLength;
+                inLongLine = TRUE;
+                break;
+            } else {
+                break;
+            }
+            
+            if (BANNER_OUTPUT_BYTES - outputLength < BANNER_MAX_BYTES) {
+                writeFailed = !WriteBannerOutput(output, outputLength);
+                outputLength = 0;
+            }
+            
+            SYSTEMTIME st;
+            const char* line = input + lineStart;
+            if (!inLongLine && lineLength < BANNER_LINE_MAX && ParseBannerTimestamp(line, lineLength, &st)) {
+                outputLength = (size_t)(AppendBanner(output + outputLength, &st) - output);
+            } else if (lineLength + 1 <= BANNER_OUTPUT_BYTES - outputLength) {
+                memcpy(output + outputLength, line, lineLength);
+                outputLength += lineLength;
+                output[outputLength++] = '\n';
+            } else {
+                writeFailed = !WriteBannerOutput(output, outputLength) || 
+                              !WriteBannerOutput(line, lineLength) ||
+                              !WriteBannerOutput("\n", 1);
+                outputLength = 0;
+            }
+            inLongLine = FALSE;
+            lineStart += next;
+        }
+        
+        memmove(input, input + lineStart, inputLength - lineStart);
+        inputLength -= lineStart;
+    }
+    
+    if (!writeFailed && outputLength > 0) {
+        writeFailed = !WriteBannerOutput(output, outputLength);
+    }
+    if (fflush(stdout) != 0) {
+        writeFailed = TRUE;
+    }
+    
+    free(input);
+    free(output);
+    return writeFailed ? 1 : 0;
+}
+
+// Blit a glyph into the frame buffer (direct overwrite, no clearing)
+static void UpdateCharPosition(
+    _In_ SHORT x, 
+    _In_ SHORT y, 
+    _In_ GlyphId glyph
+) {
+    g_renderStats.glyphBlits++;
+    
+    // The cells come from the active font
+    int scale = g_layout.scale;
+    const wchar_t* scaled = GetScaledGlyph(glyph, scale);
+    if (!scaled) {
+        scale = 1;
+        scaled = GetScaledGlyph(glyph, scale);
+    }
+    
+    // Glyphs in the date region take its (dimmer) theme colors
+    const WORD* rowAttributes = IsInLayoutRect(&g_layout.date, x, y) ? 
+                                g_themeAttributes.date : g_themeAttributes.time;
+    int width = g_font.width * scale;
+    int height = g_font.height * scale;
+    for (int line = 0; line < height; line++) {
+        FrameWriteCells(
+            x,
+            (SHORT)(y + line),
+            scaled + (size_t)line * width,
+            width,
+            rowAttributes[line]
+        );
+    }
+}
+
+// Update character position only if it has changed
+static void UpdateCharPositionIfChanged(
+    _In_ SHORT x,
+    _In_ SHORT y,
+    _In_ GlyphId glyph,
+    _In_ GlyphId oldGlyph
+) {
+    if (glyph != oldGlyph) {
+        UpdateCharPosition(x, y, glyph);
+    }
+}
+
+// Print the title line
+static void PrintTitleLine(void) {
+    const WORD titleBackgroundAttribute = BACKGROUND_RED | BACKGROUND_GREEN | 
+                                          BACKGROUND_BLUE | BACKGROUND_INTENSITY;
+    const WORD titleTextAttribute = FOREGROUND_BLUE;
+    
+    SetWidgetText(
+        WIDGET_TITLE,
+        L"Lou32 Visual Time & Date System Display Utility Apparatus",
+        titleBackgroundAttribute,
+        titleBackgroundAttribute | titleTextAttribute
+    );
+}
+
+// Print time with smart updates
+static void PrintTimeAscii(
+    _In_ const SYSTEMTIME* st, 
+    _In_ SHORT startX, 
+    _In_ SHORT startY,
+    _In_ BOOL forceRedraw,
+    _Inout_ DisplayState* state
+) {
+    long long composeStart = StatsNow();
+    int hour12 = st->wHour % 12;
+    if (hour12 == 0) {
+        hour12 = 12;
+    }
+    
+    BOOL isPM = (st->wHour >= 12);
+    
+    int hourTens = hour12 / 10;
+    int hourOnes = hour12 % 10;
+    int minuteTens = st->wMinute / 10;
+    int minuteOnes = st->wMinute % 10;
+    int secondTens = st->wSecond / 10;
+    int secondOnes = st->wSecond % 10;
+    
+    // Offsets come scaled from the layout; AM/PM already makes room for seconds
+    const SHORT spacing = g_layout.glyphSpacing;
+    const SHORT colonOffset = g_layout.colonOffset;
+    const SHORT secondsColonOffset = g_layout.secondsColonOffset;
+    const SHORT secondsOffset = g_layout.secondsOffset;
+    SHORT ampmX = (SHORT)(startX + g_layout.ampmOffset);
+
+    if (forceRedraw || !state->initialized) {
+        // Full redraw
+        UpdateCharPosition(startX, startY, GetAsciiDigit(hourTens));
+        UpdateCharPosition(
+            (SHORT)(startX + spacing), startY, GetAsciiDigit(hourOnes)
+        );
+        UpdateCharPosition(
+            (SHORT)(startX + colonOffset), startY, GLYPH_COLON
+        );
+        UpdateCharPosition(
+            (SHORT)(startX + colonOffset + spacing), 
+            startY, 
+            GetAsciiDigit(minuteTens)
+        );
+        UpdateCharPosition(
+            (SHORT)(startX + colonOffset + spacing * 2), 
+            startY, 
+            GetAsciiDigit(minuteOnes)
+        );
+        
+        if (g_showSeconds) {
+            UpdateCharPosition(
+                (SHORT)(startX + secondsColonOffset), startY, GLYPH_COLON
+            );
+            UpdateCharPosition(
+                (SHORT)(startX + secondsOffset), startY, GetAsciiDigit(secondTens)
+            );
+            UpdateCharPosition(
+                (SHORT)(startX + secondsOffset + spacing), 
+                startY, 
+                GetAsciiDigit(secondOnes)
+            );
+        }
+        
+        GlyphId ampmChar = isPM ? GLYPH_P : GLYPH_A;
+        UpdateCharPosition(ampmX, startY, ampmChar);
+        UpdateCharPosition((SHORT)(ampmX + spacing), startY, GLYPH_M);
+    } else {
+        // Smart update - only changed digits
+        UpdateCharPositionIfChanged(
+            startX, startY, 
+            GetAsciiDigit(hourTens), 
+            GetAsciiDigit(state->hourTens)
+        );
+        UpdateCharPositionIfChanged(
+            (SHORT)(startX + spacing), startY, 
+            GetAsciiDigit(hourOnes), 
+            GetAsciiDigit(state->hourOnes)
+        );
+        UpdateCharPositionIfChanged(
+            (SHORT)(startX + colonOffset + spacing), startY, 
+            GetAsciiDigit(minuteTens), 
+            GetAsciiDigit(state->minuteTens)
+        );
+        UpdateCharPositionIfChanged(
+            (SHORT)(startX + colonOffset + spacing * 2), startY, 
+            GetAsciiDigit(minuteOnes), 
+            GetAsciiDigit(state->minuteOnes)
+        );
+        
+        if (g_showSeconds) {
+            UpdateCharPositionIfChanged(
+                (SHORT)(startX + secondsOffset), startY, 
+                GetAsciiDigit(secondTens), 
+                GetAsciiDigit(state->secondTens)
+            );
+            UpdateCharPositionIfChanged(
+                (SHORT)(startX + secondsOffset + spacing), startY, 
+                GetAsciiDigit(secondOnes), 
+                GetAsciiDigit(state->secondOnes)
+            );
+        }
+        
+        if (isPM != state->isPM) {
+            GlyphId ampmChar = isPM ? GLYPH_P : GLYPH_A;
+            UpdateCharPosition(ampmX, startY, ampmChar);
+        }
+    }
+    
+    // Update state
+    state->hourTens = hourTens;
+    state->hourOnes = hourOnes;
+    state->minuteTens = minuteTens;
+    state->minuteOnes = minuteOnes;
+    state->secondTens = secondTens;
+    state->secondOnes = secondOnes;
+    state->isPM = isPM;
+    
+    StatsRecordSince(&g_renderStats.timeCompose, composeStart);
+}
+
+// Print date with smart updates
+static void PrintDateAscii(
+    _In_ const SYSTEMTIME* st, 
+    _In_ SHORT startX, 
+    _In_ SHORT startY,
+    _In_ BOOL forceRedraw,
+    _Inout_ DisplayState* state
+) {
+    long long composeStart = StatsNow();
+    int yearThousands = st->wYear / 1000;
+    int yearHundreds = (st->wYear % 1000) / 100;
+    int yearTens = (st->wYear % 100) / 10;
+    int yearOnes = st->wYear % 10;
+    int monthTens = st->wMonth / 10;
+    int monthOnes = st->wMonth % 10;
+    int dayTens = st->wDay / 10;
+    int dayOnes = st->wDay % 10;
+    const SHORT spacing = g_layout.glyphSpacing;
+
+    if (forceRedraw || !state->initialized) {
+        // Full redraw
+        SHORT currentX = startX;
+        UpdateCharPosition(currentX, startY, GetAsciiDigit(yearThousands));
+        currentX = (SHORT)(currentX + spacing);
+        UpdateCharPosition(currentX, startY, GetAsciiDigit(yearHundreds));
+        currentX = (SHORT)(currentX + spacing);
+        UpdateCharPosition(currentX, startY, GetAsciiDigit(yearTens));
+        currentX = (SHORT)(currentX + spacing);
+        UpdateCharPosition(currentX, startY, GetAsciiDigit(yearOnes));
+        currentX = (SHORT)(currentX + spacing);
+        UpdateCharPosition(currentX, startY, GLYPH_DASH);
+        currentX = (SHORT)(currentX + spacing);
+        UpdateCharPosition(currentX, startY, GetAsciiDigit(monthTens));
+        currentX = (SHORT)(currentX + spacing);
+        UpdateCharPosition(currentX, startY, GetAsciiDigit(monthOnes));
+        currentX = (SHORT)(currentX + spacing);
+        UpdateCharPosition(currentX, startY, GLYPH_DASH);
+        currentX = (SHORT)(currentX + spacing);
+        UpdateCharPosition(currentX, startY, GetAsciiDigit(dayTens));
+        currentX = (SHORT)(currentX + spacing);
+        UpdateCharPosition(currentX, startY, GetAsciiDigit(dayOnes));
+    } else {
+        // Smart update - only changed digits
+        SHORT currentX = startX;
+        
+        UpdateCharPositionIfChanged(
+            currentX, startY, 
+            GetAsciiDigit(yearThousands), 
+            GetAsciiDigit(state->yearThousands)
+        );
+        currentX = (SHORT)(currentX + spacing);
+        
+        UpdateCharPositionIfChanged(
+            currentX, startY, 
+            GetAsciiDigit(yearHundreds), 
+            GetAsciiDigit(state->yearHundreds)
+        );
+        currentX = (SHORT)(currentX + spacing);
+        
+        UpdateCharPositionIfChanged(
+            currentX, startY, 
+            GetAsciiDigit(yearTens), 
+            GetAsciiDigit(state->yearTens)
+        );
+        currentX = (SHORT)(currentX + spacing);
+        
+        UpdateCharPositionIfChanged(
+            currentX, startY, 
+            GetAsciiDigit(yearOnes), 
+            GetAsciiDigit(state->yearOnes)
+        );
+        currentX = (SHORT)(currentX + spacing * 2); // Skip dash
+        
+        UpdateCharPositionIfChanged(
+            currentX, startY, 
+            GetAsciiDigit(monthTens), 
+            GetAsciiDigit(state->monthTens)
+        );
+        currentX = (SHORT)(currentX + spacing);
+        
+        UpdateCharPositionIfChanged(
+            currentX, startY, 
+            GetAsciiDigit(monthOnes), 
+            GetAsciiDigit(state->monthOnes)
+        );
+        currentX = (SHORT)(currentX + spacing * 2); // Skip dash
+        
+        UpdateCharPositionIfChanged(
+            currentX, startY, 
+            GetAsciiDigit(dayTens), 
+            GetAsciiDigit(state->dayTens)
+        );
+        currentX = (SHORT)(currentX + spacing);
+        
+        UpdateCharPositionIfChanged(
+            currentX, startY, 
+            GetAsciiDigit(dayOnes), 
+            GetAsciiDigit(state->dayOnes)
+        );
+    }
+    
+    // Update state
+    state->yearThousands = yearThousands;
+    state->yearHundreds = yearHundreds;
+    state->yearTens = yearTens;
+    state->yearOnes = yearOnes;
+    state->monthTens = monthTens;
+    state->monthOnes = monthOnes;
+    state->dayTens = dayTens;
+    state->dayOnes = dayOnes;
+    
+    StatsRecordSince(&g_renderStats.dateCompose, composeStart);
+}
+
+// Days from 1970-01-01 to a proleptic Gregorian date
+static long long DaysFromCivil(_In_ int year, _In_ int month, _In_ int day) {
+    long long y = (long long)year - (month <= 2 ? 1 : 0);
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    long long yearOfEra = y - era * 400;
+    long long dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    long long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+// Inverse of DaysFromCivil
+static void CivilFromDays(_In_ long long days, _Out_ int* year, _Out_ int* month, _Out_ int* day) {
+    days += 719468;
+    long long era = (days >= 0 ? days : days - 146096) / 146097;
+    long long dayOfEra = days - era * 146097;
+    long long yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    long long dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    long long monthIndex = (5 * dayOfYear + 2) / 153;
+    
+    *day = (int)(dayOfYear - (153 * monthIndex + 2) / 5 + 1);
+    *month = (int)(monthIndex < 10 ? monthIndex + 3 : monthIndex - 9);
+    *year = (int)(yearOfEra + era * 400 + (*month <= 2 ? 1 : 0));
+}
+
+// Split seconds since the epoch (already shifted to local time) into fields
+static void SecondsToSystemTime(_In_ long long seconds, _Out_ SYSTEMTIME* st) {
+    long long days = seconds / SECONDS_PER_DAY;
+    long long secondOfDay = seconds % SECONDS_PER_DAY;
+    if (secondOfDay < 0) {
+        secondOfDay += SECONDS_PER_DAY;
+        days--;
+    }
+    
+    int year, month, day;
+    CivilFromDays(days, &year, &month, &day);
+    
+    st->wYear = (WORD)year;
+    st->wMonth = (WORD)month;
+    st->wDay = (WORD)day;
+    st->wDayOfWeek = (WORD)(((days % 7) + 11) % 7);   // 1970-01-01 was a Thursday
+    st->wHour = (WORD)(secondOfDay / 3600);
+    st->wMinute = (WORD)(secondOfDay / 60 % 60);
+    st->wSecond = (WORD)(secondOfDay % 60);
+    st->wMilliseconds = 0;
+}
+
+// Read a TZ abbreviation: letters, or anything between < and >
+static BOOL ParseTzName(_Inout_ const char** text, _Out_writes_(ZONE_ABBREV_LENGTH) wchar_t* name) {
+    const char* p = *text;
+    int length = 0;
+    
+    if (*p == '<') {
+        p++;
+        while (*p && *p != '>') {
+            if (length < ZONE_ABBREV_LENGTH - 1) {
+                name[length++] = (wchar_t)(unsigned char)*p;
+            }
+            p++;
+        }
+        if (*p != '>' || length == 0) {
+            return FALSE;
+        }
+        p++;
+    } else {
+        while ((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z')) {
+            if (length < ZONE_ABBREV_LENGTH - 1) {
+                name[length++] = (wchar_t)(unsigned char)*p;
+            }
+            p++;
+        }
+        if (length < 3) {
+            return FALSE;
+        }
+    }
+    
+    name[length] = L'\0';
+    *text = p;
+    return TRUE;
+}
+
+// Read [+|-]hh[:mm[:ss]] as signed seconds
+static BOOL ParseTzSeconds(_Inout_ const char** text, _Out_ long* seconds) {
+    const char* p = *text;
+    long sign = 1;
+    long parts[3] = { 0, 0, 0 };
+    
+    if (*p == '+' || *p == '-') {
+        sign = (*p == '-') ? -1 : 1;
+        p++;
+    }
+    
+    for (int part = 0; part < 3; part++) {
+        if (part > 0) {
+            if (*p != ':') {
+                break;
+            }
+            p++;
+        }
+        if (*p < '0' || *p > '9') {
+            return FALSE;
+        }
+        while (*p >= '0' && *p <= '9') {
+            parts[part] = parts[part] * 10 + (*p - '0');
+            if (parts[part] > 167) {
+                return FALSE;
+            }
+            p++;
+        }
+    }
+    
+    *seconds = sign * (parts[0] * 3600 + parts[1] * 60 + parts[2]);
+    *text = p;
+    return TRUE;
+}
+
+static BOOL ParseTzNumber(_Inout_ const char** text, _Out_ int* value) {
+    const char* p = *text;
+    int result = 0;
+    
+    if (*p < '0' || *p > '9') {
+        return FALSE;
+    }
+    while (*p >= '0' && *p <= '9') {
+        result = result * 10 + (*p - '0');
+        if (result > 1000) {
+            return FALSE;
+        }
+        p++;
+    }
+    
+    *value = result;
+    *text = p;
+    return TRUE;
+}
+
+// Read Mm.w.d, Jn or n, with an optional /time (default 02:00:00)
+static BOOL ParseTzDate(_Inout_ const char** text, _Out_ ZoneRuleDate* date) {
+    const char* p = *text;
+    
+    memset(date, 0, sizeof(*date));
+    if (*p == 'M') {
+        p++;
+        date->kind = ZONE_DATE_MONTH_WEEK;
+        if (!ParseTzNumber(&p, &date->month) || *p++ != '.' ||
+            !ParseTzNumber(&p, &date->week) || *p++ != '.' ||
+            !ParseTzNumber(&p, &date->weekday)) {
+            return FALSE;
+        }
+        if (date->month < 1 || date->month > 12 || date->week < 1 || date->week > 5 ||
+            date->weekday > 6) {
+            return FALSE;
+        }
+    } else if (*p == 'J') {
+        p++;
+        date->kind = ZONE_DATE_JULIAN;
+        if (!ParseTzNumber(&p, &date->day) || date->day < 1 || date->day > 365) {
+            return FALSE;
+        }
+    } else {
+        date->kind = ZONE_DATE_ORDINAL;
+        if (!ParseTzNumber(&p, &date->day) || date->day > 365) {
+            return FALSE;
+        }
+    }
+    
+    date->time = 2 * 3600;
+    if (*p == '/') {
+        p++;
+        if (!ParseTzSeconds(&p, &date->time)) {
+            return FALSE;
+        }
+    }
+    
+    *text = p;
+    return TRUE;
+}
+
+// Parse a POSIX TZ rule such as "EST5EDT,M3.2.0,M11.1.0" or "<+0530>-5:30".
+// Offsets in the string are west-positive; ZoneRule stores them east-positive.
+static BOOL ParsePosixTzRule(_In_z_ const char* text, _Out_ ZoneRule* rule) {
+    const char* p = text;
+    long offset;
+    
+    memset(rule, 0, sizeof(*rule));
+    if (!ParseTzName(&p, rule->stdAbbrev) || !ParseTzSeconds(&p, &offset)) {
+        return FALSE;
+    }
+    rule->stdOffset = -offset;
+    rule->dstOffset = rule->stdOffset;
+    
+    if (*p == '\0') {
+        return TRUE;
+    }
+    
+    if (!ParseTzName(&p, rule->dstAbbrev)) {
+        return FALSE;
+    }
+    rule->hasDst = TRUE;
+    rule->dstOffset = rule->stdOffset + 3600;
+    if (*p != ',' && *p != '\0') {
+        if (!ParseTzSeconds(&p, &offset)) {
+            return FALSE;
+        }
+        rule->dstOffset = -offset;
+    }
+    
+    if (*p == '\0') {
+        // No dates given: POSIX leaves this to the implementation; use US rules
+        const char* defaultRule = ",M3.2.0,M11.1.0";
+        p = defaultRule;
+    }
+    
+    if (*p++ != ',' || !ParseTzDate(&p, &rule->start) ||
+        *p++ != ',' || !ParseTzDate(&p, &rule->end) || *p != '\0') {
+        return FALSE;
+    }
+    
+    return TRUE;
+}
+
+static uint32_t ReadBigEndian32(_In_reads_(4) const unsigned char* bytes) {
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | 
+           ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+}
+
+// Parse a TZif file (RFC 8536). Version 2+ files carry 64-bit transitions
+// after the 32-bit block, then a POSIX TZ footer for times past the table.
+static BOOL ParseZoneInfo(_In_reads_(size) const unsigned char* data, _In_ size_t size, _Inout_ ZoneTable* table) {
+    const size_t headerSize = 44;
+    size_t offset = 0;
+    int timeSize = 4;
+    uint32_t counts[6];
+    
+    if (size < headerSize || memcmp(data, "TZif", 4) != 0) {
+        return FALSE;
+    }
+    
+    for (int pass = 0; ; pass++) {
+        if (offset + headerSize > size || memcmp(data + offset, "TZif", 4) != 0) {
+            return FALSE;
+        }
+        for (int i = 0; i < 6; i++) {
+            counts[i] = ReadBigEndian32(data + offset + 20 + i * 4);
+            if (counts[i] > 100000) {
+                return FALSE;
+            }
+        }
+        offset += headerSize;
+        
+        // counts: isutcnt, isstdcnt, leapcnt, timecnt, typecnt, charcnt
+        if (pass == 1 || data[4] < '2') {
+            break;
+        }
+        offset += (size_t)counts[3] * 5 + (size_t)counts[4] * 6 + counts[5] + 
+                  (size_t)counts[2] * 8 + counts[1] + counts[0];
+        timeSize = 8;
+    }
+    
+    uint32_t leapCount = counts[2];
+    uint32_t timeCount = counts[3];
+    uint32_t typeCount = counts[4];
+    uint32_t charCount = counts[5];
+    size_t blockSize = (size_t)timeCount * (timeSize + 1) + (size_t)typeCount * 6 + charCount + 
+                       (size_t)leapCount * (timeSize + 4) + counts[1] + counts[0];
+    
+    if (typeCount == 0 || offset + blockSize > size) {
+        return FALSE;
+    }
+    
+    const unsigned char* times = data + offset;
+    const unsigned char* indices = times + (size_t)timeCount * timeSize;
+    const unsigned char* typeData = indices + timeCount;
+    const char* abbrevs = (const char*)(typeData + (size_t)typeCount * 6);
+    
+    table->transitions = (long long*)malloc((timeCount + 1) * sizeof(long long));
+    table->transitionTypes = (unsigned char*)malloc(timeCount + 1);
+    table->types = (ZoneType*)calloc(typeCount, sizeof(ZoneType));
+    if (!table->transitions || !table->transitionTypes || !table->types) {
+        return FALSE;
+    }
+    
+    for (uint32_t i = 0; i < timeCount; i++) {
+        const unsigned char* entry = times + (size_t)i * timeSize;
+        if (timeSize == 8) {
+            uint64_t value = ((uint64_t)ReadBigEndian32(entry) << 32) | ReadBigEndian32(entry + 4);
+            table->transitions[i] = (long long)value;
+        } else {
+            table->transitions[i] = (int32_t)ReadBigEndian32(entry);
+        }
+        if (indices[i] >= typeCount || (i > 0 && table->transitions[i] <= table->transitions[i - 1])) {
+            return FALSE;
+        }
+        table->transitionTypes[i] = indices[i];
+    }
+    table->transitionCount = (int)timeCount;
+    
+    for (uint32_t i = 0; i < typeCount; i++) {
+        const unsigned char* entry = typeData + (size_t)i * 6;
+        ZoneType* type = &table->types[i];
+        unsigned char abbrevIndex = entry[5];
+        
+        type->offset = (int32_t)ReadBigEndian32(entry);
+        type->isDst = entry[4] != 0;
+        if (abbrevIndex < charCount) {
+            for (uint32_t c = 0; c < ZONE_ABBREV_LENGTH - 1 && 
+                            abbrevIndex + c < charCount && abbrevs[abbrevIndex + c]; c++) {
+                type->abbrev[c] = (wchar_t)(unsigned char)abbrevs[abbrevIndex + c];
+            }
+        }
+    }
+    table->typeCount = (int)typeCount;
+    
+    // Footer: "\n<POSIX TZ>\n"; an empty footer means no rule past the table
+    offset += blockSize;
+    if (timeSize == 8 && offset < size && data[offset] == '\n') {
+        char footer[ZONE_RULE_TEXT_MAX];
+        size_t length = 0;
+        offset++;
+        while (offset < size && data[offset] != '\n' && length < sizeof(footer) - 1) {
+            footer[length++] = (char)data[offset++];
+        }
+        footer[length] = '\0';
+        if (length > 0 && ParsePosixTzRule(footer, &table->rule)) {
+            table->hasRule = TRUE;
+        }
+    }
+    
+    return TRUE;
+}
+
+#ifdef _WIN32
+// Convert one year's registry time zone information into a rule
+static void ZoneRuleFromInformation(_In_ const TIME_ZONE_INFORMATION* info, _Out_ ZoneRule* rule) {
+    const SYSTEMTIME* dates[2] = { &info->DaylightDate, &info->StandardDate };
+    ZoneRuleDate* targets[2];
+    
+    memset(rule, 0, sizeof(*rule));
+    targets[0] = &rule->start;
+    targets[1] = &rule->end;
+    rule->stdOffset = -(info->Bias + info->StandardBias) * 60;
+    rule->dstOffset = -(info->Bias + info->DaylightBias) * 60;
+    rule->hasDst = info->DaylightDate.wMonth != 0 && info->StandardDate.wMonth != 0;
+    wcsncpy_s(rule->stdAbbrev, ZONE_ABBREV_LENGTH, info->StandardName, _TRUNCATE);
+    wcsncpy_s(rule->dstAbbrev, ZONE_ABBREV_LENGTH, info->DaylightName, _TRUNCATE);
+    
+    for (int i = 0; i < 2; i++) {
+        const SYSTEMTIME* date = dates[i];
+        ZoneRuleDate* target = targets[i];
+        
+        // wYear set means a fixed date in that year rather than "week w of month m"
+        if (date->wYear != 0) {
+            target->kind = ZONE_DATE_ORDINAL;
+            target->day = (int)(DaysFromCivil(date->wYear, date->wMonth, date->wDay) - 
+                                DaysFromCivil(date->wYear, 1, 1));
+        } else {
+            target->kind = ZONE_DATE_MONTH_WEEK;
+            target->month = date->wMonth;
+            target->week = date->wDay;
+            target->weekday = date->wDayOfWeek;
+        }
+        target->time = date->wHour * 3600L + date->wMinute * 60L + date->wSecond;
+    }
+}
+#endif
+
+// The recurring rule in force for a year (Windows zones can change yearly)
+static BOOL GetZoneRuleForYear(_In_ ZoneTable* table, _In_ int year, _Out_ ZoneRule* rule) {
+#ifdef _WIN32
+    if (table->isDynamic) {
+        TIME_ZONE_INFORMATION info;
+        if (year < 1601 || year > 30827 ||
+            !GetTimeZoneInformationForYear((WORD)year, &table->dynamic, &info)) {
+            return FALSE;
+        }
+        ZoneRuleFromInformation(&info, rule);
+        return TRUE;
+    }
+#else
+    UNREFERENCED_PARAMETER(year);
+#endif
+    *rule = table->rule;
+    return table->hasRule;
+}
+
+// UTC second at which a rule date falls in a year, given the local offset in
+// force just before it
+static long long GetZoneRuleTransition(_In_ const ZoneRuleDate* date, _In_ int year, _In_ long offset) {
+    long long jan1 = DaysFromCivil(year, 1, 1);
+    BOOL leapYear = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    long long day;
+    
+    switch (date->kind) {
+        case ZONE_DATE_JULIAN:
+            day = jan1 + date->day - 1 + ((leapYear && date->day >= 60) ? 1 : 0);
+            break;
+        case ZONE_DATE_ORDINAL:
+            day = jan1 + date->day;
+            break;
+        default: {
+            long long first = DaysFromCivil(year, date->month, 1);
+            long long next = date->month == 12 ? 
+                DaysFromCivil(year + 1, 1, 1) : DaysFromCivil(year, date->month + 1, 1);
+            int firstWeekday = (int)(((first % 7) + 11) % 7);
+            day = first + (date->weekday - firstWeekday + 7) % 7 + (date->week - 1) * 7;
+            while (day >= next) {
+                day -= 7;
+            }
+            break;
+        }
+    }
+    
+    return day * SECONDS_PER_DAY + date->time - offset;
+}
+
+// Evaluate a zone's recurring rule at a UTC second. Transitions of the
+// surrounding three years are ordered so southern-hemisphere rules (DST
+// across New Year) need no special case. Returns the next transition.
+static long long LookupZoneRule(
+    _In_ ZoneTable* table,
+    _In_ long long utc,
+    _Out_ long* offset,
+    _Out_writes_(ZONE_ABBREV_LENGTH) wchar_t* abbrev
+) {
+    ZoneRule rule;
+    int year, month, day;
+    long long eventTime[6];
+    BOOL eventDst[6];
+    int eventCount = 0;
+    
+    CivilFromDays((utc >= 0 ? utc : utc - SECONDS_PER_DAY + 1) / SECONDS_PER_DAY, &year, &month, &day);
+    
+    if (!GetZoneRuleForYear(table, year, &rule)) {
+        *offset = 0;
+        wcscpy_s(abbrev, ZONE_ABBREV_LENGTH, L"UTC");
+        return ZONE_FOREVER;
+    }
+    if (!rule.hasDst) {
+        *offset = rule.stdOffset;
+        wcscpy_s(abbrev, ZONE_ABBREV_LENGTH, rule.stdAbbrev);
+        return ZONE_FOREVER;
+    }
+    
+    for (int y = year - 1; y <= year + 1; y++) {
+        ZoneRule yearRule;
+        if (!GetZoneRuleForYear(table, y, &yearRule) || !yearRule.hasDst) {
+            continue;
+        }
+        
+        long long times[2];
+        times[0] = GetZoneRuleTransition(&yearRule.start, y, yearRule.stdOffset);
+        times[1] = GetZoneRuleTransition(&yearRule.end, y, yearRule.dstOffset);
+        for (int i = 0; i < 2; i++) {
+            // Insertion keeps the handful of events sorted
+            int slot = eventCount++;
+            while (slot > 0 && eventTime[slot - 1] > times[i]) {
+                eventTime[slot] = eventTime[slot - 1];
+                eventDst[slot] = eventDst[slot - 1];
+                slot--;
+            }
+            eventTime[slot] = times[i];
+            eventDst[slot] = (i == 0);
+        }
+    }
+    
+    BOOL isDst = eventCount > 0 ? !eventDst[0] : FALSE;
+    long long next = ZONE_FOREVER;
+    for (int i = 0; i < eventCount; i++) {
+        if (eventTime[i] <= utc) {
+            isDst = eventDst[i];
+        } else {
+            next = eventTime[i];
+            break;
+        }
+    }
+    
+    *offset = isDst ? rule.dstOffset : rule.stdOffset;
+    wcscpy_s(abbrev, ZONE_ABBREV_LENGTH, isDst ? rule.dstAbbrev : rule.stdAbbrev);
+    return next;
+}
+
+// Find a zone's offset at a UTC second. Returns the next transition, after
+// which the answer may change.
+static long long LookupZone(
+    _In_ ZoneTable* table,
+    _In_ long long utc,
+    _Out_ long* offset,
+    _Out_writes_(ZONE_ABBREV_LENGTH) wchar_t* abbrev
+) {
+    g_renderStats.zoneLookups++;
+    
+    int count = table->transitionCount;
+    if (count == 0 || utc >= table->transitions[count - 1]) {
+        if (table->hasRule
+#ifdef _WIN32
+            || table->isDynamic
+#endif
+        ) {
+            return LookupZoneRule(table, utc, offset, abbrev);
+        }
+        if (table->typeCount > 0) {
+            const ZoneType* type = &table->types[count > 0 ? table->transitionTypes[count - 1] : 0];
+            *offset = type->offset;
+            wcscpy_s(abbrev, ZONE_ABBREV_LENGTH, type->abbrev);
+        } else {
+            *offset = 0;
+            wcscpy_s(abbrev, ZONE_ABBREV_LENGTH, L"UTC");
+        }
+        return ZONE_FOREVER;
+    }
+    
+    // Before the first transition the zone uses type 0
+    if (utc < table->transitions[0]) {
+        *offset = table->types[0].offset;
+        wcscpy_s(abbrev, ZONE_ABBREV_LENGTH, table->types[0].abbrev);
+        return table->transitions[0];
+    }
+    
+    // Last transition at or before utc
+    int low = 0;
+    int high = count - 1;
+    while (low < high) {
+        int mid = low + (high - low + 1) / 2;
+        if (table->transitions[mid] <= utc) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    
+    const ZoneType* type = &table->types[table->transitionTypes[low]];
+    *offset = type->offset;
+    wcscpy_s(abbrev, ZONE_ABBREV_LENGTH, type->abbrev);
+    return table->transitions[low + 1];
+}
+
+#ifndef _WIN32
+// Load a TZif file into a table
+static BOOL LoadZoneInfoFile(_In_z_ const char* path, _Inout_ ZoneTable* table) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return FALSE;
+    }
+    
+    unsigned char* data = (unsigned char*)malloc(ZONEINFO_FILE_MAX);
+    size_t size = data ? fread(data, 1, ZONEINFO_FILE_MAX, file) : 0;
+    fclose(file);
+    
+    BOOL parsed = data && ParseZoneInfo(data, size, table);
+    free(data);
+    if (!parsed) {
+        FreeZoneTable(table);
+    }
+    return parsed;
+}
+
+// Load a zone by name from the zoneinfo database ($TZDIR or the system copy)
+static BOOL LoadZoneInfoByName(_In_z_ const char* name, _Inout_ ZoneTable* table) {
+    char path[ZONEINFO_PATH_MAX];
+    const char* directory = getenv("TZDIR");
+    
+    if (name[0] == '/') {
+        return LoadZoneInfoFile(name, table);
+    }
+    if (!directory || !directory[0]) {
+        directory = ZONEINFO_DEFAULT_DIR;
+    }
+    if (strstr(name, "..") || 
+        snprintf(path, sizeof(path), "%s/%s", directory, name) >= (int)sizeof(path)) {
+        return FALSE;
+    }
+    return LoadZoneInfoFile(path, table);
+}
+#endif
+
+// Load a zone: "UTC", "local", a zoneinfo name such as "Asia/Tokyo" (a
+// Windows time zone key such as "Tokyo Standard Time" on Windows), or a
+// POSIX TZ rule. Only the local database is consulted.
+static BOOL LoadZoneTable(_In_z_ const wchar_t* id, _Out_ ZoneTable* table) {
+    char narrow[ZONE_RULE_TEXT_MAX];
+    
+    memset(table, 0, sizeof(*table));
+    if (_wcsicmp(id, L"UTC") == 0 || _wcsicmp(id, L"Z") == 0) {
+        table->hasRule = TRUE;
+        wcscpy_s(table->rule.stdAbbrev, ZONE_ABBREV_LENGTH, L"UTC");
+        return TRUE;
+    }
+    
+#ifdef _WIN32
+    if (_wcsicmp(id, L"local") == 0) {
+        if (GetDynamicTimeZoneInformation(&table->dynamic) == TIME_ZONE_ID_INVALID) {
+            return FALSE;
+        }
+        table->isDynamic = TRUE;
+        return TRUE;
+    }
+    
+    DYNAMIC_TIME_ZONE_INFORMATION dynamic;
+    for (DWORD index = 0; EnumDynamicTimeZoneInformation(index, &dynamic) == ERROR_SUCCESS; index++) {
+        if (_wcsicmp(dynamic.TimeZoneKeyName, id) == 0) {
+            table->dynamic = dynamic;
+            table->isDynamic = TRUE;
+            return TRUE;
+        }
+    }
+    
+    size_t converted = 0;
+    if (wcstombs_s(&converted, narrow, sizeof(narrow), id, _TRUNCATE) != 0) {
+        return FALSE;
+    }
+#else
+    if (wcstombs(narrow, id, sizeof(narrow)) >= sizeof(narrow)) {
+        return FALSE;
+    }
+    
+    if (_wcsicmp(id, L"local") == 0) {
+        // Same precedence as the C library: $TZ, then /etc/localtime
+        const char* tz = getenv("TZ");
+        if (!tz || !tz[0]) {
+            return LoadZoneInfoFile("/etc/localtime", table);
+        }
+        if (tz[0] == ':') {
+            tz++;
+        }
+        if (strlen(tz) >= sizeof(narrow)) {
+            return FALSE;
+        }
+        strcpy(narrow, tz);
+    }
+    
+    if (LoadZoneInfoByName(narrow, table)) {
+        return TRUE;
+    }
+#endif
+    
+    if (ParsePosixTzRule(narrow, &table->rule)) {
+        table->hasRule = TRUE;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static void FreeZoneTable(_Inout_ ZoneTable* table) {
+    free(table->transitions);
+    free(table->transitionTypes);
+    free(table->types);
+    table->transitions = NULL;
+    table->transitionTypes = NULL;
+    table->types = NULL;
+    table->transitionCount = 0;
+    table->typeCount = 0;
+}
+
+// Add a world-clock pane from "[label=]zone"
+static BOOL AddZonePane(_In_z_ const wchar_t* spec) {
+    if (g_zonePaneCount >= ZONE_PANE_MAX) {
+        fwprintf(stderr, L"Warning: At most %d /zone panes; ignoring %ls\n", ZONE_PANE_MAX, spec);
+        return FALSE;
+    }
+    
+    ZonePane* pane = &g_zonePanes[g_zonePaneCount];
+    const wchar_t* id = spec;
+    const wchar_t* equals = wcschr(spec, L'=');
+    
+    memset(pane, 0, sizeof(*pane));
+    if (equals) {
+        size_t labelLength = (size_t)(equals - spec);
+        if (labelLength >= ZONE_NAME_LENGTH) {
+            labelLength = ZONE_NAME_LENGTH - 1;
+        }
+        wcsncpy_s(pane->label, ZONE_NAME_LENGTH, spec, labelLength);
+        id = equals + 1;
+    } else {
+        wcsncpy_s(pane->label, ZONE_NAME_LENGTH, _wcsicmp(spec, L"local") == 0 ? L"Local" : spec, _TRUNCATE);
+    }
+    
+    if (!LoadZoneTable(id, &pane->table)) {
+        fwprintf(stderr, L"Warning: Unknown time zone %ls\n", id);
+        return FALSE;
+    }
+    
+    // Empty cache: the first tick does the lookup
+    pane->cacheStart = ZONE_FOREVER;
+    pane->cacheEnd = ZONE_FOREVER;
+    g_zonePaneCount++;
+    return TRUE;
+}
+
+static void FreeZonePanes(void) {
+    for (int i = 0; i < g_zonePaneCount; i++) {
+        FreeZoneTable(&g_zonePanes[i].table);
+    }
+    g_zonePaneCount = 0;
+}
+
+// Local time in a pane's zone. The lookup only runs when utc leaves the
+// window the cached offset is known to hold for.
+static void GetPaneLocalTime(_Inout_ ZonePane* pane, _In_ long long utc, _Out_ SYSTEMTIME* st) {
+    if (utc < pane->cacheStart || utc >= pane->cacheEnd) {
+        pane->cacheEnd = LookupZone(&pane->table, utc, &pane->cacheOffset, pane->cacheAbbrev);
+        pane->cacheStart = utc;
+    }
+    SecondsToSystemTime(utc + pane->cacheOffset, st);
+}
+
+// The instant every pane shows: now, or the /render time
+static long long GetWorldClockUtc(void) {
+    if (g_renderRequested) {
+        return LocalTimeToUtcSeconds(&g_renderTime);
+    }
+    return ReadUtcSeconds();
+}
+
+// Draw every world-clock pane: a label line with the date and offset, then
+// the time in large digits. Panes flow left to right, then down.
+static void PrintWorldClock(_In_ BOOL forceRedraw) {
+    const WORD labelAttribute = FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY;
+    long long utc = GetWorldClockUtc();
+    
+    for (int i = 0; i < g_zonePaneCount; i++) {
+        ZonePane* pane = &g_zonePanes[i];
+        const LayoutRect* rect = &g_layout.panes[i];
+        const int paneWidth = rect->width;
+        SYSTEMTIME local;
+        wchar_t label[160];
+        
+        GetPaneLocalTime(pane, utc, &local);
+        
+        long offsetMinutes = pane->cacheOffset / 60;
+        long absoluteMinutes = offsetMinutes < 0 ? -offsetMinutes : offsetMinutes;
+        swprintf(
+            label,
+            160,
+            L"%ls  %04u-%02u-%02u  %ls UTC%lc%02ld:%02ld",
+            pane->label,
+            local.wYear,
+            local.wMonth,
+            local.wDay,
+            pane->cacheAbbrev,
+            offsetMinutes < 0 ? L'-' : L'+',
+            absoluteMinutes / 60,
+            absoluteMinutes % 60
+        );
+        if (paneWidth < 160) {
+            label[paneWidth] = L'\0';
+        }
+        
+        // Rewritten every pass; the frame diff drops it unless it changed
+        FrameFillRect(rect->x, rect->y, rect->width, 1, L' ', labelAttribute);
+        FrameWriteText(rect->x, rect->y, label, labelAttribute);
+        PrintTimeAscii(&local, rect->x, (SHORT)(rect->y + 1), forceRedraw, &pane->state);
+        pane->state.initialized = TRUE;
+    }
+}
+
+// Get ramp duration in milliseconds
+static DWORD GetRampDurationMs(_In_ AlarmRampSpeed speed) {
+    switch (speed) {
+        case ALARM_RAMP_FAST:
+            return 10000;      // 10 seconds
+        case ALARM_RAMP_MODERATE:
+            return 30000;      // 30 seconds
+        case ALARM_RAMP_SLOW:
+            return 60000;      // 60 seconds
+        default:
+            return 30000;
+    }
+}
+
+// Print alarm status line 2 lines below date display
+static void PrintAlarmStatusLine(void) {
+    if (!g_frame.cells) {
+        return;
+    }
+    
+    // The layout leaves the row empty when it falls off the console
+    if (g_layout.status.height == 0) {
+        return;
+    }
+    
+    // Set yellow foreground for alarm status
+    WORD alarmAttribute = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY;
+    wchar_t statusText[256] = L"";
+    
+    if (g_alarmState.isRinging) {
+        if (g_alarmState.name[0] != L'\0') {
+            swprintf(
+                statusText,
+                256,
+                L"ALARM RINGING: %ls - Press Alt+X to stop",
+                g_alarmState.name
+            );
+        } else {
+            wcscpy_s(statusText, 256, L"ALARM RINGING - Press Alt+X to stop");
+        }
+    } else if (g_alarms.count > 0) {
+        const AlarmEntry* upcoming[ALARM_STATUS_UPCOMING];
+        int upcomingCount = GetUpcomingAlarms(upcoming, ALARM_STATUS_UPCOMING);
+        
+        int length = 0;
+        if (g_alarms.count == 1) {
+            length = swprintf(statusText, 256, L"ALARM SET:");
+        } else {
+            length = swprintf(statusText, 256, L"ALARMS SET (%d):", g_alarms.count);
+        }
+        
+        // Next few alarms in firing order; the row clips anything too wide
+        for (int i = 0; i < upcomingCount && length >= 0 && length < 256; i++) {
+            const AlarmEntry* entry = upcoming[i];
+            int written = swprintf(
+                statusText + length,
+                (size_t)(256 - length),
+                L"%ls %02d:%02d%ls%ls%ls [RAMP: %ls]",
+                i > 0 ? L" |" : L"",
+                entry->hour,
+                entry->minute,
+                entry->name[0] != L'\0' ? L" " : L"",
+                entry->name,
+                entry->repeatDaily ? L" [REPEAT]" : L"",
+                GetRampName(entry->rampSpeed)
+            );
+            if (written < 0) {
+                break;
+            }
+            length += written;
+        }
+    }
+    
+    // Only a change of text reaches the frame
+    WORD normalAttribute = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+    SetWidgetText(WIDGET_STATUS, statusText, normalAttribute, alarmAttribute);
+}
+
+// Show a prompt on the prompt row and park the cursor after it for input
+static void ShowPromptText(_In_z_ const wchar_t* text) {
+    WORD normalAttribute = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+    const LayoutRect* row = &g_layout.prompt;
+    
+    SetWidgetText(WIDGET_PROMPT, text, normalAttribute, normalAttribute);
+    InvalidateFrameRect(row->x, row->y, row->width, row->height);
+    FlushFrame();
+    SetCursorPosition((SHORT)wcslen(text), row->y);
+}
+
+// Clear the prompt row, including any echoed input. The status line comes
+// back by itself if the prompt was covering it.
+static void ClearPromptRow(void) {
+    const LayoutRect* row = &g_layout.prompt;
+    
+    HideWidget(WIDGET_PROMPT);
+    InvalidateFrameRect(row->x, row->y, row->width, row->height);
+    FlushFrame();
+}
+
+// Interactive prompt for alarm settings
+static void PromptForAlarm(void) {
+    if (!g_hasConsoleInput || !g_frame.cells) {
+        return;
+    }
+    
+    // The prompt reads the console itself until it is done
+    PauseInputReader();
+    
+    // Show cursor for input
+    HideCursor(FALSE);
+    
+    // Clear ONLY the bottom line and move cursor there
+    // This will not affect anything above
+    ShowPromptText(L"Enter alarm time (HH:MM): ");
+    
+    // Read time input
+    wchar_t timeInput[32] = L"";
+    DWORD charsRead = 0;
+    if (ReadPromptInput(timeInput, 31, &charsRead) && charsRead > 1) {
+        // Clear the prompt line immediately after reading
+        ClearPromptRow();
+        
+        // Remove newline
+        if (charsRead > 0 && timeInput[charsRead - 1] == L'\n') {
+            timeInput[charsRead - 1] = L'\0';
+            charsRead--;
+        }
+        if (charsRead > 0 && timeInput[charsRead - 1] == L'\r') {
+            timeInput[charsRead - 1] = L'\0';
+            charsRead--;
         }
         
         // Parse time
         int hour = 0, minute = 0;
         if (swscanf_s(timeInput, L"%d:%d", &hour, &minute) == 2) {
             if (hour >= 0 && hour <= 23 && minute >= 0 && minute <= 59) {
-                g_alarmState.hour = (WORD)hour;
-                g_alarmState.minute = (WORD)minute;
+                BOOL repeatDaily = FALSE;
+                AlarmRampSpeed rampSpeed = ALARM_RAMP_MODERATE;
                 
                 // Prompt for repeat
-                SetCursorPosition(0, bottomRow);
-                wprintf(L"Repeat daily? (Y/N): ");
-                fflush(stdout);
+                ShowPromptText(L"Repeat daily? (Y/N): ");
                 
                 wchar_t repeatInput[8] = L"";
                 charsRead = 0;
-                if (ReadConsoleW(g_hInput, repeatInput, 7, &charsRead, NULL) && charsRead > 0) {
+                if (ReadPromptInput(repeatInput, 7, &charsRead) && charsRead > 0) {
                     // Clear the prompt line immediately after reading
-                    FillConsoleOutputCharacterW(
-                        g_hConsole, L' ', csbi.dwSize.X, coord, &cCharsWritten
-                    );
-                    FillConsoleOutputAttribute(
-                        g_hConsole, normalAttribute, csbi.dwSize.X, coord, &cCharsWritten
-                    );
+                    ClearPromptRow();
                     
                     wchar_t firstChar = towupper(repeatInput[0]);
-                    g_alarmState.repeatDaily = (firstChar == L'Y');
+                    repeatDaily = (firstChar == L'Y');
+                }
+                
+                // Prompt for ramp speed
+                ShowPromptText(L"Ramp speed (fast/moderate/slow) [moderate]: ");
+                
+                wchar_t rampInput[16] = L"";
+                charsRead = 0;
+                if (ReadPromptInput(rampInput, 15, &charsRead) && charsRead > 1) {
+                    // Clear the prompt line immediately after reading
+                    ClearPromptRow();
+                    
+                    // Remove newline
+                    if (charsRead > 0 && rampInput[charsRead - 1] == L'\n') {
+                        rampInput[charsRead - 1] = L'\0';
+                    }
+                    
+                    // Convert to lowercase for comparison
+                    for (int i = 0; rampInput[i] != L'\0'; i++) {
+                        rampInput[i] = towlower(rampInput[i]);
+                    }
+                    
+                    if (wcsncmp(rampInput, L"fast", 4) == 0) {
+                        rampSpeed = ALARM_RAMP_FAST;
+                    } else if (wcsncmp(rampInput, L"slow", 4) == 0) {
+                        rampSpeed = ALARM_RAMP_SLOW;
+                    }
+                } else {
+                    // Clear the prompt line if no input
+                    ClearPromptRow();
+                }
+                
+                // Prompt for an optional label
+                ShowPromptText(L"Label (optional): ");
+                
+                wchar_t nameInput[ALARM_NAME_LENGTH] = L"";
+                charsRead = 0;
+                if (ReadPromptInput(nameInput, ALARM_NAME_LENGTH - 1, &charsRead)) {
+                    nameInput[charsRead] = L'\0';
+                    while (charsRead > 0 && 
+                           (nameInput[charsRead - 1] == L'\n' || nameInput[charsRead - 1] == L'\r')) {
+                        nameInput[--charsRead] = L'\0';
+                    }
+                } else {
+                    nameInput[0] = L'\0';
+                }
+                ClearPromptRow();
+                
+                AddAlarm((WORD)hour, (WORD)minute, repeatDaily, rampSpeed, nameInput);
+            }
+        }
+    } else {
+        // Clear the prompt line if read failed
+        ClearPromptRow();
+    }
+    
+    // Hide cursor again
+    HideCursor(TRUE);
+    ResumeInputReader();
+    
+    // Update alarm status display
+    PrintAlarmStatusLine();
+    FlushFrame();
+}
+
+// Handle an Alt+key hotkey from either console or terminal input
+static void HandleHotkey(_In_ wchar_t key) {
+    // A viewer has no alarms or overlay of its own; the server owns them
+    if (g_viewPath) {
+        return;
+    }
+
+    key = (wchar_t)towupper(key);
+
+    // Check for Alt+A (set alarm); not timed, it waits on the user
+    if (key == L'A') {
+        PromptForAlarm();
+        return;
+    }
+    
+    StatsMarkInput();
+    
+    // Check for Alt+I (toggle the instrumentation overlay)
+    if (key == L'I') {
+        g_statsOverlay = !g_statsOverlay;
+        if (!g_statsOverlay) {
+            ClearStatsOverlay();
+        }
+        return;
+    }
+    
+    // Check for Alt+X (abort alarm); daily alarms were already rescheduled
+    // when they fired, one-shot alarms were removed
+    if (key == L'X') {
+        if (g_alarmState.isRinging) {
+            g_alarmState.isRinging = FALSE;
+            PostAudioCommand(AUDIO_CMD_STOP);
+            PrintAlarmStatusLine();
+        }
+        return;
+    }
+    
+    // Check for Alt+C (cancel the next upcoming alarm)
+    if (key == L'C') {
+        CancelNextAlarm();
+        PrintAlarmStatusLine();
+        return;
+    }
+    
+    // Alt+S, Alt+L and Alt+R drive /stopwatch and /countdown; the main loop
+    // draws the result
+    if (g_timer.mode != TIMER_OFF) {
+        HandleTimerHotkey(key);
+    }
+}
+
+// Milliseconds until something on screen needs attention: the next minute
+// boundary, just before the next second in seconds mode, the next
+// centisecond while a timer runs, or the next flash of a ringing alarm. Alarm tones are
+// timed by the audio worker, not the main loop.
+static DWORD GetNextWakeDelayMs(void) {
+    DWORD delayMs;
+    
+    if (g_power.suspended) {
+        // Alarms fire on minute boundaries; a countdown may end sooner
+        delayMs = GetMinuteWakeDelayMs();
+        if (g_timer.running && g_timer.mode == TIMER_COUNTDOWN) {
+            long long remainingCs = g_timer.countdownCs - TimerTicksToCentiseconds(GetTimerElapsed());
+            DWORD countdownMs = remainingCs > 0 ? (DWORD)(remainingCs * 10) : 0;
+            if (countdownMs < delayMs) {
+                delayMs = countdownMs;
+            }
+        }
+        // Nothing reports an unlock, or a running job moved to the foreground
+        if (delayMs > POWER_POLL_MS) {
+            delayMs = POWER_POLL_MS;
+        }
+        return delayMs;
+    }
+    
+    if (g_timer.running) {
+        // Next centisecond of elapsed time, rounded up to whole milliseconds
+        long long elapsedUs = GetTimerElapsed() * 1000000 / g_renderStats.frequency.QuadPart;
+        delayMs = (DWORD)((TIMER_TICK_US - elapsedUs % TIMER_TICK_US + 999) / 1000);
+    } else if (g_showSeconds) {
+        // Wake a little early; WaitForSecondBoundary spins the rest of the
+        // way. Rounded up, so a zero delay always leaves us inside the lead
+        // and the pass spins instead of looping back here.
+        DWORD untilUs = 1000000 - GetWallClockMicroseconds();
+        DWORD leadUs = SECONDS_WAKE_LEAD_MS * 1000;
+        delayMs = untilUs > leadUs ? (untilUs - leadUs + 999) / 1000 : 0;
+    } else {
+        delayMs = GetMinuteWakeDelayMs();
+    }
+    
+    // A themed clock also wakes to flash while an alarm rings
+    DWORD flashMs = GetAlarmFlashDelayMs();
+    return flashMs < delayMs ? flashMs : delayMs;
+}
+
+// Sleep until the next pass is due; a replay runs its passes back to back
+static void WaitForNextPass(void) {
+    DWORD delayMs = GetNextWakeDelayMs();
+    if (g_capture.mode != CAPTURE_REPLAY) {
+        WaitForNextEvent(delayMs);
+    }
+}
+
+// Milliseconds to just past the next minute boundary, so GetLocalTime
+// reports the new minute
+static DWORD GetMinuteWakeDelayMs(void) {
+    SYSTEMTIME now;
+    GetLocalTime(&now);
+    return (DWORD)(59 - now.wSecond) * 1000 + (DWORD)(1000 - now.wMilliseconds) + 1;
+}
+
+// Suspend drawing while the display is hidden, or resume it with a full
+// repaint once it is visible again. A /serve viewer counts as someone
+// watching. Returns TRUE while drawing is suspended.
+static BOOL UpdateDisplayPower(void) {
+    const wchar_t* reason = g_capture.mode == CAPTURE_REPLAY ? NULL : GetDisplayHiddenReason();
+    
+    if (reason && g_broadcast.running) {
+        EnterCriticalSection(&g_broadcast.lock);
+        if (g_broadcast.viewerCount > 0) {
+            reason = NULL;
+        }
+        LeaveCriticalSection(&g_broadcast.lock);
+    }
+    
+    // A replay is hidden exactly when the recording was
+    if (CaptureInteger(CAPTURE_HIDDEN, reason != NULL) && !reason) {
+        reason = L"hidden when recorded";
+    }
+    
+    if (reason && !g_power.suspended) {
+        g_power.suspended = TRUE;
+        g_power.reason = reason;
+        g_power.suspensions++;
+        g_power.suspendedSince = StatsNow();
+    } else if (!reason && g_power.suspended) {
+        g_power.suspended = FALSE;
+        g_power.suspendedUs += (unsigned long long)(
+            (StatsNow() - g_power.suspendedSince) * 1000000 / g_renderStats.frequency.QuadPart
+        );
+        g_power.resumePending = TRUE;
+    }
+    
+    return g_power.suspended;
+}
+
+// Prepare the seconds display: counter frequency and, on Windows, a 1 ms
+// timer period so waits end close enough to the boundary to spin the rest
+static void BeginSecondTicker(void) {
+    QueryPerformanceFrequency(&g_secondTicker.frequency);
+    g_secondTicker.shownSecond = 0xFFFF;
+#ifdef _WIN32
+    timeBeginPeriod(1);
+#endif
+}
+
+// Restore the timer period and report how close to each boundary we painted
+static void EndSecondTicker(void) {
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+    
+    if (g_secondTicker.ticks > 0) {
+        fwprintf(
+            stderr,
+            L"Seconds display: %lu ticks, boundary-to-paint latency %lu us average, %lu us max\n",
+            g_secondTicker.ticks,
+            (DWORD)(g_secondTicker.latencySumUs / g_secondTicker.ticks),
+            g_secondTicker.latencyMaxUs
+        );
+    }
+}
+
+// Called before composing a frame in seconds mode. Near a boundary, spin
+// until the wall clock rolls over; after one we have not painted yet (a
+// late wake), note when it passed. Either way the next flush is timed
+// against that boundary. Mid-second wakes (input) are not ticks.
+static void WaitForSecondBoundary(void) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    DWORD intoSecondUs = GetWallClockMicroseconds();
+    long long frequency = g_secondTicker.frequency.QuadPart;
+    
+    SYSTEMTIME st;
+    GetLocalTime(&st);
+    
+    if (1000000 - intoSecondUs <= SECONDS_WAKE_LEAD_MS * 1000) {
+        long long boundary = now.QuadPart + 
+                             (long long)(1000000 - intoSecondUs) * frequency / 1000000;
+        long long limit = boundary + (long long)SECONDS_SPIN_LIMIT_MS * frequency / 1000;
+        WORD startSecond = st.wSecond;
+        
+        // The local time can trail the precise clock by a timer tick, so
+        // spin until it actually shows the new second
+        do {
+            SpinYield();
+            QueryPerformanceCounter(&now);
+            GetLocalTime(&st);
+        } while (st.wSecond == startSecond && now.QuadPart < limit);
+        
+        g_secondTicker.boundary = boundary;
+    } else if (st.wSecond != g_secondTicker.shownSecond && g_secondTicker.shownSecond != 0xFFFF) {
+        g_secondTicker.boundary = now.QuadPart - (long long)intoSecondUs * frequency / 1000000;
+    }
+}
+
+// Fold the latency of the frame just flushed into the tick statistics
+static void RecordSecondLatency(void) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    
+    long long elapsed = now.QuadPart - g_secondTicker.boundary;
+    g_secondTicker.boundary = 0;
+    if (elapsed < 0) {
+        elapsed = 0;
+    }
+    
+    DWORD latencyUs = (DWORD)(elapsed * 1000000 / g_secondTicker.frequency.QuadPart);
+    g_lastFrameStats.paintLatencyUs = latencyUs > 0 ? latencyUs : 1;
+    g_secondTicker.ticks++;
+    g_secondTicker.latencySumUs += latencyUs;
+    if (latencyUs > g_secondTicker.latencyMaxUs) {
+        g_secondTicker.latencyMaxUs = latencyUs;
+    }
+}
+
+// Parse a /countdown length: seconds, M:SS or H:MM:SS
+static BOOL ParseTimerDuration(_In_z_ const wchar_t* text, _Out_ long long* centiseconds) {
+    long long seconds = 0;
+    int fields = 0;
+    const wchar_t* p = text;
+    
+    *centiseconds = 0;
+    while (*p) {
+        long value = 0;
+        int digits = 0;
+        while (*p >= L'0' && *p <= L'9' && digits < 6) {
+            value = value * 10 + (*p++ - L'0');
+            digits++;
+        }
+        if (digits == 0 || (fields > 0 && value > 59) || ++fields > 3) {
+            return FALSE;
+        }
+        seconds = seconds * 60 + value;
+        if (*p == L':') {
+            p++;
+            if (!*p) {
+                return FALSE;
+            }
+        } else if (*p) {
+            return FALSE;
+        }
+    }
+    
+    if (fields == 0 || seconds == 0 || seconds * 100 > TIMER_MAX_CS) {
+        return FALSE;
+    }
+    *centiseconds = seconds * 100;
+    return TRUE;
+}
+
+// Counter ticks the timer has run, including the current run
+static long long GetTimerElapsed(void) {
+    long long elapsed = g_timer.accumulated;
+    if (g_timer.running) {
+        elapsed += ReadCounter() - g_timer.startCount;
+    }
+    return elapsed;
+}
+
+static long long TimerTicksToCentiseconds(_In_ long long ticks) {
+    return ticks * 100 / g_renderStats.frequency.QuadPart;
+}
+
+// Glyphs for HH:MM:SS.cc, clamped to 99:59:59.99
+static void ComposeTimerGlyphs(_In_ long long centiseconds, _Out_writes_(TIMER_SLOTS) GlyphId* glyphs) {
+    if (centiseconds < 0) {
+        centiseconds = 0;
+    }
+    if (centiseconds > TIMER_MAX_CS) {
+        centiseconds = TIMER_MAX_CS;
+    }
+    
+    int hundredths = (int)(centiseconds % 100);
+    long long seconds = centiseconds / 100;
+    int hours = (int)(seconds / 3600);
+    int minutes = (int)(seconds / 60 % 60);
+    int secs = (int)(seconds % 60);
+    
+    glyphs[0] = GetAsciiDigit(hours / 10);
+    glyphs[1] = GetAsciiDigit(hours % 10);
+    glyphs[2] = GLYPH_COLON;
+    glyphs[3] = GetAsciiDigit(minutes / 10);
+    glyphs[4] = GetAsciiDigit(minutes % 10);
+    glyphs[5] = GLYPH_COLON;
+    glyphs[6] = GetAsciiDigit(secs / 10);
+    glyphs[7] = GetAsciiDigit(secs % 10);
+    glyphs[8] = GLYPH_DOT;
+    glyphs[9] = GetAsciiDigit(hundredths / 10);
+    glyphs[10] = GetAsciiDigit(hundredths % 10);
+}
+
+// Draw one timer line, blitting only the slots whose glyph changed
+static void DrawTimerLine(
+    _In_ SHORT startX,
+    _In_ SHORT startY,
+    _In_ long long centiseconds,
+    _In_ BOOL forceRedraw,
+    _Inout_ GlyphId* shown
+) {
+    GlyphId glyphs[TIMER_SLOTS];
+    ComposeTimerGlyphs(centiseconds, glyphs);
+    
+    for (int slot = 0; slot < TIMER_SLOTS; slot++) {
+        if (forceRedraw || glyphs[slot] != shown[slot]) {
+            UpdateCharPosition((SHORT)(startX + slot * g_layout.glyphSpacing), startY, glyphs[slot]);
+            shown[slot] = glyphs[slot];
+        }
+    }
+}
+
+// Stop a countdown that has reached zero and ring it like an alarm (Alt+X
+// silences it). Runs every pass, drawn or not.
+static void CheckTimerExpiry(void) {
+    if (g_timer.mode != TIMER_COUNTDOWN || !g_timer.running) {
+        return;
+    }
+    
+    long long elapsed = GetTimerElapsed();
+    if (TimerTicksToCentiseconds(elapsed) < g_timer.countdownCs) {
+        return;
+    }
+    
+    AlarmEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.rampSpeed = ALARM_RAMP_MODERATE;
+    wcscpy_s(entry.name, ALARM_NAME_LENGTH, L"Countdown");
+    
+    g_timer.accumulated = elapsed;
+    g_timer.running = FALSE;
+    g_timer.expired = TRUE;
+    TriggerAlarm(&entry);
+}
+
+// Draw the stopwatch or countdown: the running total on the time line and
+// the last completed lap on the date line
+static void PrintTimer(_In_ BOOL forceRedraw) {
+    long long composeStart = StatsNow();
+    long long elapsedCs = TimerTicksToCentiseconds(GetTimerElapsed());
+    long long totalCs = elapsedCs;
+    
+    if (g_timer.mode == TIMER_COUNTDOWN) {
+        totalCs = g_timer.countdownCs - elapsedCs;
+    }
+    
+    // A new centisecond is a frame; any between it and the last one shown
+    // were skipped because the loop woke late
+    if (elapsedCs != g_timer.shownCs) {
+        if (g_timer.running) {
+            g_timer.frames++;
+            if (g_timer.shownCs >= 0 && elapsedCs > g_timer.shownCs + 1) {
+                g_timer.skippedTicks += (DWORD)(elapsedCs - g_timer.shownCs - 1);
+            }
+        }
+        g_timer.shownCs = elapsedCs;
+    }
+    
+    long long lapCs = g_timer.lapCount > 0 ? g_timer.laps[(g_timer.lapCount - 1) % TIMER_LAP_MAX] : 0;
+    DrawTimerLine(g_layout.time.x, g_layout.time.y, totalCs, forceRedraw, g_timer.totalGlyphs);
+    DrawTimerLine(g_layout.date.x, g_layout.date.y, lapCs, forceRedraw, g_timer.lapGlyphs);
+    
+    StatsRecordSince(&g_renderStats.timeCompose, composeStart);
+}
+
+// Microseconds left in a running timer's frame budget since frameStart
+static long GetTimerBudgetLeftUs(_In_ long long frameStart) {
+    long long elapsedUs = (StatsNow() - frameStart) * 1000000 / g_renderStats.frequency.QuadPart;
+    return (long)(TIMER_FRAME_BUDGET_US - elapsedUs);
+}
+
+// Alt+S start/stop, Alt+L lap, Alt+R reset. Returns FALSE for other keys.
+static BOOL HandleTimerHotkey(_In_ wchar_t key) {
+    long long now = ReadCounter();
+    
+    if (key == L'S') {
+        if (g_timer.running) {
+            g_timer.accumulated += now - g_timer.startCount;
+            g_timer.running = FALSE;
+        } else if (!g_timer.expired) {
+            g_timer.startCount = now;
+            g_timer.running = TRUE;
+        }
+        return TRUE;
+    }
+    
+    if (key == L'L') {
+        long long elapsed = GetTimerElapsed();
+        long long lapCs = TimerTicksToCentiseconds(elapsed) - TimerTicksToCentiseconds(g_timer.lapStart);
+        if (lapCs > 0) {
+            // Past TIMER_LAP_MAX the oldest laps are overwritten
+            g_timer.laps[g_timer.lapCount % TIMER_LAP_MAX] = lapCs;
+            g_timer.lapCount++;
+            g_timer.lapStart = elapsed;
+        }
+        return TRUE;
+    }
+    
+    if (key == L'R') {
+        g_timer.running = FALSE;
+        g_timer.expired = FALSE;
+        g_timer.accumulated = 0;
+        g_timer.lapStart = 0;
+        g_timer.lapCount = 0;
+        g_timer.shownCs = -1;
+        return TRUE;
+    }
+    
+    return FALSE;
+}
+
+// Prepare /stopwatch or /countdown: a 1 ms timer period on Windows so the
+// 10 ms waits are not rounded up to the 15.6 ms default tick
+static void BeginTimerMode(void) {
+    g_timer.shownCs = -1;
+#ifdef _WIN32
+    timeBeginPeriod(1);
+#endif
+}
+
+// Restore the timer period and report frame pacing and the laps taken
+static void EndTimerMode(void) {
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+    
+    fwprintf(
+        stderr,
+        L"%ls: %lu frames, %lu centiseconds skipped, %lu frames over the %d us budget\n",
+        g_timer.mode == TIMER_COUNTDOWN ? L"Countdown" : L"Stopwatch",
+        g_timer.frames,
+        g_timer.skippedTicks,
+        g_timer.overBudget,
+        TIMER_FRAME_BUDGET_US
+    );
+    
+    int first = g_timer.lapCount > TIMER_LAP_MAX ? g_timer.lapCount - TIMER_LAP_MAX : 0;
+    for (int lap = first; lap < g_timer.lapCount; lap++) {
+        long long cs = g_timer.laps[lap % TIMER_LAP_MAX];
+        fwprintf(
+            stderr,
+            L"Lap %d: %02lld:%02lld:%02lld.%02lld\n",
+            lap + 1,
+            cs / 360000,
+            cs / 6000 % 60,
+            cs / 100 % 60,
+            cs % 100
+        );
+    }
+}
+
+// Start the run-wide counters; the counter frequency never changes
+static void InitRenderStats(void) {
+    QueryPerformanceFrequency(&g_renderStats.frequency);
+    g_renderStats.frameTime.minUs = 0xFFFFFFFF;
+    g_renderStats.timeCompose.minUs = 0xFFFFFFFF;
+    g_renderStats.dateCompose.minUs = 0xFFFFFFFF;
+    g_renderStats.inputToPaint.minUs = 0xFFFFFFFF;
+}
+
+static long long StatsNow(void) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+// Add the time since start to a histogram
+static void StatsRecordSince(_Inout_ StatsHistogram* histogram, _In_ long long start) {
+    if (g_renderStats.frequency.QuadPart == 0) {
+        return;
+    }
+    
+    long long elapsed = StatsNow() - start;
+    DWORD elapsedUs = elapsed > 0 ? 
+        (DWORD)(elapsed * 1000000 / g_renderStats.frequency.QuadPart) : 0;
+    
+    int bucket = 0;
+    while (bucket < STATS_HISTOGRAM_BUCKETS - 1 && (elapsedUs >> (bucket + 1)) != 0) {
+        bucket++;
+    }
+    
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->sumUs += elapsedUs;
+    if (elapsedUs < histogram->minUs) {
+        histogram->minUs = elapsedUs;
+    }
+    if (elapsedUs > histogram->maxUs) {
+        histogram->maxUs = elapsedUs;
+    }
+}
+
+// Upper bound of the bucket holding the given percentile, capped at the max
+static DWORD StatsPercentileUs(_In_ const StatsHistogram* histogram, _In_ DWORD percent) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+    
+    unsigned long long rank = ((unsigned long long)histogram->count * percent + 99) / 100;
+    unsigned long long seen = 0;
+    for (int bucket = 0; bucket < STATS_HISTOGRAM_BUCKETS; bucket++) {
+        seen += histogram->buckets[bucket];
+        if (seen >= rank) {
+            DWORD upperUs = (DWORD)((2UL << bucket) - 1);
+            return upperUs < histogram->maxUs ? upperUs : histogram->maxUs;
+        }
+    }
+    return histogram->maxUs;
+}
+
+// Note an input that should show up on screen; timed until the next flush
+static void StatsMarkInput(void) {
+    g_renderStats.inputEvents++;
+    if (g_renderStats.inputPending == 0) {
+        g_renderStats.inputPending = 
+            g_renderStats.inputArrival ? g_renderStats.inputArrival : StatsNow();
+    }
+}
+
+static void StatsInputPainted(void) {
+    if (g_renderStats.inputPending != 0) {
+        StatsRecordSince(&g_renderStats.inputToPaint, g_renderStats.inputPending);
+        g_renderStats.inputPending = 0;
+    }
+}
+
+// Draw the Alt+I overlay on the rows below the alarm status line
+static void DrawStatsOverlay(void) {
+    const LayoutRect* overlay = &g_layout.overlay;
+    WORD overlayAttribute = FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY;
+    const RenderStats* stats = &g_renderStats;
+    wchar_t lines[STATS_OVERLAY_ROWS][160];
+    
+    swprintf(
+        lines[0],
+        160,
+        L"Frames %lu drawn, %lu skipped | wakeups %lu, inputs %lu | "
+        L"console calls %llu | cells %llu, bytes %llu",
+        stats->framesRendered,
+        stats->framesSkipped,
+        stats->loopWakeups,
+        stats->inputEvents,
+        stats->consoleCalls,
+        stats->cellsWritten,
+        stats->bytesWritten
+    );
+    swprintf(
+        lines[1],
+        160,
+        L"Frame us p50 %lu p99 %lu max %lu | time us p50 %lu | date us p50 %lu | "
+        L"glyph blits %lu",
+        StatsPercentileUs(&stats->frameTime, 50),
+        StatsPercentileUs(&stats->frameTime, 99),
+        stats->frameTime.maxUs,
+        StatsPercentileUs(&stats->timeCompose, 50),
+        StatsPercentileUs(&stats->dateCompose, 50),
+        stats->glyphBlits
+    );
+    swprintf(
+        lines[2],
+        160,
+        L"Input-to-paint us p50 %lu p99 %lu max %lu (%lu samples) | Alt+I to hide",
+        StatsPercentileUs(&stats->inputToPaint, 50),
+        StatsPercentileUs(&stats->inputToPaint, 99),
+        stats->inputToPaint.maxUs,
+        stats->inputToPaint.count
+    );
+    
+    // These are measurements of this run; a replay shows the recorded ones
+    for (int i = 0; i < STATS_OVERLAY_ROWS; i++) {
+        size_t length = wcslen(lines[i]);
+        CaptureText(lines[i], sizeof(lines[i]) / sizeof(lines[i][0]), &length, TRUE);
+    }
+    
+    for (SHORT i = 0; i < overlay->height; i++) {
+        SHORT row = (SHORT)(overlay->y + i);
+        FrameFillRect(overlay->x, row, overlay->width, 1, L' ', overlayAttribute);
+        FrameWriteText(overlay->x, row, lines[i], overlayAttribute);
+    }
+}
+
+static void ClearStatsOverlay(void) {
+    const LayoutRect* overlay = &g_layout.overlay;
+    WORD normalAttribute = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+    
+    FrameFillRect(overlay->x, overlay->y, overlay->width, overlay->height, L' ', normalAttribute);
+}
+
+static void WriteStatsHistogram(
+    _In_ FILE* file,
+    _In_z_ const wchar_t* label,
+    _In_ const StatsHistogram* histogram
+) {
+    if (histogram->count == 0) {
+        fwprintf(file, L"%ls: no samples\n", label);
+        return;
+    }
+    
+    fwprintf(
+        file,
+        L"%ls: %lu samples, avg %llu us, min %lu us, p50 %lu us, p90 %lu us, "
+        L"p99 %lu us, max %lu us\n",
+        label,
+        histogram->count,
+        histogram->sumUs / histogram->count,
+        histogram->minUs,
+        StatsPercentileUs(histogram, 50),
+        StatsPercentileUs(histogram, 90),
+        StatsPercentileUs(histogram, 99),
+        histogram->maxUs
+    );
+    for (int bucket = 0; bucket < STATS_HISTOGRAM_BUCKETS; bucket++) {
+        if (histogram->buckets[bucket] != 0) {
+            fwprintf(
+                file,
+                L"  < %8lu us: %lu\n",
+                (unsigned long)(2UL << bucket),
+                histogram->buckets[bucket]
+            );
+        }
+    }
+}
+
+// Write the run's counters and histograms to the /stats file
+static void DumpRenderStats(void) {
+    if (!g_statsPath) {
+        return;
+    }
+    
+    FILE* file = NULL;
+    if (_wfopen_s(&file, g_statsPath, L"w") != 0 || !file) {
+        fwprintf(stderr, L"Warning: Could not write stats file %ls\n", g_statsPath);
+        return;
+    }
+    
+    const RenderStats* stats = &g_renderStats;
+    fwprintf(file, L"backend: %ls\n", g_backend->name);
+    fwprintf(file, L"frames rendered: %lu\n", stats->framesRendered);
+    fwprintf(file, L"frames skipped: %lu\n", stats->framesSkipped);
+    fwprintf(file, L"loop wakeups: %lu\n", stats->loopWakeups);
+    fwprintf(file, L"input events: %lu\n", stats->inputEvents);
+    fwprintf(file, L"input queue high water: %lu\n", g_input.highWater);
+    fwprintf(file, L"input queue stalls: %lu\n", g_input.stalls);
+    fwprintf(file, L"console calls: %llu\n", stats->consoleCalls);
+    fwprintf(file, L"cells written: %llu\n", stats->cellsWritten);
+    fwprintf(file, L"bytes written: %llu\n", stats->bytesWritten);
+    fwprintf(file, L"glyph blits: %lu\n", stats->glyphBlits);
+    fwprintf(file, L"widget paints: %lu\n", stats->widgetPaints);
+    fwprintf(file, L"zone lookups: %lu\n", stats->zoneLookups);
+    if (stats->fontSource) {
+        fwprintf(file, L"font load: %ls in %lu us\n", stats->fontSource, stats->fontLoadUs);
+    }
+    if (g_power.suspensions > 0) {
+        unsigned long long suspendedUs = g_power.suspendedUs;
+        if (g_power.suspended) {
+            suspendedUs += (unsigned long long)(
+                (StatsNow() - g_power.suspendedSince) * 1000000 / stats->frequency.QuadPart
+            );
+        }
+        fwprintf(file, L"display suspensions: %lu (last: %ls)\n", g_power.suspensions, g_power.reason);
+        fwprintf(file, L"display suspended: %llu ms\n", suspendedUs / 1000);
+    }
+    if (g_timer.mode != TIMER_OFF) {
+        fwprintf(file, L"timer frames: %lu\n", g_timer.frames);
+        fwprintf(file, L"timer centiseconds skipped: %lu\n", g_timer.skippedTicks);
+        fwprintf(file, L"timer frames over budget: %lu\n", g_timer.overBudget);
+    }
+    WriteStatsHistogram(file, L"frame time", &stats->frameTime);
+    WriteStatsHistogram(file, L"PrintTimeAscii", &stats->timeCompose);
+    WriteStatsHistogram(file, L"PrintDateAscii", &stats->dateCompose);
+    WriteStatsHistogram(file, L"input-to-paint", &stats->inputToPaint);
+    
+    fclose(file);
+}
+
+// Fire every alarm whose time has come. Only the heap head is examined, so
+// this is cheap enough to run on every pass of the main loop.
+static void CheckAlarmTime(_In_ const SYSTEMTIME* st) {
+    long long now = GetLocalMinuteStamp(st);
+    
+    while (g_alarms.count > 0 && g_alarms.heap[0]->nextFire <= now) {
+        AlarmEntry* entry = g_alarms.heap[0];
+        TriggerAlarm(entry);
+        if (g_soak.running) {
+            SoakRecordFire(entry, now);
+        }
+        
+        if (entry->repeatDaily) {
+            // Skip any days missed while the machine was asleep
+            do {
+                entry->nextFire += MINUTES_PER_DAY;
+            } while (entry->nextFire <= now);
+            AlarmHeapSiftDown(0);
+            JournalRecordAlarm(JOURNAL_RECORD_FIRED, entry);
+        } else {
+            RemoveAlarm(entry);
+        }
+    }
+}
+
+// Trigger the alarm, or hand an already ringing alarm over to this entry
+static void TriggerAlarm(_In_ const AlarmEntry* entry) {
+    wcscpy_s(g_alarmState.name, ALARM_NAME_LENGTH, entry->name);
+    
+    if (g_alarmState.isRinging) {
+        if (g_alarmState.rampSpeed != entry->rampSpeed) {
+            g_alarmState.rampSpeed = entry->rampSpeed;
+            PostAudioCommand(AUDIO_CMD_SET_RAMP);
+        }
+    } else {
+        g_alarmState.isRinging = TRUE;
+        g_alarmState.rampSpeed = entry->rampSpeed;
+        g_alarmState.ringStartTime = ReadTickCount();
+        PostAudioCommand(AUDIO_CMD_START_RAMP);
+    }
+    PrintAlarmStatusLine();
+}
+
+// Local wall-clock time as minutes since 1970-01-01, the scheduler's key
+static long long GetLocalMinuteStamp(_In_ const SYSTEMTIME* st) {
+    // Days from civil date, shifting the year to start in March
+    long long year = (long long)st->wYear - (st->wMonth <= 2 ? 1 : 0);
+    long long era = (year >= 0 ? year : year - 399) / 400;
+    long long yearOfEra = year - era * 400;
+    long long monthIndex = (st->wMonth + 9) % 12;
+    long long dayOfYear = (153 * monthIndex + 2) / 5 + st->wDay - 1;
+    long long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    long long days = era * 146097 + dayOfEra - 719468;
+    
+    return days * MINUTES_PER_DAY + st->wHour * 60 + st->wMinute;
+}
+
+// Heap order: earliest fire time first, oldest alarm first on ties
+static BOOL AlarmFiresBefore(_In_ const AlarmEntry* a, _In_ const AlarmEntry* b) {
+    if (a->nextFire != b->nextFire) {
+        return a->nextFire < b->nextFire;
+    }
+    return a->id < b->id;
+}
+
+static void AlarmHeapSwap(_In_ int i, _In_ int j) {
+    AlarmEntry* entry = g_alarms.heap[i];
+    g_alarms.heap[i] = g_alarms.heap[j];
+    g_alarms.heap[j] = entry;
+    g_alarms.heap[i]->heapIndex = i;
+    g_alarms.heap[j]->heapIndex = j;
+}
+
+static void AlarmHeapSiftUp(_In_ int index) {
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (!AlarmFiresBefore(g_alarms.heap[index], g_alarms.heap[parent])) {
+            break;
+        }
+        AlarmHeapSwap(index, parent);
+        index = parent;
+    }
+}
+
+static void AlarmHeapSiftDown(_In_ int index) {
+    for (;;) {
+        int smallest = index;
+        int left = index * 2 + 1;
+        int right = left + 1;
+        
+        if (left < g_alarms.count && 
+            AlarmFiresBefore(g_alarms.heap[left], g_alarms.heap[smallest])) {
+            smallest = left;
+        }
+        if (right < g_alarms.count && 
+            AlarmFiresBefore(g_alarms.heap[right], g_alarms.heap[smallest])) {
+            smallest = right;
+        }
+        if (smallest == index) {
+            break;
+        }
+        AlarmHeapSwap(index, smallest);
+        index = smallest;
+    }
+}
+
+// First slot to probe for an id (Knuth's multiplicative hash)
+static int AlarmIdSlot(_In_ DWORD id, _In_ int capacity) {
+    return (int)((uint32_t)(id * 2654435761UL) & (uint32_t)(capacity - 1));
+}
+
+static BOOL AlarmIdSetFind(_In_ const AlarmIdSet* set, _In_ DWORD id) {
+    if (set->capacity == 0) {
+        return FALSE;
+    }
+    for (int slot = AlarmIdSlot(id, set->capacity); set->slots[slot] != 0;
+         slot = (slot + 1) & (set->capacity - 1)) {
+        if (set->slots[slot] == id) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// Add a nonzero id, growing the table so it stays at most half full
+static BOOL AlarmIdSetAdd(_Inout_ AlarmIdSet* set, _In_ DWORD id) {
+    if (AlarmIdSetFind(set, id)) {
+        return TRUE;
+    }
+    
+    if ((set->count + 1) * 2 > set->capacity) {
+        int capacity = set->capacity > 0 ? set->capacity * 2 : 32;
+        DWORD* slots = (DWORD*)calloc((size_t)capacity, sizeof(DWORD));
+        if (!slots) {
+            return FALSE;
+        }
+        for (int i = 0; i < set->capacity; i++) {
+            if (set->slots[i] != 0) {
+                int slot = AlarmIdSlot(set->slots[i], capacity);
+                while (slots[slot] != 0) {
+                    slot = (slot + 1) & (capacity - 1);
                 }
-                
-                // Prompt for ramp speed
-                SetCursorPosition(0, bottomRow);
-                wprintf(L"Ramp speed (fast/moderate/slow) [moderate]: ");
-                fflush(stdout);
-                
-                wchar_t rampInput[16] = L"";
-                charsRead = 0;
-                if (ReadConsoleW(g_hInput, rampInput, 15, &charsRead, NULL) && charsRead > 1) {
-                    // Clear the prompt line immediately after reading
-                    FillConsoleOutputCharacterW(
-                        g_hConsole, L' ', csbi.dwSize.X, coord, &cCharsWritten
-                    );
-                    FillConsoleOutputAttribute(
-                        g_hConsole, normalAttribute, csbi.dwSize.X, coord, &cCharsWritten
-                    );
-                    
-                    // Remove newline
-                    if (charsRead > 0 && rampInput[charsRead - 1] == L'\n') {
-                        rampInput[charsRead - 1] = L'\0';
-                    }
-                    
-                    // Convert to lowercase for comparison
-                    for (int i = 0; rampInput[i] != L'\0'; i++) {
-                        rampInput[i] = towlower(rampInput[i]);
+                slots[slot] = set->slots[i];
+            }
+        }
+        free(set->slots);
+        set->slots = slots;
+        set->capacity = capacity;
+    }
+    
+    int slot = AlarmIdSlot(id, set->capacity);
+    while (set->slots[slot] != 0) {
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    set->slots[slot] = id;
+    set->count++;
+    return TRUE;
+}
+
+static void AlarmIdSetFree(_Inout_ AlarmIdSet* set) {
+    free(set->slots);
+    set->slots = NULL;
+    set->capacity = 0;
+    set->count = 0;
+}
+
+// Schedule a new alarm and record it in the journal
+static AlarmEntry* AddAlarm(
+    _In_ WORD hour,
+    _In_ WORD minute,
+    _In_ BOOL repeatDaily,
+    _In_ AlarmRampSpeed rampSpeed,
+    _In_z_ const wchar_t* name
+) {
+    AlarmEntry* entry = InsertAlarm(g_alarms.nextId + 1, hour, minute, repeatDaily, rampSpeed, name);
+    if (entry) {
+        JournalRecordAlarm(JOURNAL_RECORD_ADD, entry);
+    }
+    return entry;
+}
+
+// Schedule an alarm given by /alarm or an alarm file. Its id is a hash of
+// the definition, so after a restart the copy restored from the journal is
+// recognised by id rather than added again. Identical entries hash on to
+// distinct ids, so each of them is kept.
+static void AddStartupAlarm(
+    _In_ WORD hour,
+    _In_ WORD minute,
+    _In_ BOOL repeatDaily,
+    _In_ AlarmRampSpeed rampSpeed,
+    _In_z_ const wchar_t* name
+) {
+    wchar_t storedName[ALARM_NAME_LENGTH];
+    wcsncpy_s(storedName, ALARM_NAME_LENGTH, name, _TRUNCATE);
+    
+    uint32_t fields[4] = { hour, minute, repeatDaily ? 1U : 0U, (uint32_t)rampSpeed };
+    uint64_t hash = Fnv1a64(fields, sizeof(fields), FNV1A64_OFFSET_BASIS);
+    hash = Fnv1a64(storedName, wcslen(storedName) * sizeof(wchar_t), hash);
+    
+    for (uint32_t copy = 0; ; copy++) {
+        uint64_t copyHash = Fnv1a64(&copy, sizeof(copy), hash);
+        DWORD id = (DWORD)(ALARM_ID_STARTUP | ((copyHash ^ (copyHash >> 32)) & 0x7FFFFFFFUL));
+        if (AlarmIdSetFind(&g_alarms.startupIds, id)) {
+            continue;
+        }
+        AlarmIdSetAdd(&g_alarms.startupIds, id);
+    
+        if (!AlarmIdSetFind(&g_alarms.restoredIds, id)) {
+            AlarmEntry* entry = InsertAlarm(id, hour, minute, repeatDaily, rampSpeed, storedName);
+            if (entry) {
+                JournalRecordAlarm(JOURNAL_RECORD_ADD, entry);
+            }
+        }
+        return;
+    }
+}
+
+// Put an alarm into the heap at its next occurrence (today if not yet passed)
+static AlarmEntry* InsertAlarm(
+    _In_ DWORD id,
+    _In_ WORD hour,
+    _In_ WORD minute,
+    _In_ BOOL repeatDaily,
+    _In_ AlarmRampSpeed rampSpeed,
+    _In_z_ const wchar_t* name
+) {
+    if (g_alarms.count == g_alarms.capacity) {
+        int capacity = g_alarms.capacity > 0 ? g_alarms.capacity * 2 : 16;
+        AlarmEntry** heap = (AlarmEntry**)realloc(
+            g_alarms.heap,
+            (size_t)capacity * sizeof(AlarmEntry*)
+        );
+        if (!heap) {
+            fwprintf(stderr, L"Warning: Could not allocate alarm\n");
+            return NULL;
+        }
+        g_alarms.heap = heap;
+        g_alarms.capacity = capacity;
+    }
+    
+    AlarmEntry* entry = (AlarmEntry*)calloc(1, sizeof(AlarmEntry));
+    if (!entry) {
+        fwprintf(stderr, L"Warning: Could not allocate alarm\n");
+        return NULL;
+    }
+    
+    SYSTEMTIME now;
+    ReadLocalTime(&now);
+    long long nowStamp = GetLocalMinuteStamp(&now);
+    long long todayStart = nowStamp - (now.wHour * 60 + now.wMinute);
+    
+    entry->id = id;
+    if (!(id & ALARM_ID_STARTUP) && id > g_alarms.nextId) {
+        g_alarms.nextId = id;
+    }
+    entry->hour = hour;
+    entry->minute = minute;
+    entry->repeatDaily = repeatDaily;
+    entry->rampSpeed = rampSpeed;
+    wcsncpy_s(entry->name, ALARM_NAME_LENGTH, name, _TRUNCATE);
+    entry->nextFire = todayStart + hour * 60 + minute;
+    if (entry->nextFire < nowStamp) {
+        entry->nextFire += MINUTES_PER_DAY;
+    }
+    
+    entry->heapIndex = g_alarms.count;
+    g_alarms.heap[g_alarms.count++] = entry;
+    AlarmHeapSiftUp(entry->heapIndex);
+    return entry;
+}
+
+// Move an alarm to a new fire time, keeping the heap in order
+static void RescheduleAlarm(_Inout_ AlarmEntry* entry, _In_ long long nextFire) {
+    entry->nextFire = nextFire;
+    AlarmHeapSiftUp(entry->heapIndex);
+    AlarmHeapSiftDown(entry->heapIndex);
+}
+
+// Unschedule and free an alarm
+static void RemoveAlarm(_In_ AlarmEntry* entry) {
+    JournalRecordAlarm(JOURNAL_RECORD_REMOVE, entry);
+    
+    int index = entry->heapIndex;
+    int last = g_alarms.count - 1;
+    
+    if (index != last) {
+        AlarmHeapSwap(index, last);
+    }
+    g_alarms.count--;
+    
+    // The entry moved into the hole may belong above or below it
+    if (index < g_alarms.count) {
+        AlarmEntry* moved = g_alarms.heap[index];
+        AlarmHeapSiftUp(index);
+        AlarmHeapSiftDown(moved->heapIndex);
+    }
+    
+    free(entry);
+}
+
+// Drop the next upcoming alarm (Alt+C)
+static void CancelNextAlarm(void) {
+    if (g_alarms.count > 0) {
+        RemoveAlarm(g_alarms.heap[0]);
+    }
+}
+
+static void FreeAlarmScheduler(void) {
+    for (int i = 0; i < g_alarms.count; i++) {
+        free(g_alarms.heap[i]);
+    }
+    free(g_alarms.heap);
+    g_alarms.heap = NULL;
+    g_alarms.count = 0;
+    g_alarms.capacity = 0;
+    AlarmIdSetFree(&g_alarms.restoredIds);
+    AlarmIdSetFree(&g_alarms.startupIds);
+}
+
+// Collect the next few alarms in firing order without disturbing the heap.
+// Walks a small frontier from the root: each pick exposes its two children.
+static int GetUpcomingAlarms(_Out_writes_(maxCount) const AlarmEntry** upcoming, _In_ int maxCount) {
+    int frontier[ALARM_STATUS_UPCOMING + 2];
+    int frontierCount = 0;
+    int found = 0;
+    
+    if (maxCount > ALARM_STATUS_UPCOMING) {
+        maxCount = ALARM_STATUS_UPCOMING;
+    }
+    if (g_alarms.count > 0) {
+        frontier[frontierCount++] = 0;
+    }
+    
+    while (found < maxCount && frontierCount > 0) {
+        int best = 0;
+        for (int i = 1; i < frontierCount; i++) {
+            if (AlarmFiresBefore(g_alarms.heap[frontier[i]], g_alarms.heap[frontier[best]])) {
+                best = i;
+            }
+        }
+        
+        int index = frontier[best];
+        frontier[best] = frontier[--frontierCount];
+        upcoming[found++] = g_alarms.heap[index];
+        
+        for (int child = index * 2 + 1; child <= index * 2 + 2; child++) {
+            if (child < g_alarms.count) {
+                frontier[frontierCount++] = child;
+            }
+        }
+    }
+    
+    return found;
+}
+
+static const wchar_t* GetRampName(_In_ AlarmRampSpeed speed) {
+    switch (speed) {
+        case ALARM_RAMP_FAST:
+            return L"fast";
+        case ALARM_RAMP_SLOW:
+            return L"slow";
+        default:
+            return L"moderate";
+    }
+}
+
+static BOOL ParseRampName(_In_z_ const wchar_t* text, _Out_ AlarmRampSpeed* speed) {
+    if (_wcsicmp(text, L"fast") == 0) {
+        *speed = ALARM_RAMP_FAST;
+    } else if (_wcsicmp(text, L"moderate") == 0) {
+        *speed = ALARM_RAMP_MODERATE;
+    } else if (_wcsicmp(text, L"slow") == 0) {
+        *speed = ALARM_RAMP_SLOW;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Load alarms from a text file, one per line:
+//   HH:MM [daily] [fast|moderate|slow] [label...]
+// Blank lines and lines starting with # are ignored.
+static BOOL LoadAlarmFile(_In_z_ const wchar_t* path) {
+    FILE* file = NULL;
+    if (_wfopen_s(&file, path, L"r") != 0 || !file) {
+        fwprintf(stderr, L"Warning: Could not open alarm file %ls\n", path);
+        return FALSE;
+    }
+    
+    char bytes[ALARM_FILE_LINE_MAX];
+    wchar_t line[ALARM_FILE_LINE_MAX];
+    int lineNumber = 0;
+    
+    while (fgets(bytes, sizeof(bytes), file)) {
+        lineNumber++;
+        
+        if (mbstowcs(line, bytes, ALARM_FILE_LINE_MAX - 1) == (size_t)-1) {
+            fwprintf(stderr, L"Warning: %ls:%d: invalid text, skipped\n", path, lineNumber);
+            continue;
+        }
+        line[ALARM_FILE_LINE_MAX - 1] = L'\0';
+        
+        // Trim trailing whitespace (including the newline)
+        size_t length = wcslen(line);
+        while (length > 0 && iswspace(line[length - 1])) {
+            line[--length] = L'\0';
+        }
+        
+        wchar_t* cursor = line;
+        while (iswspace(*cursor)) {
+            cursor++;
+        }
+        if (*cursor == L'\0' || *cursor == L'#') {
+            continue;
+        }
+        
+        int hour = 0, minute = 0;
+        if (swscanf_s(cursor, L"%d:%d", &hour, &minute) != 2 ||
+            hour < 0 || hour > 23 || minute < 0 || minute > 59) {
+            fwprintf(stderr, L"Warning: %ls:%d: expected HH:MM, skipped\n", path, lineNumber);
+            continue;
+        }
+        
+        BOOL repeatDaily = FALSE;
+        AlarmRampSpeed rampSpeed = ALARM_RAMP_MODERATE;
+        const wchar_t* name = L"";
+        
+        // Skip the time, then take option words until the label begins
+        while (*cursor != L'\0' && !iswspace(*cursor)) {
+            cursor++;
+        }
+        for (;;) {
+            while (iswspace(*cursor)) {
+                cursor++;
+            }
+            if (*cursor == L'\0') {
+                break;
+            }
+            
+            wchar_t* wordEnd = cursor;
+            while (*wordEnd != L'\0' && !iswspace(*wordEnd)) {
+                wordEnd++;
+            }
+            wchar_t saved = *wordEnd;
+            *wordEnd = L'\0';
+            
+            BOOL isOption = TRUE;
+            if (_wcsicmp(cursor, L"daily") == 0) {
+                repeatDaily = TRUE;
+            } else if (!ParseRampName(cursor, &rampSpeed)) {
+                isOption = FALSE;
+            }
+            
+            *wordEnd = saved;
+            if (!isOption) {
+                name = cursor;
+                break;
+            }
+            cursor = wordEnd;
+        }
+        
+        AddStartupAlarm((WORD)hour, (WORD)minute, repeatDaily, rampSpeed, name);
+    }
+    
+    fclose(file);
+    return TRUE;
+}
+
+// CRC-32 (IEEE) of a journal record, so torn or garbled writes are detected
+static uint32_t JournalCrc32(_In_reads_(length) const void* data, _In_ size_t length) {
+    static uint32_t table[256];
+    static BOOL tableReady = FALSE;
+    
+    // Built on the main thread by OpenAlarmJournal before the writer starts
+    if (!tableReady) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++) {
+                value = (value & 1) ? (value >> 1) ^ 0xEDB88320UL : value >> 1;
+            }
+            table[i] = value;
+        }
+        tableReady = TRUE;
+    }
+    
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint32_t crc = 0xFFFFFFFFUL;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFUL;
+}
+
+static BOOL JournalRecordValid(_In_ const JournalRecord* record) {
+    return record->magic == JOURNAL_MAGIC &&
+           record->crc == JournalCrc32(record, offsetof(JournalRecord, crc)) &&
+           (record->type == JOURNAL_RECORD_ADD || record->type == JOURNAL_RECORD_REMOVE ||
+            record->type == JOURNAL_RECORD_FIRED);
+}
+
+// Queue a journal record for an alarm change; never blocks on disk
+static void JournalRecordAlarm(_In_ JournalRecordType type, _In_ const AlarmEntry* entry) {
+    if (!g_journal.running) {
+        return;
+    }
+    
+    JournalRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = JOURNAL_MAGIC;
+    record.id = (uint32_t)entry->id;
+    record.type = (uint16_t)type;
+    if (type == JOURNAL_RECORD_ADD) {
+        record.nextFire = entry->nextFire;
+        record.hour = entry->hour;
+        record.minute = entry->minute;
+        record.flags = entry->repeatDaily ? JOURNAL_FLAG_REPEAT : 0;
+        record.rampSpeed = (uint16_t)entry->rampSpeed;
+        if (wcstombs(record.name, entry->name, JOURNAL_NAME_BYTES - 1) == (size_t)-1) {
+            record.name[0] = '\0';
+        }
+    } else if (type == JOURNAL_RECORD_FIRED) {
+        record.nextFire = entry->nextFire;
+    }
+    record.crc = JournalCrc32(&record, offsetof(JournalRecord, crc));
+    
+    EnterCriticalSection(&g_journal.lock);
+    if (g_journal.pendingCount == g_journal.pendingCapacity) {
+        int capacity = g_journal.pendingCapacity > 0 ? g_journal.pendingCapacity * 2 : 64;
+        JournalRecord* pending = (JournalRecord*)realloc(
+            g_journal.pending,
+            (size_t)capacity * sizeof(JournalRecord)
+        );
+        if (!pending) {
+            g_journal.failed = TRUE;
+            LeaveCriticalSection(&g_journal.lock);
+            return;
+        }
+        g_journal.pending = pending;
+        g_journal.pendingCapacity = capacity;
+    }
+    g_journal.pending[g_journal.pendingCount++] = record;
+    WakeConditionVariable(&g_journal.wake);
+    LeaveCriticalSection(&g_journal.lock);
+}
+
+// Fold one record into the set of live ADD records (sorted by id)
+static BOOL JournalLiveApply(_In_ const JournalRecord* record) {
+    // Binary search for the first live record with id >= record->id
+    int low = 0;
+    int high = g_journal.liveCount;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (g_journal.live[middle].id < record->id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    BOOL found = low < g_journal.liveCount && g_journal.live[low].id == record->id;
+    
+    if (record->type == JOURNAL_RECORD_REMOVE) {
+        if (found) {
+            memmove(
+                g_journal.live + low,
+                g_journal.live + low + 1,
+                (size_t)(g_journal.liveCount - low - 1) * sizeof(JournalRecord)
+            );
+            g_journal.liveCount--;
+        }
+        return TRUE;
+    }
+    
+    // A daily alarm that fired keeps its ADD record with the new fire time
+    if (record->type == JOURNAL_RECORD_FIRED) {
+        if (found) {
+            g_journal.live[low].nextFire = record->nextFire;
+            g_journal.live[low].crc = JournalCrc32(&g_journal.live[low], offsetof(JournalRecord, crc));
+        }
+        return TRUE;
+    }
+    
+    if (found) {
+        g_journal.live[low] = *record;
+        return TRUE;
+    }
+    
+    if (g_journal.liveCount == g_journal.liveCapacity) {
+        int capacity = g_journal.liveCapacity > 0 ? g_journal.liveCapacity * 2 : 64;
+        JournalRecord* live = (JournalRecord*)realloc(
+            g_journal.live,
+            (size_t)capacity * sizeof(JournalRecord)
+        );
+        if (!live) {
+            return FALSE;
+        }
+        g_journal.live = live;
+        g_journal.liveCapacity = capacity;
+    }
+    
+    // New alarms get increasing ids, so this is almost always an append
+    memmove(
+        g_journal.live + low + 1,
+        g_journal.live + low,
+        (size_t)(g_journal.liveCount - low) * sizeof(JournalRecord)
+    );
+    g_journal.live[low] = *record;
+    g_journal.liveCount++;
+    return TRUE;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI JournalThreadMain(_In_ LPVOID param) {
+    UNREFERENCED_PARAMETER(param);
+    RunJournalWriter();
+    return 0;
+}
+#else
+static void* JournalThreadMain(void* param) {
+    UNREFERENCED_PARAMETER(param);
+    
+    // Leave SIGWINCH and quit signals to the main loop
+    sigset_t blocked;
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_BLOCK, &blocked, NULL);
+    
+    RunJournalWriter();
+    return NULL;
+}
+#endif
+
+// Load the journal with one mapped read, restore its alarms and start the
+// writer. A torn or corrupt tail (a crash mid-append) is cut off.
+static BOOL OpenAlarmJournal(_In_z_ const wchar_t* path) {
+    if (g_journal.running) {
+        return TRUE;
+    }
+    if (wcslen(path) + 5 > JOURNAL_PATH_MAX) {
+        fwprintf(stderr, L"Warning: Alarm journal path too long\n");
+        return FALSE;
+    }
+    wcscpy_s(g_journal.path, JOURNAL_PATH_MAX, path);
+    JournalCrc32(NULL, 0);
+    
+    g_journal.file = JournalFileOpen(path, FALSE);
+    if (g_journal.file == JOURNAL_INVALID_FILE) {
+        fwprintf(stderr, L"Warning: Could not open alarm journal %ls\n", path);
+        return FALSE;
+    }
+    
+    size_t size = 0;
+    const unsigned char* view = JournalFileMap(g_journal.file, &size);
+    size_t validLength = 0;
+    DWORD recordCount = 0;
+    BOOL outOfMemory = FALSE;
+    
+    if (view) {
+        size_t count = size / sizeof(JournalRecord);
+        for (size_t i = 0; i < count; i++) {
+            JournalRecord record;
+            memcpy(&record, view + i * sizeof(JournalRecord), sizeof(record));
+            if (!JournalRecordValid(&record)) {
+                break;
+            }
+            if (!JournalLiveApply(&record)) {
+                outOfMemory = TRUE;
+                break;
+            }
+            validLength += sizeof(JournalRecord);
+            recordCount++;
+        }
+        JournalFileUnmap(view, size);
+    }
+    
+    // Only a torn or corrupt tail is cut off; a journal that could not be
+    // held in memory is left untouched for the next run
+    if (outOfMemory) {
+        fwprintf(stderr, L"Warning: Could not load alarm journal %ls\n", path);
+        JournalFileClose(g_journal.file);
+        g_journal.file = JOURNAL_INVALID_FILE;
+        free(g_journal.live);
+        g_journal.live = NULL;
+        g_journal.liveCount = 0;
+        g_journal.liveCapacity = 0;
+        return FALSE;
+    }
+    
+    if (validLength != size) {
+        fwprintf(
+            stderr,
+            L"Warning: Alarm journal %ls had %lu damaged trailing bytes, discarded\n",
+            path,
+            (unsigned long)(size - validLength)
+        );
+    }
+    if (!JournalFileSetLength(g_journal.file, validLength)) {
+        fwprintf(stderr, L"Warning: Could not repair alarm journal %ls\n", path);
+        JournalFileClose(g_journal.file);
+        g_journal.file = JOURNAL_INVALID_FILE;
+        free(g_journal.live);
+        g_journal.live = NULL;
+        g_journal.liveCount = 0;
+        g_journal.liveCapacity = 0;
+        return FALSE;
+    }
+    g_journal.recordCount = recordCount;
+    
+    // Restore the alarms. Daily alarms are rescheduled from now, but never
+    // before the time recorded when they last fired, so a restart in the
+    // minute an alarm rang does not ring it again. One-shot alarms keep their
+    // recorded time and fire right away if it was missed.
+    for (int i = 0; i < g_journal.liveCount; i++) {
+        const JournalRecord* record = &g_journal.live[i];
+        wchar_t name[ALARM_NAME_LENGTH];
+        char nameBytes[JOURNAL_NAME_BYTES];
+        
+        memcpy(nameBytes, record->name, JOURNAL_NAME_BYTES);
+        nameBytes[JOURNAL_NAME_BYTES - 1] = '\0';
+        if (mbstowcs(name, nameBytes, ALARM_NAME_LENGTH - 1) == (size_t)-1) {
+            name[0] = L'\0';
+        }
+        name[ALARM_NAME_LENGTH - 1] = L'\0';
+        
+        if (record->hour > 23 || record->minute > 59 || record->rampSpeed > ALARM_RAMP_SLOW) {
+            continue;
+        }
+        
+        AlarmEntry* entry = InsertAlarm(
+            record->id,
+            record->hour,
+            record->minute,
+            (record->flags & JOURNAL_FLAG_REPEAT) != 0,
+            (AlarmRampSpeed)record->rampSpeed,
+            name
+        );
+        if (!entry) {
+            continue;
+        }
+        if (!entry->repeatDaily || record->nextFire > entry->nextFire) {
+            RescheduleAlarm(entry, record->nextFire);
+        }
+        if (entry->id & ALARM_ID_STARTUP) {
+            AlarmIdSetAdd(&g_alarms.restoredIds, entry->id);
+        }
+    }
+    
+    InitializeCriticalSection(&g_journal.lock);
+    InitializeConditionVariable(&g_journal.wake);
+    g_journal.quit = FALSE;
+    
+#ifdef _WIN32
+    g_journalThread = CreateThread(NULL, 0, JournalThreadMain, NULL, 0, NULL);
+    g_journal.running = (g_journalThread != NULL);
+#else
+    g_journal.running = (pthread_create(&g_journalThread, NULL, JournalThreadMain, NULL) == 0);
+#endif
+    
+    if (!g_journal.running) {
+        fwprintf(stderr, L"Warning: Could not start alarm journal thread\n");
+        DeleteCriticalSection(&g_journal.lock);
+        JournalFileClose(g_journal.file);
+        g_journal.file = JOURNAL_INVALID_FILE;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Write out anything still queued, stop the writer and close the journal
+static void CloseAlarmJournal(void) {
+    if (!g_journal.running) {
+        return;
+    }
+    
+    EnterCriticalSection(&g_journal.lock);
+    g_journal.quit = TRUE;
+    WakeConditionVariable(&g_journal.wake);
+    LeaveCriticalSection(&g_journal.lock);
+    
+#ifdef _WIN32
+    WaitForSingleObject(g_journalThread, INFINITE);
+    CloseHandle(g_journalThread);
+    g_journalThread = NULL;
+#else
+    pthread_join(g_journalThread, NULL);
+#endif
+    
+    g_journal.running = FALSE;
+    DeleteCriticalSection(&g_journal.lock);
+    if (g_journal.file != JOURNAL_INVALID_FILE) {
+        JournalFileClose(g_journal.file);
+        g_journal.file = JOURNAL_INVALID_FILE;
+    }
+    
+    if (g_journal.failed) {
+        fwprintf(stderr, L"Warning: Some alarm changes could not be saved to %ls\n", g_journal.path);
+    }
+    
+    free(g_journal.pending);
+    free(g_journal.writing);
+    free(g_journal.live);
+    g_journal.pending = NULL;
+    g_journal.writing = NULL;
+    g_journal.live = NULL;
+    g_journal.pendingCount = 0;
+    g_journal.pendingCapacity = 0;
+    g_journal.writingCapacity = 0;
+    g_journal.liveCount = 0;
+    g_journal.liveCapacity = 0;
+}
+
+// Rewrite the journal as just its live alarms. The snapshot is written to a
+// temporary file, synced and renamed over the journal, so a crash at any
+// point leaves either the old or the new file intact.
+static BOOL CompactAlarmJournal(void) {
+    wchar_t tempPath[JOURNAL_PATH_MAX];
+    swprintf(tempPath, JOURNAL_PATH_MAX, L"%ls.tmp", g_journal.path);
+    
+    JournalFile temp = JournalFileOpen(tempPath, TRUE);
+    if (temp == JOURNAL_INVALID_FILE) {
+        return FALSE;
+    }
+    
+    BOOL written = JournalFileWrite(
+        temp,
+        g_journal.live,
+        (size_t)g_journal.liveCount * sizeof(JournalRecord)
+    ) && JournalFileSync(temp);
+    JournalFileClose(temp);
+    if (!written) {
+        return FALSE;
+    }
+    
+    // Windows cannot replace a file that is still open
+    JournalFileClose(g_journal.file);
+    BOOL replaced = JournalFileReplace(tempPath, g_journal.path);
+    
+    g_journal.file = JournalFileOpen(g_journal.path, FALSE);
+    if (g_journal.file == JOURNAL_INVALID_FILE) {
+        return FALSE;
+    }
+    
+    if (replaced) {
+        g_journal.recordCount = (DWORD)g_journal.liveCount;
+    }
+    
+    // Position for appending whichever file is now in place
+    size_t size = 0;
+    const unsigned char* view = JournalFileMap(g_journal.file, &size);
+    if (view) {
+        JournalFileUnmap(view, size);
+    }
+    return JournalFileSetLength(g_journal.file, size) && replaced;
+}
+
+// Journal writer: append queued records in batches, sync each batch, and
+// compact once most of the file describes alarms that no longer exist.
+static void RunJournalWriter(void) {
+    EnterCriticalSection(&g_journal.lock);
+    for (;;) {
+        if (g_journal.pendingCount == 0) {
+            if (g_journal.quit) {
+                break;
+            }
+            SleepConditionVariableCS(&g_journal.wake, &g_journal.lock, INFINITE);
+            continue;
+        }
+        
+        // Swap buffers so the main loop can keep queueing while we write
+        JournalRecord* batch = g_journal.pending;
+        int batchCount = g_journal.pendingCount;
+        g_journal.pending = g_journal.writing;
+        g_journal.writing = batch;
+        int capacity = g_journal.pendingCapacity;
+        g_journal.pendingCapacity = g_journal.writingCapacity;
+        g_journal.writingCapacity = capacity;
+        g_journal.pendingCount = 0;
+        LeaveCriticalSection(&g_journal.lock);
+        
+        BOOL ok = g_journal.file != JOURNAL_INVALID_FILE &&
+                  JournalFileWrite(g_journal.file, batch, (size_t)batchCount * sizeof(JournalRecord)) &&
+                  JournalFileSync(g_journal.file);
+        if (ok) {
+            g_journal.recordCount += (DWORD)batchCount;
+        }
+        for (int i = 0; i < batchCount; i++) {
+            if (!JournalLiveApply(&batch[i])) {
+                ok = FALSE;
+            }
+        }
+        
+        if (ok && g_journal.recordCount >= JOURNAL_COMPACT_MIN_RECORDS &&
+            g_journal.recordCount > 2 * (DWORD)g_journal.liveCount) {
+            ok = CompactAlarmJournal();
+        }
+        
+        EnterCriticalSection(&g_journal.lock);
+        if (!ok) {
+            g_journal.failed = TRUE;
+        }
+    }
+    LeaveCriticalSection(&g_journal.lock);
+}
+
+#ifdef _WIN32
+static JournalFile JournalFileOpen(_In_z_ const wchar_t* path, _In_ BOOL truncate) {
+    return CreateFileW(
+        path,
+        GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ,
+        NULL,
+        truncate ? CREATE_ALWAYS : OPEN_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL
+    );
+}
+
+static const unsigned char* JournalFileMap(_In_ JournalFile file, _Out_ size_t* size) {
+    LARGE_INTEGER fileSize;
+    
+    *size = 0;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        return NULL;
+    }
+    
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        return NULL;
+    }
+    const unsigned char* view = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);  // The view keeps the mapping alive
+    
+    if (view) {
+        *size = (size_t)fileSize.QuadPart;
+    }
+    return view;
+}
+
+static void JournalFileUnmap(_In_ const unsigned char* view, _In_ size_t size) {
+    UNREFERENCED_PARAMETER(size);
+    UnmapViewOfFile(view);
+}
+
+// Cut the file to the given length and leave the file pointer at its end
+static BOOL JournalFileSetLength(_In_ JournalFile file, _In_ size_t length) {
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG)length;
+    return SetFilePointerEx(file, position, NULL, FILE_BEGIN) && SetEndOfFile(file);
+}
+
+static BOOL JournalFileWrite(_In_ JournalFile file, _In_reads_(length) const void* data, _In_ size_t length) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    while (length > 0) {
+        DWORD chunk = length > 0x10000000 ? 0x10000000 : (DWORD)length;
+        DWORD written = 0;
+        if (!WriteFile(file, bytes, chunk, &written, NULL) || written == 0) {
+            return FALSE;
+        }
+        bytes += written;
+        length -= written;
+    }
+    return TRUE;
+}
+
+static BOOL JournalFileSync(_In_ JournalFile file) {
+    return FlushFileBuffers(file);
+}
+
+static void JournalFileClose(_In_ JournalFile file) {
+    CloseHandle(file);
+}
+
+static BOOL JournalFileReplace(_In_z_ const wchar_t* source, _In_z_ const wchar_t* target) {
+    return MoveFileExW(source, target, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+}
+
+static JournalFile FontFileOpen(_In_z_ const wchar_t* path) {
+    return CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+// Size and last-write time, for the font cache key
+static BOOL FontFileIdentity(_In_ JournalFile file, _Out_ uint64_t* size, _Out_ uint64_t* modified) {
+    LARGE_INTEGER fileSize;
+    FILETIME written;
+    
+    if (!GetFileSizeEx(file, &fileSize) || !GetFileTime(file, NULL, NULL, &written)) {
+        return FALSE;
+    }
+    *size = (uint64_t)fileSize.QuadPart;
+    *modified = ((uint64_t)written.dwHighDateTime << 32) | written.dwLowDateTime;
+    return TRUE;
+}
+
+// Compiled font cache file for a key, under %LOCALAPPDATA%\ascii_time
+static BOOL GetFontCachePath(_In_ uint64_t key, _Out_writes_(capacity) wchar_t* path, _In_ size_t capacity) {
+    wchar_t base[FONT_PATH_MAX];
+    DWORD length = GetEnvironmentVariableW(L"LOCALAPPDATA", base, FONT_PATH_MAX);
+    
+    if (length == 0 || length >= FONT_PATH_MAX ||
+        swprintf(path, capacity, L"%ls\\ascii_time", base) < 0) {
+        return FALSE;
+    }
+    CreateDirectoryW(path, NULL);   // Fails harmlessly once it exists
+    return swprintf(path, capacity, L"%ls\\ascii_time\\font-%016llx.bin", base, (unsigned long long)key) > 0;
+}
+
+static void DeleteFontCacheFile(_In_z_ const wchar_t* path) {
+    DeleteFileW(path);
+}
+#else
+// Convert a wide path to the locale's multibyte encoding
+static BOOL JournalPathBytes(_In_z_ const wchar_t* path, _Out_ char* bytes, _In_ size_t size) {
+    size_t converted = wcstombs(bytes, path, size);
+    return converted != (size_t)-1 && converted < size;
+}
+
+static JournalFile JournalFileOpen(_In_z_ const wchar_t* path, _In_ BOOL truncate) {
+    char pathBytes[JOURNAL_PATH_MAX * 4];
+    if (!JournalPathBytes(path, pathBytes, sizeof(pathBytes))) {
+        return JOURNAL_INVALID_FILE;
+    }
+    return open(pathBytes, O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+}
+
+static const unsigned char* JournalFileMap(_In_ JournalFile file, _Out_ size_t* size) {
+    struct stat info;
+    
+    *size = 0;
+    if (fstat(file, &info) != 0 || info.st_size == 0) {
+        return NULL;
+    }
+    
+    void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (view == MAP_FAILED) {
+        return NULL;
+    }
+    *size = (size_t)info.st_size;
+    return (const unsigned char*)view;
+}
+
+static void JournalFileUnmap(_In_ const unsigned char* view, _In_ size_t size) {
+    munmap((void*)view, size);
+}
+
+// Cut the file to the given length and leave the file offset at its end
+static BOOL JournalFileSetLength(_In_ JournalFile file, _In_ size_t length) {
+    return ftruncate(file, (off_t)length) == 0 && 
+           lseek(file, (off_t)length, SEEK_SET) == (off_t)length;
+}
+
+static BOOL JournalFileWrite(_In_ JournalFile file, _In_reads_(length) const void* data, _In_ size_t length) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    while (length > 0) {
+        ssize_t written = write(file, bytes, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return FALSE;
+        }
+        bytes += written;
+        length -= (size_t)written;
+    }
+    return TRUE;
+}
+
+static BOOL JournalFileSync(_In_ JournalFile file) {
+    return fsync(file) == 0;
+}
+
+static void JournalFileClose(_In_ JournalFile file) {
+    close(file);
+}
+
+// Rename over the target, then sync the directory so the rename itself
+// survives a crash
+static BOOL JournalFileReplace(_In_z_ const wchar_t* source, _In_z_ const wchar_t* target) {
+    char sourceBytes[JOURNAL_PATH_MAX * 4];
+    char targetBytes[JOURNAL_PATH_MAX * 4];
+    if (!JournalPathBytes(source, sourceBytes, sizeof(sourceBytes)) ||
+        !JournalPathBytes(target, targetBytes, sizeof(targetBytes)) ||
+        rename(sourceBytes, targetBytes) != 0) {
+        return FALSE;
+    }
+    
+    char* slash = strrchr(targetBytes, '/');
+    if (slash == targetBytes) {
+        slash[1] = '\0';
+    } else if (slash) {
+        *slash = '\0';
+    } else {
+        strcpy(targetBytes, ".");
+    }
+    
+    int directory = open(targetBytes, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory < 0) {
+        return FALSE;
+    }
+    BOOL synced = fsync(directory) == 0;
+    close(directory);
+    return synced;
+}
+
+static JournalFile FontFileOpen(_In_z_ const wchar_t* path) {
+    char pathBytes[FONT_PATH_MAX * 4];
+    if (!JournalPathBytes(path, pathBytes, sizeof(pathBytes))) {
+        return JOURNAL_INVALID_FILE;
+    }
+    return open(pathBytes, O_RDONLY | O_CLOEXEC);
+}
+
+// Size and modification time, for the font cache key
+static BOOL FontFileIdentity(_In_ JournalFile file, _Out_ uint64_t* size, _Out_ uint64_t* modified) {
+    struct stat info;
+    
+    if (fstat(file, &info) != 0) {
+        return FALSE;
+    }
+    *size = (uint64_t)info.st_size;
+    *modified = (uint64_t)info.st_mtime;
+    return TRUE;
+}
+
+// Compiled font cache file for a key, under $XDG_CACHE_HOME/ascii_time
+// (~/.cache/ascii_time by default)
+static BOOL GetFontCachePath(_In_ uint64_t key, _Out_writes_(capacity) wchar_t* path, _In_ size_t capacity) {
+    char directory[FONT_PATH_MAX];
+    const char* base = getenv("XDG_CACHE_HOME");
+    int length;
+    
+    if (base && base[0] == '/') {
+        // Create $XDG_CACHE_HOME and any missing parents, as the spec asks
+        length = snprintf(directory, sizeof(directory), "%s", base);
+        if (length > 0 && length < (int)sizeof(directory)) {
+            for (char* slash = strchr(directory + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+                *slash = '\0';
+                mkdir(directory, 0700);
+                *slash = '/';
+            }
+            mkdir(directory, 0700);
+        }
+        length = snprintf(directory, sizeof(directory), "%s/ascii_time", base);
+    } else {
+        const char* home = getenv("HOME");
+        if (!home || !home[0]) {
+            return FALSE;
+        }
+        length = snprintf(directory, sizeof(directory), "%s/.cache", home);
+        if (length > 0 && length < (int)sizeof(directory)) {
+            mkdir(directory, 0700);
+        }
+        length = snprintf(directory, sizeof(directory), "%s/.cache/ascii_time", home);
+    }
+    if (length <= 0 || length >= (int)sizeof(directory)) {
+        return FALSE;
+    }
+    mkdir(directory, 0700);     // Fails harmlessly once it exists
+    
+    length = swprintf(path, capacity, L"%s/font-%016llx.bin", directory, (unsigned long long)key);
+    return length > 0 && (size_t)length < capacity;
+}
+
+static void DeleteFontCacheFile(_In_z_ const wchar_t* path) {
+    char pathBytes[FONT_PATH_MAX * 4];
+    if (JournalPathBytes(path, pathBytes, sizeof(pathBytes))) {
+        unlink(pathBytes);
+    }
+}
+#endif
+
+static void PutBroadcastUint16(_Inout_ unsigned char** cursor, _In_ uint16_t value) {
+    memcpy(*cursor, &value, sizeof(value));
+    *cursor += sizeof(value);
+}
+
+static void PutBroadcastUint32(_Inout_ unsigned char** cursor, _In_ uint32_t value) {
+    memcpy(*cursor, &value, sizeof(value));
+    *cursor += sizeof(value);
+}
+
+// Mark every row of a viewer fully dirty and ask for a keyframe
+static void MarkViewerKeyframe(_Inout_ BroadcastViewer* viewer) {
+    for (SHORT row = 0; row < g_broadcast.height; row++) {
+        viewer->dirtyLeft[row] = 0;
+        viewer->dirtyRight[row] = (SHORT)(g_broadcast.width - 1);
+    }
+    viewer->dirty = TRUE;
+    viewer->needsKeyframe = TRUE;
+}
+
+// Size a viewer's dirty rows to the current frame height
+static BOOL ResizeViewerRows(_Inout_ BroadcastViewer* viewer) {
+    size_t rows = g_broadcast.height > 0 ? (size_t)g_broadcast.height : 1;
+    SHORT* left = (SHORT*)realloc(viewer->dirtyLeft, rows * sizeof(SHORT));
+    if (left) {
+        viewer->dirtyLeft = left;
+    }
+    SHORT* right = (SHORT*)realloc(viewer->dirtyRight, rows * sizeof(SHORT));
+    if (right) {
+        viewer->dirtyRight = right;
+    }
+    if (!left || !right) {
+        return FALSE;
+    }
+    
+    MarkViewerKeyframe(viewer);
+    return TRUE;
+}
+
+static void DropViewer(_In_ int index) {
+    BroadcastViewer* viewer = &g_broadcast.viewers[index];
+    
+    BroadcastClose(viewer->handle);
+    free(viewer->pending);
+    free(viewer->dirtyLeft);
+    free(viewer->dirtyRight);
+    
+    g_broadcast.viewerCount--;
+    if (index != g_broadcast.viewerCount) {
+        *viewer = g_broadcast.viewers[g_broadcast.viewerCount];
+    }
+    memset(&g_broadcast.viewers[g_broadcast.viewerCount], 0, sizeof(BroadcastViewer));
+}
+
+// Start serving frames on a Unix domain socket or named pipe
+static BOOL StartBroadcastServer(_In_z_ const wchar_t* path) {
+    memset(&g_broadcast, 0, sizeof(g_broadcast));
+    g_broadcast.listener = BroadcastListen(path);
+    if (g_broadcast.listener == BROADCAST_INVALID_HANDLE) {
+        return FALSE;
+    }
+    
+    InitializeCriticalSection(&g_broadcast.lock);
+    InitializeConditionVariable(&g_broadcast.wake);
+    
+#ifdef _WIN32
+    g_broadcastThread = CreateThread(NULL, 0, BroadcastThreadMain, NULL, 0, NULL);
+    g_broadcast.running = (g_broadcastThread != NULL);
+#else
+    g_broadcast.running = (pthread_create(&g_broadcastThread, NULL, BroadcastThreadMain, NULL) == 0);
+#endif
+    
+    if (!g_broadcast.running) {
+        BroadcastCloseListener();
+        DeleteCriticalSection(&g_broadcast.lock);
+    }
+    return g_broadcast.running;
+}
+
+// Disconnect every viewer and stop the worker. The counters are kept for
+// ReportBroadcastServer once the console is restored.
+static void StopBroadcastServer(void) {
+    if (!g_broadcast.running) {
+        return;
+    }
+    
+    EnterCriticalSection(&g_broadcast.lock);
+    g_broadcast.quit = TRUE;
+    WakeConditionVariable(&g_broadcast.wake);
+    LeaveCriticalSection(&g_broadcast.lock);
+    
+#ifdef _WIN32
+    WaitForSingleObject(g_broadcastThread, INFINITE);
+    CloseHandle(g_broadcastThread);
+    g_broadcastThread = NULL;
+#else
+    pthread_join(g_broadcastThread, NULL);
+#endif
+    
+    while (g_broadcast.viewerCount > 0) {
+        DropViewer(g_broadcast.viewerCount - 1);
+    }
+    BroadcastCloseListener();
+    free(g_broadcast.cells);
+    g_broadcast.cells = NULL;
+    g_broadcast.running = FALSE;
+    g_broadcast.stopped = TRUE;
+    DeleteCriticalSection(&g_broadcast.lock);
+}
+
+// Report what a stopped server sent
+static void ReportBroadcastServer(void) {
+    if (!g_broadcast.stopped) {
+        return;
+    }
+    
+    fwprintf(
+        stderr,
+        L"Broadcast: %lu viewers served, %lu messages sent, %lu frame changes coalesced\n",
+        g_broadcast.viewersServed,
+        g_broadcast.messagesSent,
+        g_broadcast.framesCoalesced
+    );
+}
+
+// Called by FlushFrame after the diff: copy this frame's changed cells into
+// the snapshot and widen each viewer's dirty rows. Never touches a socket.
+static void BroadcastFrame(void) {
+    EnterCriticalSection(&g_broadcast.lock);
+    
+    if (g_frame.width != g_broadcast.width || g_frame.height != g_broadcast.height) {
+        size_t cellCount = (size_t)g_frame.width * (size_t)g_frame.height;
+        FrameCell* cells = (FrameCell*)realloc(g_broadcast.cells, cellCount * sizeof(FrameCell));
+        if (!cells) {
+            LeaveCriticalSection(&g_broadcast.lock);
+            return;
+        }
+        
+        g_broadcast.cells = cells;
+        g_broadcast.width = g_frame.width;
+        g_broadcast.height = g_frame.height;
+        memcpy(cells, g_frame.cells, cellCount * sizeof(FrameCell));
+        
+        for (int i = g_broadcast.viewerCount - 1; i >= 0; i--) {
+            if (!ResizeViewerRows(&g_broadcast.viewers[i])) {
+                DropViewer(i);
+            }
+        }
+    } else {
+        for (int i = 0; i < g_broadcast.viewerCount; i++) {
+            if (g_broadcast.viewers[i].dirty) {
+                g_broadcast.framesCoalesced++;
+            }
+        }
+        
+        for (int s = 0; s < g_frame.spanCount; s++) {
+            const FrameSpan* span = &g_frame.spans[s];
+            size_t offset = (size_t)span->y * g_frame.width + span->x;
+            SHORT right = (SHORT)(span->x + span->length - 1);
+            
+            memcpy(g_broadcast.cells + offset, g_frame.cells + offset, span->length * sizeof(FrameCell));
+            for (int i = 0; i < g_broadcast.viewerCount; i++) {
+                BroadcastViewer* viewer = &g_broadcast.viewers[i];
+                if (viewer->dirtyLeft[span->y] > viewer->dirtyRight[span->y]) {
+                    viewer->dirtyLeft[span->y] = span->x;
+                    viewer->dirtyRight[span->y] = right;
+                } else {
+                    if (span->x < viewer->dirtyLeft[span->y]) {
+                        viewer->dirtyLeft[span->y] = span->x;
                     }
-                    
-                    if (wcsncmp(rampInput, L"fast", 4) == 0) {
-                        g_alarmState.rampSpeed = ALARM_RAMP_FAST;
-                    } else if (wcsncmp(rampInput, L"slow", 4) == 0) {
-                        g_alarmState.rampSpeed = ALARM_RAMP_SLOW;
-                    } else {
-                        g_alarmState.rampSpeed = ALARM_RAMP_MODERATE;
+                    if (right > viewer->dirtyRight[span->y]) {
+                        viewer->dirtyRight[span->y] = right;
                     }
-                } else {
-                    // Clear the prompt line if no input
-                    FillConsoleOutputCharacterW(
-                        g_hConsole, L' ', csbi.dwSize.X, coord, &cCharsWritten
-                    );
-                    FillConsoleOutputAttribute(
-                        g_hConsole, normalAttribute, csbi.dwSize.X, coord, &cCharsWritten
-                    );
-                    g_alarmState.rampSpeed = ALARM_RAMP_MODERATE;
                 }
-                
-                g_alarmState.isActive = TRUE;
+                viewer->dirty = TRUE;
+            }
+        }
+    }
+    
+    WakeConditionVariable(&g_broadcast.wake);
+    LeaveCriticalSection(&g_broadcast.lock);
+}
+
+// Serialize a viewer's dirty rows from the snapshot into its pending buffer
+static BOOL BuildViewerMessage(_Inout_ BroadcastViewer* viewer) {
+    int spanCount = 0;
+    size_t cellCount = 0;
+    
+    for (SHORT row = 0; row < g_broadcast.height; row++) {
+        if (viewer->dirtyLeft[row] <= viewer->dirtyRight[row]) {
+            spanCount++;
+            cellCount += (size_t)(viewer->dirtyRight[row] - viewer->dirtyLeft[row] + 1);
+        }
+    }
+    
+    size_t length = (size_t)spanCount * 6 + cellCount * BROADCAST_CELL_BYTES;
+    unsigned char* message = (unsigned char*)malloc(sizeof(BroadcastHeader) + length);
+    if (!message) {
+        return FALSE;
+    }
+    
+    BroadcastHeader header;
+    header.magic = BROADCAST_MAGIC;
+    header.type = (uint16_t)(viewer->needsKeyframe ? BROADCAST_KEYFRAME : BROADCAST_DIFF);
+    header.spanCount = (uint16_t)spanCount;
+    header.width = (uint16_t)g_broadcast.width;
+    header.height = (uint16_t)g_broadcast.height;
+    header.length = (uint32_t)length;
+    memcpy(message, &header, sizeof(header));
+    
+    unsigned char* cursor = message + sizeof(header);
+    for (SHORT row = 0; row < g_broadcast.height; row++) {
+        SHORT left = viewer->dirtyLeft[row];
+        SHORT right = viewer->dirtyRight[row];
+        if (left > right) {
+            continue;
+        }
+        
+        PutBroadcastUint16(&cursor, (uint16_t)left);
+        PutBroadcastUint16(&cursor, (uint16_t)row);
+        PutBroadcastUint16(&cursor, (uint16_t)(right - left + 1));
+        
+        const FrameCell* cells = g_broadcast.cells + (size_t)row * g_broadcast.width;
+        for (SHORT col = left; col <= right; col++) {
+            PutBroadcastUint32(&cursor, (uint32_t)cells[col].ch);
+            PutBroadcastUint16(&cursor, cells[col].attr);
+        }
+        
+        viewer->dirtyLeft[row] = SHRT_MAX;
+        viewer->dirtyRight[row] = -1;
+    }
+    
+    free(viewer->pending);
+    viewer->pending = message;
+    viewer->pendingLength = sizeof(header) + length;
+    viewer->pendingSent = 0;
+    viewer->dirty = FALSE;
+    viewer->needsKeyframe = FALSE;
+    return TRUE;
+}
+
+// Worker loop: accept viewers, turn dirty state into messages, and write
+// without blocking. A viewer that errors out is dropped; one that is merely
+// slow keeps its unsent message and collects further changes as dirt.
+static void RunBroadcastServer(void) {
+    EnterCriticalSection(&g_broadcast.lock);
+    
+    while (!g_broadcast.quit) {
+        while (g_broadcast.viewerCount < BROADCAST_MAX_VIEWERS) {
+            BroadcastHandle handle = BroadcastAccept();
+            if (handle == BROADCAST_INVALID_HANDLE) {
+                break;
+            }
+            
+            BroadcastViewer* viewer = &g_broadcast.viewers[g_broadcast.viewerCount];
+            memset(viewer, 0, sizeof(*viewer));
+            viewer->handle = handle;
+            g_broadcast.viewerCount++;
+            g_broadcast.viewersServed++;
+            if (!ResizeViewerRows(viewer)) {
+                DropViewer(g_broadcast.viewerCount - 1);
+            } else if (g_broadcast.viewerCount == 1) {
+                // A clock suspended because its own console is hidden
+                // draws again for its first viewer
+                WakeMainLoop();
+            }
+        }
+        
+        BOOL backlogged = FALSE;
+        for (int i = g_broadcast.viewerCount - 1; i >= 0; i--) {
+            BroadcastViewer* viewer = &g_broadcast.viewers[i];
+            
+            if (viewer->pendingSent == viewer->pendingLength && viewer->dirty && g_broadcast.cells) {
+                if (!BuildViewerMessage(viewer)) {
+                    backlogged = TRUE;
+                    continue;
+                }
+            }
+            
+            // Zero means the viewer's buffer is full; negative means it is gone
+            long sent = 1;
+            while (viewer->pendingSent < viewer->pendingLength) {
+                sent = BroadcastSend(
+                    viewer->handle,
+                    viewer->pending + viewer->pendingSent,
+                    viewer->pendingLength - viewer->pendingSent
+                );
+                if (sent <= 0) {
+                    break;
+                }
+                viewer->pendingSent += (size_t)sent;
+            }
+            
+            if (sent < 0) {
+                DropViewer(i);
+            } else if (viewer->pendingSent < viewer->pendingLength) {
+                backlogged = TRUE;
+            } else if (viewer->pending) {
+                free(viewer->pending);
+                viewer->pending = NULL;
+                viewer->pendingLength = 0;
+                viewer->pendingSent = 0;
+                g_broadcast.messagesSent++;
+            }
+        }
+        
+        SleepConditionVariableCS(
+            &g_broadcast.wake,
+            &g_broadcast.lock,
+            backlogged ? BROADCAST_RETRY_MS : BROADCAST_ACCEPT_MS
+        );
+    }
+    
+    LeaveCriticalSection(&g_broadcast.lock);
+}
+
+// Copy cells from a frame message into the mirror and the frame buffer
+static BOOL ApplyBroadcastMessage(
+    _Inout_ ViewerState* viewer,
+    _In_ const BroadcastHeader* header,
+    _In_reads_(header->length) const unsigned char* body
+) {
+    if (header->type == BROADCAST_KEYFRAME) {
+        size_t cellCount = (size_t)header->width * (size_t)header->height;
+        FrameCell* mirror = (FrameCell*)realloc(viewer->mirror, (cellCount ? cellCount : 1) * sizeof(FrameCell));
+        if (!mirror) {
+            return FALSE;
+        }
+        viewer->mirror = mirror;
+        viewer->width = (SHORT)header->width;
+        viewer->height = (SHORT)header->height;
+        for (size_t i = 0; i < cellCount; i++) {
+            mirror[i].ch = L' ';
+            mirror[i].attr = g_contentAttribute;
+        }
+        FrameFillRect(0, 0, g_frame.width, g_frame.height, L' ', g_contentAttribute);
+    } else if (header->width != (uint16_t)viewer->width || header->height != (uint16_t)viewer->height) {
+        return TRUE;    // Stale diff from before a keyframe we have not seen yet
+    }
+    
+    const unsigned char* cursor = body;
+    const unsigned char* end = body + header->length;
+    wchar_t chars[BROADCAST_ROW_MAX];
+    
+    for (int s = 0; s < header->spanCount; s++) {
+        uint16_t x, y, length;
+        if (end - cursor < 6) {
+            return FALSE;
+        }
+        memcpy(&x, cursor, 2);
+        memcpy(&y, cursor + 2, 2);
+        memcpy(&length, cursor + 4, 2);
+        cursor += 6;
+        
+        if ((size_t)(end - cursor) < (size_t)length * BROADCAST_CELL_BYTES ||
+            y >= header->height || x + length > header->width) {
+            return FALSE;
+        }
+        
+        FrameCell* row = viewer->mirror + (size_t)y * viewer->width + x;
+        for (uint16_t i = 0; i < length; i++) {
+            uint32_t ch;
+            memcpy(&ch, cursor, 4);
+            memcpy(&row[i].attr, cursor + 4, 2);
+            row[i].ch = (wchar_t)ch;
+            cursor += BROADCAST_CELL_BYTES;
+        }
+        
+        // Attributes can differ cell to cell, so write runs of equal attribute
+        for (uint16_t start = 0; start < length; ) {
+            uint16_t stop = start;
+            while (stop < length && row[stop].attr == row[start].attr && stop - start < BROADCAST_ROW_MAX) {
+                chars[stop - start] = row[stop].ch;
+                stop++;
+            }
+            FrameWriteCells((SHORT)(x + start), (SHORT)y, chars, stop - start, row[start].attr);
+            start = stop;
+        }
+    }
+    
+    return TRUE;
+}
+
+// Copy the whole mirror into a freshly resized frame buffer
+static void BlitViewerMirror(_In_ const ViewerState* viewer) {
+    if (!viewer->mirror) {
+        return;
+    }
+    
+    for (SHORT y = 0; y < viewer->height && y < g_frame.height; y++) {
+        const FrameCell* row = viewer->mirror + (size_t)y * viewer->width;
+        SHORT width = viewer->width < g_frame.width ? viewer->width : g_frame.width;
+        memcpy(g_frame.cells + (size_t)y * g_frame.width, row, (size_t)width * sizeof(FrameCell));
+    }
+    InvalidateFrameRect(0, 0, g_frame.width, g_frame.height);
+}
+
+// /view: mirror a /serve instance. No clock of our own: the viewer only
+// applies frame messages and repaints its console when it resizes.
+static int RunViewer(void) {
+    BroadcastHandle server = BroadcastConnect(g_viewPath);
+    if (server == BROADCAST_INVALID_HANDLE) {
+        fwprintf(stderr, L"Error: Could not connect to %ls\n", g_viewPath);
+        return 1;
+    }
+    
+    if (!InitConsole()) {
+        BroadcastClose(server);
+        return 1;
+    }
+    
+    HideCursor(TRUE);
+    CheckConsoleResize();
+    g_contentAttribute = g_geometry.attributes;
+    g_backend->ClearScreen(&g_geometry);
+    ResizeFrameBuffer();
+    FlushFrame();
+    DiscardPendingInput();
+    StartInputReader();
+    
+    ViewerState viewer = { 0 };
+    int result = 0;
+    
+    while (!g_quitRequested) {
+        if (ProcessConsoleInput()) {
+            CheckConsoleResize();
+            ResizeFrameBuffer();
+            BlitViewerMirror(&viewer);
+            FlushFrame();
+        }
+        
+        if (viewer.capacity - viewer.length < VIEWER_RECEIVE_BYTES) {
+            size_t capacity = viewer.capacity + VIEWER_RECEIVE_BYTES;
+            unsigned char* buffer = (unsigned char*)realloc(viewer.buffer, capacity);
+            if (!buffer) {
+                result = 1;
+                break;
+            }
+            viewer.buffer = buffer;
+            viewer.capacity = capacity;
+        }
+        
+        long received = BroadcastReceive(
+            server, 
+            viewer.buffer + viewer.length, 
+            viewer.capacity - viewer.length, 
+            BROADCAST_ACCEPT_MS
+        );
+        if (received < 0) {
+            break;  // Server went away
+        }
+        viewer.length += (size_t)received;
+        
+        // Apply every complete message; keep a partial one for next time
+        size_t consumed = 0;
+        BOOL applied = FALSE;
+        while (viewer.length - consumed >= sizeof(BroadcastHeader)) {
+            BroadcastHeader header;
+            memcpy(&header, viewer.buffer + consumed, sizeof(header));
+            if (header.magic != BROADCAST_MAGIC || header.length > VIEWER_MESSAGE_MAX) {
+                fwprintf(stderr, L"Error: Unexpected data from %ls\n", g_viewPath);
+                result = 1;
+                g_quitRequested = 1;
+                break;
+            }
+            if (viewer.length - consumed < sizeof(header) + header.length) {
+                break;
+            }
+            if (!ApplyBroadcastMessage(&viewer, &header, viewer.buffer + consumed + sizeof(header))) {
+                fwprintf(stderr, L"Error: Malformed frame from %ls\n", g_viewPath);
+                result = 1;
+                g_quitRequested = 1;
+                break;
+            }
+            consumed += sizeof(header) + header.length;
+            applied = TRUE;
+        }
+        
+        if (consumed > 0) {
+            memmove(viewer.buffer, viewer.buffer + consumed, viewer.length - consumed);
+            viewer.length -= consumed;
+        }
+        if (applied) {
+            FlushFrame();
+        }
+    }
+    
+    StopInputReader();
+    HideCursor(FALSE);
+    FreeFrameBuffer();
+    ShutdownConsole();
+    BroadcastClose(server);
+    free(viewer.mirror);
+    free(viewer.buffer);
+    return result;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI BroadcastThreadMain(_In_ LPVOID param) {
+    UNREFERENCED_PARAMETER(param);
+    RunBroadcastServer();
+    return 0;
+}
+
+// Create one listening instance of the server's pipe. PIPE_NOWAIT makes
+// ConnectNamedPipe poll and WriteFile take only what fits in the buffer.
+static HANDLE CreateBroadcastPipe(void) {
+    return CreateNamedPipeW(
+        g_broadcast.pipeName,
+        PIPE_ACCESS_OUTBOUND,
+        PIPE_TYPE_BYTE | PIPE_NOWAIT,
+        PIPE_UNLIMITED_INSTANCES,
+        BROADCAST_PIPE_BUFFER,
+        0,
+        0,
+        NULL
+    );
+}
+
+// Bare names go under \\.\pipe\ so /serve clock and /view clock match
+static void GetBroadcastPipeName(
+    _In_z_ const wchar_t* path, 
+    _Out_writes_(BROADCAST_PATH_MAX) wchar_t* name
+) {
+    if (_wcsnicmp(path, L"\\\\.\\pipe\\", 9) == 0) {
+        wcsncpy_s(name, BROADCAST_PATH_MAX, path, _TRUNCATE);
+    } else {
+        swprintf(name, BROADCAST_PATH_MAX, L"\\\\.\\pipe\\%ls", path);
+    }
+}
+
+static BroadcastHandle BroadcastListen(_In_z_ const wchar_t* path) {
+    GetBroadcastPipeName(path, g_broadcast.pipeName);
+    return CreateBroadcastPipe();
+}
+
+// A connected instance becomes the viewer's handle; a fresh one listens
+static BroadcastHandle BroadcastAccept(void) {
+    if (g_broadcast.listener == INVALID_HANDLE_VALUE) {
+        g_broadcast.listener = CreateBroadcastPipe();
+        if (g_broadcast.listener == INVALID_HANDLE_VALUE) {
+            return BROADCAST_INVALID_HANDLE;
+        }
+    }
+    
+    if (ConnectNamedPipe(g_broadcast.listener, NULL)) {
+        return BROADCAST_INVALID_HANDLE;  // Instance reset, now listening
+    }
+    
+    DWORD error = GetLastError();
+    if (error == ERROR_NO_DATA) {
+        // Client connected and left before we saw it
+        DisconnectNamedPipe(g_broadcast.listener);
+        return BROADCAST_INVALID_HANDLE;
+    }
+    if (error != ERROR_PIPE_CONNECTED) {
+        return BROADCAST_INVALID_HANDLE;
+    }
+    
+    HANDLE viewer = g_broadcast.listener;
+    g_broadcast.listener = CreateBroadcastPipe();
+    return viewer;
+}
+
+// Bytes written (0 if the pipe is full), or -1 once the viewer is gone
+static long BroadcastSend(_In_ BroadcastHandle handle, _In_reads_(length) const void* data, _In_ size_t length) {
+    DWORD written = 0;
+    DWORD chunk = length > 0x10000000 ? 0x10000000 : (DWORD)length;
+    if (!WriteFile(handle, data, chunk, &written, NULL)) {
+        return -1;
+    }
+    return (long)written;
+}
+
+static void BroadcastCloseListener(void) {
+    if (g_broadcast.listener != INVALID_HANDLE_VALUE) {
+        CloseHandle(g_broadcast.listener);
+        g_broadcast.listener = INVALID_HANDLE_VALUE;
+    }
+}
+
+static BroadcastHandle BroadcastConnect(_In_z_ const wchar_t* path) {
+    wchar_t name[BROADCAST_PATH_MAX];
+    GetBroadcastPipeName(path, name);
+    return CreateFileW(name, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, NULL);
+}
+
+// Wait up to timeoutMs for frame data, returning early for queued input.
+// Returns bytes read, 0 on timeout, or -1 once the server is gone.
+static long BroadcastReceive(
+    _In_ BroadcastHandle handle,
+    _Out_writes_(size) void* data,
+    _In_ size_t size,
+    _In_ DWORD timeoutMs
+) {
+    DWORD waited = 0;
+    
+    for (;;) {
+        DWORD available = 0;
+        if (!PeekNamedPipe(handle, NULL, 0, NULL, &available, NULL)) {
+            return -1;
+        }
+        if (available > 0) {
+            DWORD bytesRead = 0;
+            DWORD chunk = available < size ? available : (DWORD)size;
+            if (!ReadFile(handle, data, chunk, &bytesRead, NULL)) {
+                return -1;
+            }
+            return (long)bytesRead;
+        }
+        
+        if (waited >= timeoutMs || g_quitRequested) {
+            return 0;
+        }
+        if (g_input.running) {
+            if (WaitForSingleObject(g_input.ready, BROADCAST_RETRY_MS) == WAIT_OBJECT_0) {
+                return 0;
+            }
+        } else {
+            Sleep(BROADCAST_RETRY_MS);
+        }
+        waited += BROADCAST_RETRY_MS;
+    }
+}
+
+static void BroadcastClose(_In_ BroadcastHandle handle) {
+    CloseHandle(handle);
+}
+#else
+static void* BroadcastThreadMain(void* param) {
+    UNREFERENCED_PARAMETER(param);
+    
+    // Leave SIGWINCH and quit signals to the main loop
+    sigset_t blocked;
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_BLOCK, &blocked, NULL);
+    
+    RunBroadcastServer();
+    return NULL;
+}
+
+static BOOL SetBroadcastAddress(_In_z_ const wchar_t* path, _Out_ struct sockaddr_un* address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    return JournalPathBytes(path, address->sun_path, sizeof(address->sun_path));
+}
+
+static BroadcastHandle BroadcastListen(_In_z_ const wchar_t* path) {
+    struct sockaddr_un address;
+    struct stat info;
+    
+    if (!SetBroadcastAddress(path, &address)) {
+        return BROADCAST_INVALID_HANDLE;
+    }
+    
+    // A socket left by a server that crashed would block bind; never remove
+    // anything that is not a socket
+    if (lstat(address.sun_path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(address.sun_path);
+    }
+    
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        return BROADCAST_INVALID_HANDLE;
+    }
+    if (bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listener, BROADCAST_MAX_VIEWERS) != 0) {
+        close(listener);
+        return BROADCAST_INVALID_HANDLE;
+    }
+    
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+    fcntl(listener, F_SETFD, FD_CLOEXEC);
+    strcpy(g_broadcast.socketPath, address.sun_path);
+    
+    // A viewer closing mid-write must be an EPIPE, not a fatal signal
+    signal(SIGPIPE, SIG_IGN);
+    return listener;
+}
+
+static BroadcastHandle BroadcastAccept(void) {
+    int viewer = accept(g_broadcast.listener, NULL, NULL);
+    if (viewer < 0) {
+        return BROADCAST_INVALID_HANDLE;
+    }
+    fcntl(viewer, F_SETFL, fcntl(viewer, F_GETFL) | O_NONBLOCK);
+    fcntl(viewer, F_SETFD, FD_CLOEXEC);
+    return viewer;
+}
+
+// Bytes written (0 if the socket is full), or -1 once the viewer is gone
+static long BroadcastSend(_In_ BroadcastHandle handle, _In_reads_(length) const void* data, _In_ size_t length) {
+    ssize_t sent = send(handle, data, length, 0);
+    if (sent < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    }
+    return (long)sent;
+}
+
+static void BroadcastCloseListener(void) {
+    if (g_broadcast.listener >= 0) {
+        close(g_broadcast.listener);
+        unlink(g_broadcast.socketPath);
+        g_broadcast.listener = BROADCAST_INVALID_HANDLE;
+    }
+}
+
+static BroadcastHandle BroadcastConnect(_In_z_ const wchar_t* path) {
+    struct sockaddr_un address;
+    
+    if (!SetBroadcastAddress(path, &address)) {
+        return BROADCAST_INVALID_HANDLE;
+    }
+    
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) {
+        return BROADCAST_INVALID_HANDLE;
+    }
+    if (connect(server, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(server);
+        return BROADCAST_INVALID_HANDLE;
+    }
+    fcntl(server, F_SETFD, FD_CLOEXEC);
+    return server;
+}
+
+// Wait up to timeoutMs for frame data, returning early for terminal input
+// or signals. Returns bytes read, 0 on timeout, or -1 once the server is gone.
+static long BroadcastReceive(
+    _In_ BroadcastHandle handle,
+    _Out_writes_(size) void* data,
+    _In_ size_t size,
+    _In_ DWORD timeoutMs
+) {
+    struct pollfd fds[2];
+    nfds_t count = 0;
+    
+    fds[count].fd = handle;
+    fds[count].events = POLLIN;
+    count++;
+    if (g_wakePipe[0] >= 0) {
+        fds[count].fd = g_wakePipe[0];
+        fds[count].events = POLLIN;
+        count++;
+    }
+    
+    if (poll(fds, count, (int)timeoutMs) <= 0 || !(fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+        return 0;
+    }
+    
+    ssize_t received = recv(handle, data, size, 0);
+    if (received < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    return received > 0 ? (long)received : -1;
+}
+
+static void BroadcastClose(_In_ BroadcastHandle handle) {
+    close(handle);
+}
+#endif
+
+// Write one byte of the capture being recorded
+static void CapturePutByte(_In_ unsigned char value) {
+    putc(value, g_capture.file);
+}
+
+// Write an unsigned LEB128 varint
+static void CapturePutVarint(_In_ uint64_t value) {
+    while (value >= 0x80) {
+        CapturePutByte((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    CapturePutByte((unsigned char)value);
+}
+
+// Write a varint length and UTF-16 units (captured text is all in the BMP)
+static void CapturePutText(_In_reads_(length) const wchar_t* text, _In_ size_t length) {
+    CapturePutVarint(length);
+    for (size_t i = 0; i < length; i++) {
+        uint16_t unit = (uint16_t)text[i];
+        fwrite(&unit, sizeof(unit), 1, g_capture.file);
+    }
+}
+
+// Read an unsigned LEB128 varint from the capture being replayed
+static BOOL CaptureGetVarint(_Out_ uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (g_capture.offset >= g_capture.length) {
+            return FALSE;
+        }
+        unsigned char byte = g_capture.data[g_capture.offset++];
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// Read text written by CapturePutText, null-terminated and cut to capacity
+static BOOL CaptureGetText(_Out_writes_(capacity) wchar_t* text, _In_ size_t capacity, _Out_ size_t* length) {
+    uint64_t units;
+    *length = 0;
+    text[0] = L'\0';
+    if (!CaptureGetVarint(&units) || units > (g_capture.length - g_capture.offset) / sizeof(uint16_t)) {
+        return FALSE;
+    }
+    
+    for (uint64_t i = 0; i < units; i++) {
+        uint16_t unit;
+        memcpy(&unit, g_capture.data + g_capture.offset, sizeof(unit));
+        g_capture.offset += sizeof(unit);
+        if (*length + 1 < capacity) {
+            text[(*length)++] = (wchar_t)unit;
+        }
+    }
+    text[*length] = L'\0';
+    return TRUE;
+}
+
+// End a replay that can no longer be trusted; the loop exits on its next pass
+static void StopReplay(_In_z_ const wchar_t* problem) {
+    fwprintf(stderr, L"Error: Replay %ls at record %lu\n", problem, g_capture.records);
+    g_capture.finished = TRUE;
+    g_capture.lostStep = TRUE;
+    g_quitRequested = 1;
+}
+
+// Start on the next replayed record, which must be of the given type.
+// FALSE once the replay is over: the capture ran out, or the renderer asked
+// for a different input than the one recorded, so it is no longer
+// following the recorded run.
+static BOOL CaptureNextRecord(_In_ CaptureRecordType type) {
+    if (g_capture.finished) {
+        return FALSE;
+    }
+    
+    if (g_capture.offset >= g_capture.length) {
+        g_capture.finished = TRUE;
+        g_quitRequested = 1;
+        return FALSE;
+    }
+    
+    if (g_capture.data[g_capture.offset] != type) {
+        StopReplay(L"lost step");
+        return FALSE;
+    }
+    
+    g_capture.offset++;
+    g_capture.records++;
+    return TRUE;
+}
+
+// Pass an integer input through the capture: logged while recording,
+// replaced by the recorded value on replay
+static long long CaptureInteger(_In_ CaptureRecordType type, _In_ long long value) {
+    if (g_capture.mode == CAPTURE_RECORD) {
+        uint64_t delta = (uint64_t)value - (uint64_t)g_capture.last[type];
+        CapturePutByte((unsigned char)type);
+        CapturePutVarint((delta << 1) ^ (0 - (delta >> 63)));
+        g_capture.last[type] = value;
+    } else if (g_capture.mode == CAPTURE_REPLAY && CaptureNextRecord(type)) {
+        uint64_t zigzag;
+        if (!CaptureGetVarint(&zigzag)) {
+            StopReplay(L"ran into a damaged record");
+            return value;
+        }
+        value = (long long)((uint64_t)g_capture.last[type] + ((zigzag >> 1) ^ (0 - (zigzag & 1))));
+        g_capture.last[type] = value;
+    }
+    return value;
+}
+
+// Pass a fixed-size input through the capture
+static void CaptureBytes(_In_ CaptureRecordType type, _Inout_ void* data, _In_ size_t size) {
+    if (g_capture.mode == CAPTURE_RECORD) {
+        CapturePutByte((unsigned char)type);
+        CapturePutVarint(size);
+        fwrite(data, 1, size, g_capture.file);
+    } else if (g_capture.mode == CAPTURE_REPLAY && CaptureNextRecord(type)) {
+        uint64_t length;
+        if (!CaptureGetVarint(&length) || length != size || size > g_capture.length - g_capture.offset) {
+            StopReplay(L"ran into a damaged record");
+            return;
+        }
+        memcpy(data, g_capture.data + g_capture.offset, size);
+        g_capture.offset += size;
+    }
+}
+
+// Pass a line of text, or its absence (a failed read), through the capture.
+// Returns whether there is a line.
+static BOOL CaptureText(_Inout_ wchar_t* text, _In_ size_t capacity, _Inout_ size_t* length, _In_ BOOL present) {
+    if (g_capture.mode == CAPTURE_RECORD) {
+        CapturePutByte(CAPTURE_TEXT);
+        CapturePutVarint(present ? 1 : 0);
+        if (present) {
+            CapturePutText(text, *length);
+        }
+    } else if (g_capture.mode == CAPTURE_REPLAY && CaptureNextRecord(CAPTURE_TEXT)) {
+        uint64_t recorded;
+        if (!CaptureGetVarint(&recorded) || (recorded && !CaptureGetText(text, capacity, length))) {
+            StopReplay(L"ran into a damaged record");
+            return FALSE;
+        }
+        present = recorded != 0;
+    }
+    return present;
+}
+
+// Log the spans FlushFrame hands to the backend, or compare them with the
+// logged ones. A diverging frame is counted and the first one described;
+// the replay carries on, since the inputs after it are still good.
+static void CaptureFrame(void) {
+    if (g_capture.mode == CAPTURE_RECORD) {
+        CapturePutByte(CAPTURE_FRAME);
+        CapturePutVarint((uint64_t)g_frame.spanCount);
+        for (int i = 0; i < g_frame.spanCount; i++) {
+            const FrameSpan* span = &g_frame.spans[i];
+            const FrameCell* cells = g_frame.cells + (size_t)span->y * g_frame.width + span->x;
+            CapturePutVarint((uint64_t)span->x);
+            CapturePutVarint((uint64_t)span->y);
+            CapturePutVarint((uint64_t)span->length);
+            for (SHORT col = 0; col < span->length; col++) {
+                uint16_t cell[2] = { (uint16_t)cells[col].ch, cells[col].attr };
+                fwrite(cell, sizeof(cell), 1, g_capture.file);
             }
         }
-    } else {
-        // Clear the prompt line if read failed
-        FillConsoleOutputCharacterW(
-            g_hConsole, L' ', csbi.dwSize.X, coord, &cCharsWritten
+        return;
+    }
+    
+    if (g_capture.mode != CAPTURE_REPLAY || !CaptureNextRecord(CAPTURE_FRAME)) {
+        return;
+    }
+    
+    g_capture.frames++;
+    BOOL describe = g_capture.framesDiverged == 0;
+    BOOL diverged = FALSE;
+    uint64_t spanCount;
+    if (!CaptureGetVarint(&spanCount)) {
+        StopReplay(L"ran into a damaged record");
+        return;
+    }
+    
+    for (uint64_t i = 0; i < spanCount; i++) {
+        uint64_t x, y, length;
+        if (!CaptureGetVarint(&x) || !CaptureGetVarint(&y) || !CaptureGetVarint(&length) ||
+            length > (g_capture.length - g_capture.offset) / (2 * sizeof(uint16_t))) {
+            StopReplay(L"ran into a damaged record");
+            return;
+        }
+        const unsigned char* recorded = g_capture.data + g_capture.offset;
+        g_capture.offset += (size_t)length * 2 * sizeof(uint16_t);
+        if (diverged) {
+            continue;
+        }
+        
+        const FrameSpan* span = i < (uint64_t)g_frame.spanCount ? &g_frame.spans[i] : NULL;
+        if (!span || (uint64_t)span->x != x || (uint64_t)span->y != y || (uint64_t)span->length != length) {
+            if (describe) {
+                fwprintf(
+                    stderr,
+                    L"Replay diverged at frame %lu: span %llu recorded at %llu,%llu length %llu, drawn %ls\n",
+                    g_capture.frames,
+                    (unsigned long long)i,
+                    (unsigned long long)x,
+                    (unsigned long long)y,
+                    (unsigned long long)length,
+                    span ? L"elsewhere" : L"missing"
+                );
+            }
+            diverged = TRUE;
+            continue;
+        }
+        
+        const FrameCell* cells = g_frame.cells + (size_t)span->y * g_frame.width + span->x;
+        for (SHORT col = 0; col < span->length; col++) {
+            uint16_t cell[2];
+            memcpy(cell, recorded + (size_t)col * sizeof(cell), sizeof(cell));
+            if (cells[col].ch == (wchar_t)cell[0] && cells[col].attr == cell[1]) {
+                continue;
+            }
+            if (describe) {
+                fwprintf(
+                    stderr,
+                    L"Replay diverged at frame %lu: cell %d,%d recorded '%lc' (%04X), drawn '%lc' (%04X)\n",
+                    g_capture.frames,
+                    span->x + col,
+                    span->y,
+                    (wchar_t)cell[0],
+                    cell[1],
+                    cells[col].ch,
+                    cells[col].attr
+                );
+            }
+            diverged = TRUE;
+            break;
+        }
+    }
+    
+    if (!diverged && spanCount != (uint64_t)g_frame.spanCount) {
+        if (describe) {
+            fwprintf(
+                stderr,
+                L"Replay diverged at frame %lu: %llu spans recorded, %d drawn\n",
+                g_capture.frames,
+                (unsigned long long)spanCount,
+                g_frame.spanCount
+            );
+        }
+        diverged = TRUE;
+    }
+    if (diverged) {
+        g_capture.framesDiverged++;
+    }
+}
+
+// Next console event for the main loop; on replay, the next recorded one.
+// Each batch is logged as its events followed by a zero.
+static BOOL PopCapturedInputEvent(_Out_ InputEvent* event) {
+    BOOL popped = g_input.running && g_capture.mode != CAPTURE_REPLAY && PopInputEvent(event);
+    if (g_capture.mode == CAPTURE_OFF) {
+        return popped;
+    }
+    
+    long long encoded = popped ? (long long)event->type << 32 | (long long)(DWORD)event->key : 0;
+    encoded = CaptureInteger(CAPTURE_INPUT, encoded);
+    if (encoded == 0) {
+        return FALSE;
+    }
+    
+    if (!popped) {
+        event->type = (InputEventType)(encoded >> 32);
+        event->key = (wchar_t)(encoded & 0xFFFFFFFF);
+        event->timestamp = StatsNow();
+    }
+    return TRUE;
+}
+
+// Read a prompt line from the console, or from the capture being replayed
+static BOOL ReadPromptInput(_Out_writes_(capacity) wchar_t* buffer, _In_ DWORD capacity, _Out_ DWORD* charsRead) {
+    BOOL read = FALSE;
+    *charsRead = 0;
+    if (g_capture.mode != CAPTURE_REPLAY) {
+        read = ReadPromptLine(buffer, capacity, charsRead);
+    }
+    
+    // Prompt buffers hold capacity characters plus a terminator
+    size_t length = read ? *charsRead : 0;
+    read = CaptureText(buffer, (size_t)capacity + 1, &length, read);
+    *charsRead = (DWORD)length;
+    return read;
+}
+
+// Local time for the display and the alarm scheduler
+static void ReadLocalTime(_Out_ SYSTEMTIME* st) {
+    g_clock->GetLocal(st);
+    CaptureBytes(CAPTURE_LOCAL_TIME, st, sizeof(*st));
+}
+
+// UTC seconds for the world clock
+static long long ReadUtcSeconds(void) {
+    return CaptureInteger(CAPTURE_UTC, g_clock->GetUtc());
+}
+
+// Performance counter for the stopwatch and countdown
+static long long ReadCounter(void) {
+    return CaptureInteger(CAPTURE_COUNTER, g_clock->GetCounter());
+}
+
+// Millisecond tick count for the alarm flash
+static DWORD ReadTickCount(void) {
+    return (DWORD)CaptureInteger(CAPTURE_TICKS, g_clock->GetTicks());
+}
+
+static const CaptureFlag* FindCaptureFlag(_In_z_ const wchar_t* arg) {
+    for (size_t i = 0; i < sizeof(g_captureFlags) / sizeof(g_captureFlags[0]); i++) {
+        if (_wcsicmp(arg, g_captureFlags[i].name) == 0) {
+            return &g_captureFlags[i];
+        }
+    }
+    return NULL;
+}
+
+// Start a /record capture: the drawing flags and the alarms scheduled so
+// far, then every input from the first geometry query on
+static BOOL StartCaptureRecording(_In_z_ const wchar_t* path, _In_ int argc, _In_reads_(argc) wchar_t* argv[]) {
+    if (_wfopen_s(&g_capture.file, path, L"wb") != 0 || !g_capture.file) {
+        g_capture.file = NULL;
+        return FALSE;
+    }
+    
+    CaptureHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CAPTURE_MAGIC;
+    header.alarmCount = (uint16_t)g_alarms.count;
+    header.frequency = g_renderStats.frequency.QuadPart;
+    for (int i = 1; i < argc; i++) {
+        const CaptureFlag* flag = FindCaptureFlag(argv[i]);
+        if (flag && (!flag->takesValue || i + 1 < argc)) {
+            header.argCount += flag->takesValue ? 2 : 1;
+            i += flag->takesValue ? 1 : 0;
+        }
+    }
+    fwrite(&header, sizeof(header), 1, g_capture.file);
+    
+    for (int i = 1; i < argc; i++) {
+        const CaptureFlag* flag = FindCaptureFlag(argv[i]);
+        if (flag && (!flag->takesValue || i + 1 < argc)) {
+            CapturePutText(argv[i], wcslen(argv[i]));
+            if (flag->takesValue) {
+                i++;
+                CapturePutText(argv[i], wcslen(argv[i]));
+            }
+        }
+    }
+    
+    for (int i = 0; i < g_alarms.count; i++) {
+        const AlarmEntry* entry = g_alarms.heap[i];
+        CapturePutVarint(entry->id);
+        CapturePutVarint(entry->hour);
+        CapturePutVarint(entry->minute);
+        CapturePutVarint((uint64_t)entry->repeatDaily);
+        CapturePutVarint((uint64_t)entry->rampSpeed);
+        CapturePutVarint((uint64_t)entry->nextFire);
+        CapturePutText(entry->name, wcslen(entry->name));
+    }
+    
+    g_capture.mode = CAPTURE_RECORD;
+    return TRUE;
+}
+
+// Load a capture for /replay: re-apply its flags, schedule its alarms and
+// hand the main loop its inputs from here on
+static BOOL OpenCaptureReplay(_In_z_ const wchar_t* path) {
+    FILE* file = NULL;
+    if (_wfopen_s(&file, path, L"rb") != 0 || !file) {
+        fwprintf(stderr, L"Error: Could not open capture %ls\n", path);
+        return FALSE;
+    }
+    
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        size = ftell(file);
+    }
+    if (size >= (long)sizeof(CaptureHeader) && fseek(file, 0, SEEK_SET) == 0) {
+        g_capture.data = (unsigned char*)malloc((size_t)size);
+    }
+    if (g_capture.data && fread(g_capture.data, 1, (size_t)size, file) == (size_t)size) {
+        g_capture.length = (size_t)size;
+    }
+    fclose(file);
+    
+    CaptureHeader header;
+    if (g_capture.length > 0) {
+        memcpy(&header, g_capture.data, sizeof(header));
+    }
+    if (g_capture.length == 0 || header.magic != CAPTURE_MAGIC) {
+        fwprintf(stderr, L"Error: %ls is not a capture\n", path);
+        return FALSE;
+    }
+    if (header.frequency != g_renderStats.frequency.QuadPart) {
+        fwprintf(
+            stderr,
+            L"Error: %ls was recorded with a %lld Hz counter, this machine has %lld Hz\n",
+            path,
+            (long long)header.frequency,
+            (long long)g_renderStats.frequency.QuadPart
+        );
+        return FALSE;
+    }
+    g_capture.offset = sizeof(header);
+    
+    // Argument 0 is the program name, which ParseCommandLineArgs skips
+    g_capture.args = (wchar_t**)calloc((size_t)header.argCount + 1, sizeof(wchar_t*));
+    if (!g_capture.args) {
+        return FALSE;
+    }
+    g_capture.argCount = header.argCount + 1;
+    for (int i = 1; i < g_capture.argCount; i++) {
+        size_t length;
+        g_capture.args[i] = (wchar_t*)malloc(CAPTURE_TEXT_MAX * sizeof(wchar_t));
+        if (!g_capture.args[i] || !CaptureGetText(g_capture.args[i], CAPTURE_TEXT_MAX, &length)) {
+            fwprintf(stderr, L"Error: %ls has a damaged header\n", path);
+            return FALSE;
+        }
+    }
+    
+    for (int i = 0; i < header.alarmCount; i++) {
+        uint64_t id, hour, minute, repeatDaily, rampSpeed, nextFire;
+        wchar_t name[ALARM_NAME_LENGTH];
+        size_t length;
+        if (!CaptureGetVarint(&id) || !CaptureGetVarint(&hour) || !CaptureGetVarint(&minute) ||
+            !CaptureGetVarint(&repeatDaily) || !CaptureGetVarint(&rampSpeed) ||
+            !CaptureGetVarint(&nextFire) || !CaptureGetText(name, ALARM_NAME_LENGTH, &length) ||
+            hour > 23 || minute > 59 || rampSpeed > ALARM_RAMP_SLOW) {
+            fwprintf(stderr, L"Error: %ls has a damaged header\n", path);
+            return FALSE;
+        }
+        
+        AlarmEntry* entry = InsertAlarm(
+            (DWORD)id, (WORD)hour, (WORD)minute, repeatDaily != 0, (AlarmRampSpeed)rampSpeed, name
         );
-        FillConsoleOutputAttribute(
-            g_hConsole, normalAttribute, csbi.dwSize.X, coord, &cCharsWritten
+        if (entry) {
+            RescheduleAlarm(entry, (long long)nextFire);
+        }
+    }
+    
+    ParseCommandLineArgs(g_capture.argCount, g_capture.args);
+    
+    g_capture.mode = CAPTURE_REPLAY;
+    g_capture.replayStart = StatsNow();
+    return TRUE;
+}
+
+// Close a recording, or report how the replay went. FALSE if it diverged.
+static BOOL EndCapture(void) {
+    BOOL matched = TRUE;
+    
+    if (g_capture.mode == CAPTURE_RECORD) {
+        fclose(g_capture.file);
+        g_capture.file = NULL;
+    } else if (g_capture.mode == CAPTURE_REPLAY) {
+        double elapsedMs = (double)(StatsNow() - g_capture.replayStart) * 1000.0 / 
+                           (double)g_renderStats.frequency.QuadPart;
+        fwprintf(
+            stderr,
+            L"Replay: %lu frames in %.1f ms (%.0f frames/s), %lu diverged%ls\n",
+            g_capture.frames,
+            elapsedMs,
+            elapsedMs > 0.0 ? g_capture.frames * 1000.0 / elapsedMs : 0.0,
+            g_capture.framesDiverged,
+            g_capture.lostStep ? L", stopped early" : L""
         );
+        matched = g_capture.framesDiverged == 0 && !g_capture.lostStep;
+    }
+    
+    for (int i = 0; i < g_capture.argCount; i++) {
+        free(g_capture.args[i]);
+    }
+    free(g_capture.args);
+    free(g_capture.data);
+    g_capture.args = NULL;
+    g_capture.data = NULL;
+    g_capture.mode = CAPTURE_OFF;
+    return matched;
+}
+
+// System clock source: the OS clocks
+static void SystemClockLocal(_Out_ SYSTEMTIME* st) {
+    GetLocalTime(st);
+}
+
+static long long SystemClockUtc(void) {
+    return GetUtcSeconds();
+}
+
+static long long SystemClockCounter(void) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+static DWORD SystemClockTicks(void) {
+    return GetTickCount();
+}
+
+// Simulated clock source: everything derives from the virtual milliseconds
+static void SimulatedClockLocal(_Out_ SYSTEMTIME* st) {
+    long long localMs = g_simulatedTime.startMs + g_simulatedTime.elapsedMs;
+    SecondsToSystemTime(localMs / 1000, st);
+    st->wMilliseconds = (WORD)(localMs % 1000);
+}
+
+static long long SimulatedClockUtc(void) {
+    return (g_simulatedTime.startMs + g_simulatedTime.elapsedMs) / 1000 - g_simulatedTime.utcOffset;
+}
+
+// Counter ticks since the start, split so that years of nanosecond ticks
+// do not overflow
+static long long SimulatedClockCounter(void) {
+    long long frequency = g_renderStats.frequency.QuadPart;
+    long long elapsedMs = g_simulatedTime.elapsedMs;
+    return elapsedMs * (frequency / 1000) + elapsedMs * (frequency % 1000) / 1000;
+}
+
+static DWORD SimulatedClockTicks(void) {
+    return g_simulatedTime.tickStart + (DWORD)g_simulatedTime.elapsedMs;
+}
+
+// Switch to simulated time, starting from the current local time so alarms
+// scheduled from the command line line up with it
+static void StartSimulatedClock(void) {
+    SYSTEMTIME now;
+    GetLocalTime(&now);
+    
+    long long localSeconds = DaysFromCivil(now.wYear, now.wMonth, now.wDay) * SECONDS_PER_DAY +
+                             now.wHour * 3600 + now.wMinute * 60 + now.wSecond;
+    g_simulatedTime.startMs = localSeconds * 1000 + now.wMilliseconds;
+    g_simulatedTime.elapsedMs = 0;
+    g_simulatedTime.utcOffset = localSeconds - GetUtcSeconds();
+    g_simulatedTime.tickStart = SOAK_TICK_START;
+    g_clock = &g_simulatedClock;
+}
+
+// Format a scheduler minute stamp for a soak report
+static void FormatSoakMinute(_In_ long long stamp, _Out_writes_(SOAK_TIME_LENGTH) wchar_t* text) {
+    SYSTEMTIME st;
+    SecondsToSystemTime(stamp * 60, &st);
+    swprintf(
+        text, SOAK_TIME_LENGTH, L"%04u-%02u-%02u %02u:%02u",
+        st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute
+    );
+}
+
+// Only the first few faults are worth spelling out
+static BOOL SoakShouldReport(void) {
+    return g_soak.faultsReported++ < SOAK_FAULT_REPORT_MAX;
+}
+
+// Check an alarm firing against the occurrence the soak expected of it.
+// Called before the scheduler reschedules or removes the entry.
+static void SoakRecordFire(_In_ const AlarmEntry* entry, _In_ long long now) {
+    SoakAlarm* alarm = NULL;
+    for (int i = 0; i < g_soak.alarmCount; i++) {
+        if (g_soak.alarms[i].id == entry->id) {
+            alarm = &g_soak.alarms[i];
+            break;
+        }
+    }
+    if (!alarm) {
+        return;
+    }
+    
+    g_soak.fires++;
+    alarm->fires++;
+    if (now == alarm->expected) {
+        alarm->expected = alarm->repeatDaily ? now + MINUTES_PER_DAY : LLONG_MAX;
+        return;
+    }
+    
+    wchar_t fired[SOAK_TIME_LENGTH];
+    wchar_t expected[SOAK_TIME_LENGTH];
+    FormatSoakMinute(now, fired);
+    if (now < alarm->expected) {
+        // A second firing for an occurrence already served
+        g_soak.early++;
+        if (SoakShouldReport()) {
+            fwprintf(stderr, L"Soak: alarm %lu fired again at %ls\n", alarm->id, fired);
+        }
+        return;
+    }
+    
+    g_soak.late++;
+    if (SoakShouldReport()) {
+        FormatSoakMinute(alarm->expected, expected);
+        fwprintf(stderr, L"Soak: alarm %lu due %ls fired late at %ls\n", alarm->id, expected, fired);
+    }
+    if (alarm->repeatDaily) {
+        do {
+            alarm->expected += MINUTES_PER_DAY;
+        } while (alarm->expected <= now);
+    } else {
+        alarm->expected = LLONG_MAX;
+    }
+}
+
+// The audio worker's side of PostAudioCommand during a soak
+static void SoakAudioCommand(_In_ const AudioCommand* command) {
+    if (command->type == AUDIO_CMD_START_RAMP) {
+        g_soak.rings++;
+        g_soak.burstFrequency = 0;
+        g_soak.reachedFull = FALSE;
+    }
+    ApplyAudioCommand(&g_soak.ramp, command);
+}
+
+// Play, silently, every tone the audio worker would have played by now.
+// Within a ramp speed bursts may only climb, and once the ramp duration has
+// passed every burst must be at full intensity. Nobody presses Alt+X in a
+// soak, so a ring is silenced a little while after it got there.
+static void SoakAdvanceRamp(void) {
+    AudioRampState* ramp = &g_soak.ramp;
+    DWORD now = g_clock->GetTicks();
+    
+    while (ramp->ringing && now - ramp->lastToneTime >= ramp->toneDelayMs) {
+        BOOL burstStart = ramp->tonesLeft == 0;
+        DWORD toneTime = ramp->lastToneTime + ramp->toneDelayMs;
+        DWORD frequency = NextAlarmTone(ramp, toneTime);
+        g_soak.tones++;
+        if (!burstStart) {
+            continue;
+        }
+        
+        g_soak.bursts++;
+        DWORD rampMs = GetRampDurationMs(ramp->rampSpeed);
+        DWORD fullFrequency;
+        int fullTones;
+        ComputeAlarmBurst(rampMs, ramp->rampSpeed, &fullFrequency, &fullTones);
+        
+        const wchar_t* fault = NULL;
+        if (ramp->rampSpeed == g_soak.burstSpeed && frequency < g_soak.burstFrequency) {
+            fault = L"fell back";
+        } else if (toneTime - ramp->ringStartTime >= rampMs &&
+                   (frequency != fullFrequency || ramp->tonesLeft + 1 != fullTones)) {
+            fault = L"missed full intensity";
+        }
+        if (fault) {
+            g_soak.rampFaults++;
+            if (SoakShouldReport()) {
+                fwprintf(
+                    stderr, L"Soak: ramp %ls %lu ms into a ring: %lu Hz x %d\n",
+                    fault, toneTime - ramp->ringStartTime, frequency, ramp->tonesLeft + 1
+                );
+            }
+        }
+        
+        if (frequency == fullFrequency && !g_soak.reachedFull) {
+            g_soak.reachedFull = TRUE;
+            g_soak.fullSince = toneTime;
+        }
+        g_soak.burstSpeed = ramp->rampSpeed;
+        g_soak.burstFrequency = frequency;
+    }
+    
+    if (g_alarmState.isRinging && g_soak.reachedFull && now - g_soak.fullSince >= SOAK_RING_TAIL_MS) {
+        HandleHotkey(L'X');
+    }
+}
+
+// Alarms for a soak given none: the first and last minutes of the day, two
+// alarms sharing a minute with different ramps, and a one-shot
+static void AddSoakAlarms(void) {
+    AddAlarm(0, 0, TRUE, ALARM_RAMP_MODERATE, L"midnight");
+    AddAlarm(23, 59, TRUE, ALARM_RAMP_SLOW, L"last minute");
+    AddAlarm(7, 30, TRUE, ALARM_RAMP_FAST, L"wake");
+    AddAlarm(7, 30, TRUE, ALARM_RAMP_SLOW, L"wake again");
+    AddAlarm(12, 0, FALSE, ALARM_RAMP_FAST, L"noon");
+}
+
+// /soak DAYS: run the alarm scheduler and the ramp through that many days
+// of simulated time, one main loop pass per simulated second, and check
+// every alarm fired exactly once per occurrence. Returns 1 on any fault.
+static int RunAlarmSoak(void) {
+    // The soak's firings and removals are not the user's to keep
+    CloseAlarmJournal();
+    StartSimulatedClock();
+    
+    if (g_alarms.count == 0) {
+        AddSoakAlarms();
+    }
+    
+    g_soak.alarms = (SoakAlarm*)calloc((size_t)g_alarms.count, sizeof(SoakAlarm));
+    if (!g_soak.alarms) {
+        fwprintf(stderr, L"Error: Out of memory for the soak\n");
+        return 1;
+    }
+    
+    // Each alarm owes the occurrence it is scheduled for, which must fall
+    // on its own minute of the day
+    for (int i = 0; i < g_alarms.count; i++) {
+        const AlarmEntry* entry = g_alarms.heap[i];
+        SoakAlarm* alarm = &g_soak.alarms[g_soak.alarmCount++];
+        alarm->id = entry->id;
+        alarm->repeatDaily = entry->repeatDaily;
+        alarm->expected = entry->nextFire;
+        if (entry->nextFire % MINUTES_PER_DAY != entry->hour * 60 + entry->minute) {
+            g_soak.late++;
+            if (SoakShouldReport()) {
+                wchar_t scheduled[SOAK_TIME_LENGTH];
+                FormatSoakMinute(entry->nextFire, scheduled);
+                fwprintf(
+                    stderr, L"Soak: alarm %lu for %02u:%02u scheduled at %ls\n",
+                    entry->id, entry->hour, entry->minute, scheduled
+                );
+            }
+        }
+    }
+    g_soak.running = TRUE;
+    
+    SYSTEMTIME st;
+    long long steps = (long long)g_soakDays * SECONDS_PER_DAY * 1000 / SOAK_STEP_MS;
+    long long start = StatsNow();
+    for (long long step = 0; step < steps; step++) {
+        g_simulatedTime.elapsedMs += SOAK_STEP_MS;
+        
+        // Tones due before this pass play first, as on the worker thread
+        SoakAdvanceRamp();
+        ReadLocalTime(&st);
+        CheckAlarmTime(&st);
+    }
+    double elapsedMs = (double)(StatsNow() - start) * 1000.0 / (double)g_renderStats.frequency.QuadPart;
+    
+    // Whatever is still owed from inside the simulated span was missed
+    long long end = GetLocalMinuteStamp(&st);
+    for (int i = 0; i < g_soak.alarmCount; i++) {
+        const SoakAlarm* alarm = &g_soak.alarms[i];
+        if (alarm->expected > end) {
+            continue;
+        }
+        
+        DWORD missed = alarm->repeatDaily ? (DWORD)((end - alarm->expected) / MINUTES_PER_DAY + 1) : 1;
+        g_soak.missed += missed;
+        if (SoakShouldReport()) {
+            wchar_t expected[SOAK_TIME_LENGTH];
+            FormatSoakMinute(alarm->expected, expected);
+            fwprintf(stderr, L"Soak: alarm %lu missed %lu occurrences from %ls\n", alarm->id, missed, expected);
+        }
+    }
+    g_soak.running = FALSE;
+    
+    fwprintf(
+        stderr,
+        L"Soak: %d days, %lld ticks of %d ms in %.1f ms (%.0f ticks/s)\n",
+        g_soakDays,
+        steps,
+        SOAK_STEP_MS,
+        elapsedMs,
+        elapsedMs > 0.0 ? steps * 1000.0 / elapsedMs : 0.0
+    );
+    fwprintf(
+        stderr,
+        L"Soak: %d alarms, %lu fires, %lu missed, %lu late, %lu early\n",
+        g_soak.alarmCount, g_soak.fires, g_soak.missed, g_soak.late, g_soak.early
+    );
+    fwprintf(
+        stderr,
+        L"Soak: %lu rings, %lu bursts, %lu tones, %lu ramp faults\n",
+        g_soak.rings, g_soak.bursts, g_soak.tones, g_soak.rampFaults
+    );
+    
+    BOOL passed = g_soak.missed == 0 && g_soak.late == 0 && g_soak.early == 0 && g_soak.rampFaults == 0;
+    free(g_soak.alarms);
+    g_soak.alarms = NULL;
+    g_clock = &g_systemClock;
+    return passed ? 0 : 1;
+}
+
+// Work out one burst of the ramp: pitch rises and the burst gets longer
+// (more tones = louder) as the alarm keeps ringing
+static void ComputeAlarmBurst(
+    _In_ DWORD elapsedMs,
+    _In_ AlarmRampSpeed speed,
+    _Out_ DWORD* frequency,
+    _Out_ int* toneCount
+) {
+    DWORD rampDurationMs = GetRampDurationMs(speed);
+    
+    // Calculate intensity (0.0 to 1.0) based on elapsed time
+    float intensity = (float)elapsedMs / (float)rampDurationMs;
+    if (intensity > 1.0f) {
+        intensity = 1.0f;
     }
     
-    // Hide cursor again
-    HideCursor(TRUE);
+    // Beep frequency constants
+    const DWORD baseFrequency = 800;      // Base frequency in Hz
+    const DWORD maxFrequency = 2000;      // Max frequency in Hz
     
-    // Update alarm status display
-    PrintAlarmStatusLine();
+    *frequency = (DWORD)(baseFrequency + (maxFrequency - baseFrequency) * intensity);
+    *toneCount = 1 + (int)(intensity * 4);  // 1 to 5 beeps
+}
+
+#ifdef _WIN32
+static DWORD WINAPI AudioThreadMain(_In_ LPVOID param) {
+    UNREFERENCED_PARAMETER(param);
+    RunAudioWorker();
+    return 0;
+}
+#else
+static void* AudioThreadMain(void* param) {
+    UNREFERENCED_PARAMETER(param);
+    
+    // Leave SIGWINCH and quit signals to the main loop
+    sigset_t blocked;
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_BLOCK, &blocked, NULL);
+    
+    RunAudioWorker();
+    return NULL;
 }
+#endif
 
-// Check keyboard input for hotkeys
-static void CheckKeyboardInput(void) {
-    if (g_hInput == INVALID_HANDLE_VALUE) {
+// Start the audio worker thread and its command queue
+static BOOL StartAudioWorker(void) {
+    InitializeCriticalSection(&g_audioQueue.lock);
+    InitializeConditionVariable(&g_audioQueue.wake);
+    g_audioQueue.head = 0;
+    g_audioQueue.count = 0;
+    
+#ifdef _WIN32
+    g_audioThread = CreateThread(NULL, 0, AudioThreadMain, NULL, 0, NULL);
+    g_audioQueue.running = (g_audioThread != NULL);
+#else
+    g_audioQueue.running = (pthread_create(&g_audioThread, NULL, AudioThreadMain, NULL) == 0);
+#endif
+    
+    if (!g_audioQueue.running) {
+        DeleteCriticalSection(&g_audioQueue.lock);
+    }
+    return g_audioQueue.running;
+}
+
+// Silence any alarm, stop the audio worker and wait for it to exit
+static void StopAudioWorker(void) {
+    if (!g_audioQueue.running) {
         return;
     }
     
-    INPUT_RECORD irInBuf[32];
-    DWORD cNumRead;
+    PostAudioCommand(AUDIO_CMD_QUIT);
+    
+#ifdef _WIN32
+    WaitForSingleObject(g_audioThread, INFINITE);
+    CloseHandle(g_audioThread);
+    g_audioThread = NULL;
+#else
+    pthread_join(g_audioThread, NULL);
+#endif
+    
+    g_audioQueue.running = FALSE;
+    DeleteCriticalSection(&g_audioQueue.lock);
+}
+
+// Queue a command for the audio worker, carrying the current alarm settings
+static void PostAudioCommand(_In_ AudioCommandType type) {
+    AudioCommand command;
+    command.type = type;
+    command.rampSpeed = g_alarmState.rampSpeed;
+    command.ringStartTime = g_alarmState.ringStartTime;
     
-    if (!PeekConsoleInput(g_hInput, irInBuf, 32, &cNumRead)) {
+    // A soak has no audio thread and plays the worker's part itself
+    if (g_soak.running) {
+        SoakAudioCommand(&command);
         return;
     }
-    
-    if (cNumRead == 0) {
+    if (!g_audioQueue.running) {
         return;
     }
     
-    BOOL shouldRead = FALSE;
+    EnterCriticalSection(&g_audioQueue.lock);
     
-    for (DWORD i = 0; i < cNumRead; i++) {
-        if (irInBuf[i].EventType == KEY_EVENT && irInBuf[i].Event.KeyEvent.bKeyDown) {
-            KEY_EVENT_RECORD* ker = &irInBuf[i].Event.KeyEvent;
-            
-            // Check for Alt+A (set alarm)
-            if ((ker->dwControlKeyState & (LEFT_ALT_PRESSED | RIGHT_ALT_PRESSED)) &&
-                (ker->wVirtualKeyCode == 'A' || ker->wVirtualKeyCode == 'a')) {
-                shouldRead = TRUE;
-                // Read all input to clear buffer
-                ReadConsoleInput(g_hInput, irInBuf, cNumRead, &cNumRead);
-                PromptForAlarm();
-                break;
+    // Later commands supersede earlier ones, so a full queue drops its oldest
+    if (g_audioQueue.count == AUDIO_QUEUE_CAPACITY) {
+        g_audioQueue.head = (g_audioQueue.head + 1) % AUDIO_QUEUE_CAPACITY;
+        g_audioQueue.count--;
+    }
+    
+    int tail = (g_audioQueue.head + g_audioQueue.count) % AUDIO_QUEUE_CAPACITY;
+    g_audioQueue.commands[tail] = command;
+    g_audioQueue.count++;
+    
+    WakeConditionVariable(&g_audioQueue.wake);
+    LeaveCriticalSection(&g_audioQueue.lock);
+}
+
+// Update the worker's ramp state for one queued command
+static void ApplyAudioCommand(_Inout_ AudioRampState* ramp, _In_ const AudioCommand* command) {
+    switch (command->type) {
+        case AUDIO_CMD_START_RAMP:
+            ramp->ringing = TRUE;
+            ramp->rampSpeed = command->rampSpeed;
+            ramp->ringStartTime = command->ringStartTime;
+            ramp->tonesLeft = 0;
+            ramp->lastToneTime = g_clock->GetTicks();
+            ramp->toneDelayMs = 0;  // First burst starts immediately
+            break;
+        case AUDIO_CMD_SET_RAMP:
+            // Takes effect from the next burst
+            ramp->rampSpeed = command->rampSpeed;
+            break;
+        case AUDIO_CMD_STOP:
+        case AUDIO_CMD_QUIT:
+            ramp->ringing = FALSE;
+            ramp->tonesLeft = 0;
+            break;
+    }
+}
+
+// Take the next tone of the current burst and schedule the one after it.
+// Returns the tone's frequency.
+static DWORD NextAlarmTone(_Inout_ AudioRampState* ramp, _In_ DWORD currentTime) {
+    if (ramp->tonesLeft == 0) {
+        ComputeAlarmBurst(
+            currentTime - ramp->ringStartTime,
+            ramp->rampSpeed,
+            &ramp->frequency,
+            &ramp->tonesLeft
+        );
+        ramp->burstStartTime = currentTime;
+    }
+    
+    ramp->tonesLeft--;
+    ramp->lastToneTime = currentTime;
+    
+    if (ramp->tonesLeft > 0) {
+        // Small gap between tones of the same burst
+        ramp->toneDelayMs = ALARM_TONE_DURATION_MS + ALARM_TONE_GAP_MS;
+    } else {
+        // Bursts start every 500ms, but never before this tone has finished
+        DWORD burstElapsedMs = currentTime - ramp->burstStartTime;
+        ramp->toneDelayMs = ALARM_TONE_DURATION_MS;
+        if (burstElapsedMs + ALARM_TONE_DURATION_MS < ALARM_BEEP_INTERVAL_MS) {
+            ramp->toneDelayMs = ALARM_BEEP_INTERVAL_MS - burstElapsedMs;
+        }
+    }
+    return ramp->frequency;
+}
+
+// Play the next tone of the current burst
+static void PlayNextAlarmTone(_Inout_ AudioRampState* ramp) {
+    PlayTone(NextAlarmTone(ramp, g_clock->GetTicks()), ALARM_TONE_DURATION_MS);
+}
+
+// Audio worker: sleep until the next tone is due or a command arrives.
+// Tones are played outside the lock so posting a command never blocks.
+static void RunAudioWorker(void) {
+    AudioRampState ramp = { 0 };
+    BOOL quit = FALSE;
+    
+    EnterCriticalSection(&g_audioQueue.lock);
+    while (!quit) {
+        if (g_audioQueue.count == 0) {
+            DWORD waitMs = INFINITE;
+            if (ramp.ringing) {
+                DWORD sinceToneMs = g_clock->GetTicks() - ramp.lastToneTime;
+                waitMs = sinceToneMs < ramp.toneDelayMs ? ramp.toneDelayMs - sinceToneMs : 0;
             }
-            
-            // Check for Alt+X (abort alarm)
-            if ((ker->dwControlKeyState & (LEFT_ALT_PRESSED | RIGHT_ALT_PRESSED)) &&
-                (ker->wVirtualKeyCode == 'X' || ker->wVirtualKeyCode == 'x')) {
-                shouldRead = TRUE;
-                // Read all input to clear buffer
-                ReadConsoleInput(g_hInput, irInBuf, cNumRead, &cNumRead);
-                
-                if (g_alarmState.isRinging) {
-                    g_alarmState.isRinging = FALSE;
-                    // If not repeating, disable alarm after user stops it
-                    if (!g_alarmState.repeatDaily) {
-                        g_alarmState.isActive = FALSE;
-                    }
-                    PrintAlarmStatusLine();
-                }
-                break;
+            if (waitMs > 0) {
+                SleepConditionVariableCS(&g_audioQueue.wake, &g_audioQueue.lock, waitMs);
             }
         }
+        
+        while (g_audioQueue.count > 0) {
+            AudioCommand command = g_audioQueue.commands[g_audioQueue.head];
+            g_audioQueue.head = (g_audioQueue.head + 1) % AUDIO_QUEUE_CAPACITY;
+            g_audioQueue.count--;
+            ApplyAudioCommand(&ramp, &command);
+            if (command.type == AUDIO_CMD_QUIT) {
+                quit = TRUE;
+            }
+        }
+        
+        if (quit || !ramp.ringing ||
+            g_clock->GetTicks() - ramp.lastToneTime < ramp.toneDelayMs) {
+            continue;
+        }
+        
+        LeaveCriticalSection(&g_audioQueue.lock);
+        PlayNextAlarmTone(&ramp);
+        EnterCriticalSection(&g_audioQueue.lock);
+    }
+    LeaveCriticalSection(&g_audioQueue.lock);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI InputThreadMain(_In_ LPVOID param) {
+    UNREFERENCED_PARAMETER(param);
+    RunInputReader();
+    return 0;
+}
+#else
+static void* InputThreadMain(void* param) {
+    UNREFERENCED_PARAMETER(param);
+    
+    // Leave SIGWINCH and quit signals to the main loop
+    sigset_t blocked;
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_BLOCK, &blocked, NULL);
+    
+    RunInputReader();
+    return NULL;
+}
+#endif
+
+// Start the thread that owns console input from here on. Without it there
+// are no hotkeys, so console input is treated as unavailable.
+static BOOL StartInputReader(void) {
+    if (!g_hasConsoleInput) {
+        return FALSE;
+    }
+    
+    InitializeCriticalSection(&g_input.lock);
+    InitializeConditionVariable(&g_input.changed);
+    g_input.ring.head = 0;
+    g_input.ring.tail = 0;
+    g_input.pauseRequested = FALSE;
+    g_input.paused = FALSE;
+    g_input.quit = FALSE;
+    
+#ifdef _WIN32
+    g_input.control = CreateEventW(NULL, TRUE, FALSE, NULL);
+    g_input.ready = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (g_input.control && g_input.ready) {
+        g_inputThread = CreateThread(NULL, 0, InputThreadMain, NULL, 0, NULL);
+        g_input.running = (g_inputThread != NULL);
+    }
+    if (!g_input.running) {
+        if (g_input.control) {
+            CloseHandle(g_input.control);
+        }
+        if (g_input.ready) {
+            CloseHandle(g_input.ready);
+        }
+        g_input.control = g_input.ready = NULL;
+    }
+#else
+    if (pipe(g_input.controlPipe) == 0) {
+        for (int i = 0; i < 2; i++) {
+            fcntl(g_input.controlPipe[i], F_SETFL, fcntl(g_input.controlPipe[i], F_GETFL) | O_NONBLOCK);
+            fcntl(g_input.controlPipe[i], F_SETFD, FD_CLOEXEC);
+        }
+        g_input.running = (pthread_create(&g_inputThread, NULL, InputThreadMain, NULL) == 0);
+        if (!g_input.running) {
+            close(g_input.controlPipe[0]);
+            close(g_input.controlPipe[1]);
+        }
     }
+#endif
     
-    if (shouldRead && cNumRead > 0) {
-        // Already read above
+    if (!g_input.running) {
+        DeleteCriticalSection(&g_input.lock);
+        g_hasConsoleInput = FALSE;
+    }
+    return g_input.running;
+}
+
+// Stop the input thread and wait for it to exit
+static void StopInputReader(void) {
+    if (!g_input.running) {
         return;
     }
+    
+    EnterCriticalSection(&g_input.lock);
+    g_input.quit = TRUE;
+    WakeConditionVariable(&g_input.changed);
+    LeaveCriticalSection(&g_input.lock);
+    SignalInputReader();
+    
+#ifdef _WIN32
+    WaitForSingleObject(g_inputThread, INFINITE);
+    CloseHandle(g_inputThread);
+    g_inputThread = NULL;
+    CloseHandle(g_input.control);
+    CloseHandle(g_input.ready);
+    g_input.control = g_input.ready = NULL;
+#else
+    pthread_join(g_inputThread, NULL);
+    close(g_input.controlPipe[0]);
+    close(g_input.controlPipe[1]);
+#endif
+    
+    g_input.running = FALSE;
+    DeleteCriticalSection(&g_input.lock);
 }
 
-// Check if alarm time matches and trigger if needed
-static void CheckAlarmTime(_In_ const SYSTEMTIME* st) {
-    if (!g_alarmState.isActive || g_alarmState.isRinging) {
+// Park the input thread so a prompt can read the console itself. Returns
+// once the thread is no longer reading.
+static void PauseInputReader(void) {
+    if (!g_input.running) {
         return;
     }
     
-    // Check if current time matches alarm time
-    if (st->wHour == g_alarmState.hour && st->wMinute == g_alarmState.minute) {
-        TriggerAlarm();
+    EnterCriticalSection(&g_input.lock);
+    g_input.pauseRequested = TRUE;
+    SignalInputReader();
+    while (!g_input.paused) {
+        SleepConditionVariableCS(&g_input.changed, &g_input.lock, INFINITE);
     }
+    LeaveCriticalSection(&g_input.lock);
 }
 
-// Trigger the alarm
-static void TriggerAlarm(void) {
-    g_alarmState.isRinging = TRUE;
-    g_alarmState.ringStartTime = GetTickCount();
-    g_alarmState.lastBeepTime = 0;  // Reset beep timer
-    PrintAlarmStatusLine();
+static void ResumeInputReader(void) {
+    if (!g_input.running) {
+        return;
+    }
+    
+    EnterCriticalSection(&g_input.lock);
+    g_input.pauseRequested = FALSE;
+    WakeConditionVariable(&g_input.changed);
+    LeaveCriticalSection(&g_input.lock);
 }
 
-// Update alarm beep with volume ramping
-static void UpdateAlarmBeep(void) {
-    if (!g_alarmState.isRinging) {
-        return;
+// Called by the input thread before each blocking wait: clears the control
+// signal and parks while paused. Returns FALSE once the thread should exit.
+static BOOL InputReaderCheckpoint(void) {
+    EnterCriticalSection(&g_input.lock);
+#ifdef _WIN32
+    ResetEvent(g_input.control);
+#else
+    char drain[64];
+    while (read(g_input.controlPipe[0], drain, sizeof(drain)) > 0) {
+    }
+#endif
+    while (g_input.pauseRequested && !g_input.quit) {
+        g_input.paused = TRUE;
+        WakeConditionVariable(&g_input.changed);
+        SleepConditionVariableCS(&g_input.changed, &g_input.lock, INFINITE);
+    }
+    g_input.paused = FALSE;
+    BOOL keepReading = !g_input.quit;
+    LeaveCriticalSection(&g_input.lock);
+    return keepReading;
+}
+
+// Input thread side: queue one event. A full ring means the main loop is
+// behind, so wait for it instead of dropping anything (still honouring a
+// pause, since the main loop may be the one asking). Returns FALSE only if
+// the thread is told to quit while waiting.
+static BOOL PushInputEvent(_In_ const InputEvent* event) {
+    InputRing* ring = &g_input.ring;
+    LONG tail = ring->tail;
+    LONG next = (tail + 1) & (INPUT_RING_CAPACITY - 1);
+    LONG head = InterlockedCompareExchange(&ring->head, 0, 0);
+    
+    while (next == head) {
+        if (!InputReaderCheckpoint()) {
+            return FALSE;
+        }
+        
+        g_input.stalls++;
+        WakeMainLoop();
+#ifdef _WIN32
+        Sleep(INPUT_STALL_RETRY_MS);
+#else
+        poll(NULL, 0, INPUT_STALL_RETRY_MS);
+#endif
+        head = InterlockedCompareExchange(&ring->head, 0, 0);
     }
     
-    DWORD currentTime = GetTickCount();
+    ring->events[tail] = *event;
+    InterlockedExchange(&ring->tail, next);
     
-    // Only beep at intervals (every 500ms) to avoid constant beeping
-    const DWORD beepIntervalMs = 500;
-    if (currentTime - g_alarmState.lastBeepTime < beepIntervalMs) {
-        return;
+    DWORD queued = (DWORD)((next - head) & (INPUT_RING_CAPACITY - 1));
+    if (queued > g_input.highWater) {
+        g_input.highWater = queued;
     }
+    return TRUE;
+}
+
+// Main loop side: take the oldest queued event, if any
+static BOOL PopInputEvent(_Out_ InputEvent* event) {
+    InputRing* ring = &g_input.ring;
+    LONG head = ring->head;
     
-    g_alarmState.lastBeepTime = currentTime;
+    if (head == InterlockedCompareExchange(&ring->tail, 0, 0)) {
+        return FALSE;
+    }
     
-    DWORD elapsedMs = currentTime - g_alarmState.ringStartTime;
-    DWORD rampDurationMs = GetRampDurationMs(g_alarmState.rampSpeed);
+    *event = ring->events[head];
+    InterlockedExchange(&ring->head, (head + 1) & (INPUT_RING_CAPACITY - 1));
+    return TRUE;
+}
+
+// Dispatch everything the input thread has queued, in arrival order.
+// Returns TRUE if the console was resized.
+static BOOL ProcessConsoleInput(void) {
+    BOOL resized = FALSE;
+    long long signals = 0;
     
-    // Calculate intensity (0.0 to 1.0) based on elapsed time
-    float intensity = (float)elapsedMs / (float)rampDurationMs;
-    if (intensity > 1.0f) {
-        intensity = 1.0f;
+#ifndef _WIN32
+    if (g_resizePending) {
+        g_resizePending = 0;
+        signals |= CAPTURE_SIGNAL_RESIZE;
     }
     
-    // Beep frequency and duration constants
-    const DWORD baseFrequency = 800;      // Base frequency in Hz
-    const DWORD maxFrequency = 2000;      // Max frequency in Hz
-    const DWORD beepDuration = 200;       // Duration per beep in ms
+    // The terminal was someone else's while we were stopped
+    if (g_continuePending) {
+        g_continuePending = 0;
+        signals |= CAPTURE_SIGNAL_CONTINUE;
+    }
     
-    // Calculate current frequency based on intensity
-    DWORD currentFrequency = (DWORD)(baseFrequency + (maxFrequency - baseFrequency) * intensity);
+    if (g_wakePipe[0] >= 0) {
+        char drain[64];
+        while (read(g_wakePipe[0], drain, sizeof(drain)) > 0) {
+        }
+    }
+#endif
     
-    // Calculate number of beeps to simulate volume (more beeps = louder)
-    // At max intensity, we'll do multiple rapid beeps
-    int beepCount = 1 + (int)(intensity * 4);  // 1 to 5 beeps
+    // Like keys, signals come from the capture on replay
+    signals = CaptureInteger(CAPTURE_SIGNALS, signals);
+    if (signals & CAPTURE_SIGNAL_RESIZE) {
+        StatsMarkInput();
+        resized = TRUE;
+    }
+    if (signals & CAPTURE_SIGNAL_CONTINUE) {
+        g_power.resumePending = TRUE;
+    }
     
-    // Beep with increasing frequency/intensity
-    for (int i = 0; i < beepCount; i++) {
-        Beep(currentFrequency, beepDuration);
-        if (i < beepCount - 1) {
-            Sleep(50);  // Small gap between beeps
+    InputEvent event;
+    while (PopCapturedInputEvent(&event)) {
+        // Latency is timed from when the reader saw the event
+        g_renderStats.inputArrival = event.timestamp;
+        if (event.type == INPUT_EVENT_RESIZE) {
+            if (!resized) {
+                StatsMarkInput();
+            }
+            resized = TRUE;
+            g_power.probeDue = TRUE;
+        } else if (event.type == INPUT_EVENT_FOCUS) {
+            g_power.probeDue = TRUE;
+        } else if (event.type == INPUT_EVENT_HOTKEY) {
+            HandleHotkey(event.key);
         }
+        g_renderStats.inputArrival = 0;
     }
+    
+    return resized;
 }
 
 // Parse command-line arguments
 static void ParseCommandLineArgs(_In_ int argc, _In_ wchar_t* argv[]) {
-    BOOL repeatSet = FALSE;
+    BOOL alarmSet = FALSE;
+    WORD alarmHour = 0;
+    WORD alarmMinute = 0;
+    BOOL repeatDaily = FALSE;
     BOOL rampSet = FALSE;
+    AlarmRampSpeed rampSpeed = ALARM_RAMP_MODERATE;
+    const wchar_t* alarmFile = NULL;
+    const wchar_t* journalPath = NULL;
     
     for (int i = 1; i < argc; i++) {
         wchar_t* arg = argv[i];
@@ -976,53 +9267,198 @@ static void ParseCommandLineArgs(_In_ int argc, _In_ wchar_t* argv[]) {
             // Parse HH:MM format
             if (swscanf_s(timeStr, L"%d:%d", &hour, &minute) == 2) {
                 if (hour >= 0 && hour <= 23 && minute >= 0 && minute <= 59) {
-                    g_alarmState.hour = (WORD)hour;
-                    g_alarmState.minute = (WORD)minute;
-                    g_alarmState.isActive = TRUE;
+                    alarmHour = (WORD)hour;
+                    alarmMinute = (WORD)minute;
+                    alarmSet = TRUE;
                 }
             }
         }
         // Check for /repeat or /r flag
         else if (_wcsicmp(arg, L"/repeat") == 0 || _wcsicmp(arg, L"/r") == 0) {
-            if (!repeatSet) {
-                g_alarmState.repeatDaily = TRUE;
-                repeatSet = TRUE;
-            }
+            repeatDaily = TRUE;
         }
         // Check for /ramp flag
         else if ((_wcsicmp(arg, L"/ramp") == 0) && i + 1 < argc && !rampSet) {
             wchar_t* rampStr = argv[++i];
-            if (_wcsicmp(rampStr, L"fast") == 0) {
-                g_alarmState.rampSpeed = ALARM_RAMP_FAST;
-                rampSet = TRUE;
-            } else if (_wcsicmp(rampStr, L"moderate") == 0) {
-                g_alarmState.rampSpeed = ALARM_RAMP_MODERATE;
-                rampSet = TRUE;
-            } else if (_wcsicmp(rampStr, L"slow") == 0) {
-                g_alarmState.rampSpeed = ALARM_RAMP_SLOW;
-                rampSet = TRUE;
+            rampSet = ParseRampName(rampStr, &rampSpeed);
+        }
+        // Check for /alarms flag (file of named alarms)
+        else if (_wcsicmp(arg, L"/alarms") == 0 && i + 1 < argc) {
+            alarmFile = argv[++i];
+        }
+        // Check for /journal flag (persistent alarm store)
+        else if (_wcsicmp(arg, L"/journal") == 0 && i + 1 < argc) {
+            journalPath = argv[++i];
+        }
+        // Check for /stats flag (dump render instrumentation on exit)
+        else if (_wcsicmp(arg, L"/stats") == 0 && i + 1 < argc) {
+            g_statsPath = argv[++i];
+        }
+        // Check for /zone flag (world-clock pane, repeatable)
+        else if (_wcsicmp(arg, L"/zone") == 0 && i + 1 < argc) {
+            AddZonePane(argv[++i]);
+        }
+        // Check for /serve flag (stream frames to /view instances)
+        else if (_wcsicmp(arg, L"/serve") == 0 && i + 1 < argc) {
+            g_servePath = argv[++i];
+        }
+        // Check for /view flag (mirror a /serve instance)
+        else if (_wcsicmp(arg, L"/view") == 0 && i + 1 < argc) {
+            g_viewPath = argv[++i];
+        }
+        // Check for /record flag (capture inputs and frames for /replay)
+        else if (_wcsicmp(arg, L"/record") == 0 && i + 1 < argc) {
+            g_recordPath = argv[++i];
+        }
+        // Check for /replay flag (re-run a capture headless and compare)
+        else if (_wcsicmp(arg, L"/replay") == 0 && i + 1 < argc) {
+            g_replayPath = argv[++i];
+        }
+        // Check for /soak flag (run the alarms through DAYS of simulated time)
+        else if (_wcsicmp(arg, L"/soak") == 0 && i + 1 < argc) {
+            wchar_t* daysStr = argv[++i];
+            int days = 0;
+            if (swscanf_s(daysStr, L"%d", &days) == 1 && days > 0 && days <= SOAK_MAX_DAYS) {
+                g_soakDays = days;
+            } else {
+                fwprintf(stderr, L"Warning: Invalid /soak days %ls, expected 1 to %d\n", daysStr, SOAK_MAX_DAYS);
+            }
+        }
+        // Check for /layout flag (auto, stacked or side)
+        else if (_wcsicmp(arg, L"/layout") == 0 && i + 1 < argc) {
+            wchar_t* layoutStr = argv[++i];
+            if (!ParseLayoutName(layoutStr, &g_layoutArrangement)) {
+                fwprintf(stderr, L"Warning: Unknown layout %ls, using auto\n", layoutStr);
+                g_layoutArrangement = LAYOUT_AUTO;
+            }
+        }
+        // Check for /theme flag (plain, sunset, ocean or forest)
+        else if (_wcsicmp(arg, L"/theme") == 0 && i + 1 < argc) {
+            wchar_t* themeStr = argv[++i];
+            if (!ParseThemeName(themeStr, &g_theme)) {
+                fwprintf(stderr, L"Warning: Unknown theme %ls, using plain\n", themeStr);
+            }
+        }
+        // Check for /center flag (center the clock in the console)
+        else if (_wcsicmp(arg, L"/center") == 0) {
+            g_layoutCentered = TRUE;
+        }
+        // Check for /stopwatch flag (stopwatch in place of the clock)
+        else if (_wcsicmp(arg, L"/stopwatch") == 0) {
+            g_timer.mode = TIMER_STOPWATCH;
+        }
+        // Check for /countdown flag (countdown from [[H:]M:]S)
+        else if (_wcsicmp(arg, L"/countdown") == 0 && i + 1 < argc) {
+            wchar_t* durationStr = argv[++i];
+            if (ParseTimerDuration(durationStr, &g_timer.countdownCs)) {
+                g_timer.mode = TIMER_COUNTDOWN;
+            } else {
+                fwprintf(stderr, L"Warning: Invalid countdown %ls, expected [[H:]M:]S\n", durationStr);
+            }
+        }
+        // Check for /font flag (FIGlet .flf font for the clock glyphs)
+        else if (_wcsicmp(arg, L"/font") == 0 && i + 1 < argc) {
+            g_fontPath = argv[++i];
+        }
+        // Check for /banner flag (timestamps on stdin to banners on stdout)
+        else if (_wcsicmp(arg, L"/banner") == 0) {
+            g_bannerMode = TRUE;
+        }
+        // Check for /seconds flag (HH:MM:SS display)
+        else if (_wcsicmp(arg, L"/seconds") == 0) {
+            g_showSeconds = TRUE;
+        }
+        // Check for /render flag (headless render of a fixed time)
+        else if (_wcsicmp(arg, L"/render") == 0 && i + 1 < argc) {
+            wchar_t* timeStr = argv[++i];
+            int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+            
+            // Parse YYYY-MM-DDTHH:MM[:SS] format
+            int fields = swscanf_s(
+                timeStr, L"%d-%d-%dT%d:%d:%d", &year, &month, &day, &hour, &minute, &second
+            );
+            if (fields >= 5 &&
+                year >= 0 && year <= 9999 && month >= 1 && month <= 12 &&
+                day >= 1 && day <= 31 && hour >= 0 && hour <= 23 &&
+                minute >= 0 && minute <= 59 && second >= 0 && second <= 59) {
+                g_renderTime.wYear = (WORD)year;
+                g_renderTime.wMonth = (WORD)month;
+                g_renderTime.wDay = (WORD)day;
+                g_renderTime.wHour = (WORD)hour;
+                g_renderTime.wMinute = (WORD)minute;
+                g_renderTime.wSecond = (WORD)second;
+                g_renderRequested = TRUE;
+            } else {
+                fwprintf(stderr, L"Warning: Invalid /render time %ls\n", timeStr);
+            }
+        }
+        // Check for /rendersize flag (headless screen size, WIDTHxHEIGHT)
+        else if (_wcsicmp(arg, L"/rendersize") == 0 && i + 1 < argc) {
+            wchar_t* sizeStr = argv[++i];
+            int width = 0, height = 0;
+            if (swscanf_s(sizeStr, L"%dx%d", &width, &height) == 2 &&
+                width > 0 && width <= 1000 && height > 0 && height <= 1000) {
+                g_headless.width = (SHORT)width;
+                g_headless.height = (SHORT)height;
             }
         }
+        // Check for /framelog flag (per-frame write statistics)
+        else if (_wcsicmp(arg, L"/framelog") == 0 && i + 1 < argc) {
+            wchar_t* logPath = argv[++i];
+            if (!g_frameLog && _wfopen_s(&g_frameLog, logPath, L"w") != 0) {
+                g_frameLog = NULL;
+                fwprintf(stderr, L"Warning: Could not open frame log %ls\n", logPath);
+            }
+        }
+    }
+    
+    // Restore saved alarms first so the ones below are journaled, or
+    // recognised by id as already saved
+    if (journalPath) {
+        OpenAlarmJournal(journalPath);
     }
     
-    // Set default ramp speed if not specified
-    if (!rampSet) {
-        g_alarmState.rampSpeed = ALARM_RAMP_MODERATE;
+    if (alarmFile) {
+        LoadAlarmFile(alarmFile);
+    }
+    
+    // /alarm, /repeat and /ramp together are shorthand for one unnamed alarm
+    if (alarmSet) {
+        AddStartupAlarm(alarmHour, alarmMinute, repeatDaily, rampSpeed, L"");
     }
 }
 
 // Redraw all content
 static void RedrawAll(_In_ const SYSTEMTIME* st) {
+    ResizeFrameBuffer();
+    ComputeLayout();
+    PlaceWidgets();
+    g_themeAttributes.flashPhase = GetAlarmFlashPhase();
+    BuildThemeAttributes();
     HideCursor(TRUE);
     PrintTitleLine();
     g_displayState.initialized = FALSE;
-    PrintTimeAscii(st, 0, 3, TRUE);
-    PrintDateAscii(st, 0, 12, TRUE);
+    if (g_timer.mode != TIMER_OFF) {
+        PrintTimer(TRUE);
+    } else if (g_zonePaneCount > 0) {
+        PrintWorldClock(TRUE);
+    } else {
+        PrintTimeAscii(st, g_layout.time.x, g_layout.time.y, TRUE, &g_displayState);
+        PrintDateAscii(st, g_layout.date.x, g_layout.date.y, TRUE, &g_displayState);
+    }
     g_displayState.initialized = TRUE;
     PrintAlarmStatusLine();
+    if (g_statsOverlay) {
+        DrawStatsOverlay();
+    }
 }
 
+#ifndef _WIN32
+int wmain(int argc, wchar_t* argv[]);
+#endif
+
 int wmain(int argc, wchar_t* argv[]) {
+#ifdef _WIN32
     if (!setlocale(LC_ALL, ".UTF8")) {
         fwprintf(stderr, L"Warning: Could not set UTF-8 locale\n");
     }
@@ -1030,110 +9466,262 @@ int wmain(int argc, wchar_t* argv[]) {
     if (!SetConsoleOutputCP(CP_UTF8)) {
         fwprintf(stderr, L"Warning: Could not set console code page\n");
     }
+#endif
 
-    g_hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-    if (g_hConsole == INVALID_HANDLE_VALUE) {
-        fwprintf(
-            stderr, 
-            L"Error: Could not get console handle (error %lu)\n", 
-            GetLastError()
-        );
+    if (!ValidateGlyphAtlas()) {
         return 1;
     }
+    UseBuiltinFont();
+    
+    InitRenderStats();
 
-    g_hInput = GetStdHandle(STD_INPUT_HANDLE);
-    if (g_hInput != INVALID_HANDLE_VALUE) {
-        DWORD mode;
-        if (GetConsoleMode(g_hInput, &mode)) {
-            SetConsoleMode(g_hInput, mode | ENABLE_WINDOW_INPUT | ENABLE_PROCESSED_INPUT);
+    // Parse command-line arguments
+    ParseCommandLineArgs(argc, argv);
+    
+    // A replay runs with the recorded flags and alarms on top
+    if (g_replayPath && !OpenCaptureReplay(g_replayPath)) {
+        EndCapture();
+        CloseAlarmJournal();
+        FreeAlarmScheduler();
+        return 1;
+    }
+    
+    if (g_fontPath) {
+        LoadFont(g_fontPath);
+    }
+    
+    // A timer takes the whole clock area and always shows seconds
+    if (g_timer.mode != TIMER_OFF) {
+        if (g_zonePaneCount > 0) {
+            fwprintf(stderr, L"Warning: /zone is ignored with /stopwatch and /countdown\n");
+            FreeZonePanes();
         }
+        g_showSeconds = FALSE;
+    }
+    
+    // Headless rendering needs no console at all
+    if (g_renderRequested) {
+        int result = RunHeadlessRender();
+        DumpRenderStats();
+        CloseAlarmJournal();
+        FreeAlarmScheduler();
+        return result;
+    }
+    
+    // A soak runs the alarms on simulated time, with no console or audio
+    if (g_soakDays > 0) {
+        int result = RunAlarmSoak();
+        CloseAlarmJournal();
+        FreeAlarmScheduler();
+        return result;
+    }
+    
+    // Banner mode is a filter: no console, no clock
+    if (g_bannerMode) {
+        int result = RunBannerMode();
+        CloseAlarmJournal();
+        FreeAlarmScheduler();
+        return result;
+    }
+    
+    // A viewer only mirrors another instance's frames
+    if (g_viewPath) {
+        int result = RunViewer();
+        CloseAlarmJournal();
+        FreeAlarmScheduler();
+        return result;
     }
 
-    // Parse command-line arguments
-    ParseCommandLineArgs(argc, argv);
+    // A replay draws into memory and takes its input from the capture
+    if (g_capture.mode == CAPTURE_REPLAY) {
+        g_backend = &g_headlessBackend;
+        g_hasConsoleInput = TRUE;
+    } else if (!InitConsole()) {
+        return 1;
+    }
 
     HideCursor(TRUE);
 
+    // Alarm tones play on their own thread so they never stall the display
+    if (g_capture.mode != CAPTURE_REPLAY && !StartAudioWorker()) {
+        fwprintf(stderr, L"Warning: Could not start audio thread, alarms will be silent\n");
+    }
+
+    if (g_servePath && !StartBroadcastServer(g_servePath)) {
+        fwprintf(stderr, L"Warning: Could not serve frames on %ls\n", g_servePath);
+    }
+
+    if (g_showSeconds) {
+        BeginSecondTicker();
+    }
+    if (g_timer.mode != TIMER_OFF) {
+        BeginTimerMode();
+    }
+
+    if (g_recordPath && g_capture.mode == CAPTURE_OFF &&
+        !StartCaptureRecording(g_recordPath, argc, argv)) {
+        fwprintf(stderr, L"Warning: Could not record to %ls\n", g_recordPath);
+    }
+
     // Initialize console size tracking
     CheckConsoleResize();
 
     // Initial screen setup - clear entire screen first
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    if (GetConsoleScreenBufferInfo(g_hConsole, &csbi)) {
-        DWORD dwConSize = csbi.dwSize.X * csbi.dwSize.Y;
-        COORD coordScreen = { 0, 0 };
-        DWORD cCharsWritten;
-        
-        FillConsoleOutputCharacterW(
-            g_hConsole, 
-            L' ', 
-            dwConSize, 
-            coordScreen, 
-            &cCharsWritten
-        );
-        FillConsoleOutputAttribute(
-            g_hConsole, 
-            csbi.wAttributes, 
-            dwConSize, 
-            coordScreen, 
-            &cCharsWritten
-        );
-    }
+    g_contentAttribute = g_geometry.attributes;
+    g_backend->ClearScreen(&g_geometry);
     
-    PrintTitleLine();
-
     SYSTEMTIME st;
-    GetLocalTime(&st);
+    ReadLocalTime(&st);
     
-    // Track previous minute to detect when alarm minute passes
-    WORD lastCheckedMinute = 0xFF;
-    
-    // Initial draw
-    g_displayState.initialized = FALSE;
-    PrintTimeAscii(&st, 0, 3, TRUE);
-    PrintDateAscii(&st, 0, 12, TRUE);
-    g_displayState.initialized = TRUE;
-    PrintAlarmStatusLine();
+    // Initial draw, unless the clock starts out hidden
+    RedrawAll(&st);
+    if (!UpdateDisplayPower()) {
+        FlushFrame();
+    }
 
-    // Flush console input buffer
-    if (g_hInput != INVALID_HANDLE_VALUE) {
-        FlushConsoleInputBuffer(g_hInput);
+    // Flush console input buffer, then hand the console to the input thread
+    if (g_capture.mode != CAPTURE_REPLAY) {
+        DiscardPendingInput();
+        if (g_hasConsoleInput && !StartInputReader()) {
+            fwprintf(stderr, L"Warning: Could not start input thread, hotkeys are disabled\n");
+        }
     }
 
-    // Main loop
-    while (TRUE) {
-        // Check keyboard input for hotkeys
-        CheckKeyboardInput();
+    // Main loop - sleeps until the next minute (or second), or console input
+    while (!g_quitRequested) {
+        g_renderStats.loopWakeups++;
+        
+        // Handle hotkeys and resize events
+        BOOL resized = ProcessConsoleInput();
+        
+        // Nobody can see the clock: keep the alarms, skip the drawing
+        if (UpdateDisplayPower()) {
+            ReadLocalTime(&st);
+            CheckAlarmTime(&st);
+            CheckTimerExpiry();
+            WaitForNextPass();
+            continue;
+        }
+        
+        if (g_showSeconds && g_capture.mode != CAPTURE_REPLAY) {
+            WaitForSecondBoundary();
+        }
+        
+        long long passStart = StatsNow();
+        ReadLocalTime(&st);
+        
+        // Fire any alarms that have come due
+        CheckAlarmTime(&st);
+        CheckTimerExpiry();
+        
+        // Ringing starting, stopping or flashing recolors the time digits
+        BOOL recolor = UpdateThemePhase();
         
-        // Check for resize event
-        if (CheckForResizeEvent()) {
+        if (resized) {
             CheckConsoleResize();
-            GetLocalTime(&st);
+        }
+        
+        // Back from hidden: whatever covered the clock may have drawn over
+        // it, so repaint every cell. A resize event that left the frame size
+        // alone keeps the layout and everything already on screen.
+        if (g_power.resumePending) {
+            g_power.resumePending = FALSE;
+            RestoreConsoleModes();
+            CheckConsoleResize();
+            g_timer.shownCs = -1;
+            RedrawAll(&st);
+            InvalidateFrameRect(0, 0, g_frame.width, g_frame.height);
+        } else if (resized && !IsLayoutCurrent()) {
             RedrawAll(&st);
-            PrintAlarmStatusLine();
         } else {
-            // Normal update
-            GetLocalTime(&st);
-            
-            // Check alarm time (only once per minute to avoid repeated triggers)
-            if (st.wMinute != lastCheckedMinute) {
-                lastCheckedMinute = st.wMinute;
-                CheckAlarmTime(&st);
+            if (g_timer.mode != TIMER_OFF) {
+                PrintTimer(recolor);
+            } else if (g_zonePaneCount > 0) {
+                PrintWorldClock(recolor);
+            } else {
+                PrintTimeAscii(&st, g_layout.time.x, g_layout.time.y, recolor, &g_displayState);
+                PrintDateAscii(&st, g_layout.date.x, g_layout.date.y, FALSE, &g_displayState);
             }
-            
-            PrintTimeAscii(&st, 0, 3, FALSE);
-            PrintDateAscii(&st, 0, 12, FALSE);
         }
         
-        // Update alarm beep if ringing
-        if (g_alarmState.isRinging) {
-            UpdateAlarmBeep();
-            // Update status line to show it's still ringing
-            PrintAlarmStatusLine();
+        // A running timer gives the overlay only what is left of its budget
+        if (g_statsOverlay &&
+            CaptureInteger(CAPTURE_OVERLAY, !g_timer.running || GetTimerBudgetLeftUs(passStart) > 0)) {
+            DrawStatsOverlay();
+        }
+        
+        // Push everything composed this tick in one write
+        FlushFrame();
+        StatsRecordSince(&g_renderStats.frameTime, passStart);
+        if (g_timer.running && GetTimerBudgetLeftUs(passStart) < 0) {
+            g_timer.overBudget++;
         }
+        StatsInputPainted();
+        g_secondTicker.shownSecond = st.wSecond;
+        g_secondTicker.boundary = 0;
 
-        Sleep(UPDATE_INTERVAL_MS);
+        WaitForNextPass();
     }
 
+    StopAudioWorker();
+    StopBroadcastServer();
+    StopInputReader();
     HideCursor(FALSE);
-    return 0;
+    FreeFrameBuffer();
+    FreeScaledGlyphs();
+    FreeFont();
+    FreeZonePanes();
+    ShutdownConsole();
+    ReportBroadcastServer();
+    if (g_showSeconds) {
+        EndSecondTicker();
+    }
+    if (g_timer.mode != TIMER_OFF) {
+        EndTimerMode();
+    }
+    BOOL replayMatched = EndCapture();
+    DumpRenderStats();
+    CloseAlarmJournal();
+    FreeAlarmScheduler();
+    if (g_frameLog) {
+        fclose(g_frameLog);
+    }
+    return replayMatched ? 0 : 1;
+}
+
+#ifndef _WIN32
+// POSIX entry point: convert arguments to wide strings and run wmain
+int main(int argc, char* argv[]) {
+    // Wide stdio (/render output, diagnostics) needs a UTF-8 capable locale
+    if (!setlocale(LC_ALL, "") || MB_CUR_MAX == 1) {
+        setlocale(LC_CTYPE, "C.UTF-8");
+    }
+    
+    wchar_t** wideArgv = (wchar_t**)calloc((size_t)argc + 1, sizeof(wchar_t*));
+    if (!wideArgv) {
+        return 1;
+    }
+    
+    for (int i = 0; i < argc; i++) {
+        size_t length = mbstowcs(NULL, argv[i], 0);
+        if (length == (size_t)-1) {
+            length = 0;
+        }
+        wideArgv[i] = (wchar_t*)calloc(length + 1, sizeof(wchar_t));
+        if (!wideArgv[i]) {
+            return 1;
+        }
+        if (length > 0) {
+            mbstowcs(wideArgv[i], argv[i], length + 1);
+        }
+    }
+    
+    int result = wmain(argc, wideArgv);
+    
+    for (int i = 0; i < argc; i++) {
+        free(wideArgv[i]);
+    }
+    free(wideArgv);
+    return result;
+}
+#endif
@@ -0,0 +1,199 @@
+#!/bin/sh
+# Golden-frame tests. Each case renders a fixed time with the headless
+# backend (/render) and diffs the frame against tests/golden/<case>.txt.
+# The /banner filter is checked the same way against a fixed corpus of
+# epoch and ISO 8601 lines, then timed on a larger copy of it. Modes that
+# check themselves (/soak, /replay) only have to exit cleanly.
+#
+# Usage: tests/run_tests.sh [path/to/ascii_time]
+# Without a binary, ascii_time.c is built with $CC (default cc) first.
+# UPDATE_GOLDEN=1 rewrites the golden files after an intended change.
+
+dir=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+if [ $# -gt 0 ]; then
+    bin=$1
+else
+    bin=$tmp/ascii_time
+    ${CC:-cc} -std=c11 -O2 -pthread -o "$bin" "$dir/../ascii_time.c" || exit 1
+fi
+
+# The frames are UTF-8 block characters. /render times are local wall
+# times, so world-clock panes depend on the local zone; pin it.
+LC_ALL=C.UTF-8
+TZ=UTC
+export LC_ALL TZ
+
+passed=0
+failed=0
+
+# check_render NAME ARGS...: render with ARGS and compare with golden/NAME.txt
+check_render() {
+    name=$1
+    shift
+    golden=$dir/golden/$name.txt
+    
+    if ! "$bin" "$@" > "$tmp/$name.txt" 2> "$tmp/$name.err"; then
+        echo "FAIL $name: exited with an error"
+        cat "$tmp/$name.err"
+        failed=$((failed + 1))
+        return
+    fi
+    
+    if [ "${UPDATE_GOLDEN:-0}" = 1 ]; then
+        cp "$tmp/$name.txt" "$golden"
+        echo "updated $name"
+    elif diff -u "$golden" "$tmp/$name.txt" > "$tmp/$name.diff"; then
+        echo "ok   $name"
+        passed=$((passed + 1))
+    else
+        echo "FAIL $name"
+        cat "$tmp/$name.diff"
+        failed=$((failed + 1))
+    fi
+}
+
+# check_font NAME ARGS...: render with ARGS twice over an empty font cache.
+# The first run must parse the font and the second load it from the cache;
+# both frames must match golden/NAME.txt.
+check_font() {
+    name=$1
+    shift
+    XDG_CACHE_HOME=$tmp/cache
+    export XDG_CACHE_HOME
+    
+    for source in parsed cache; do
+        check_render "$name" "$@" /stats "$tmp/$name.stats"
+        if ! grep -q "^font load: $source " "$tmp/$name.stats"; then
+            echo "FAIL $name: font was not loaded from the $source copy"
+            failed=$((failed + 1))
+        fi
+    done
+    unset XDG_CACHE_HOME
+}
+
+# check_exit NAME ARGS...: run with ARGS; pass if it exits 0
+check_exit() {
+    name=$1
+    shift
+    
+    if "$bin" "$@" > "$tmp/$name.out" 2>&1; then
+        echo "ok   $name"
+        passed=$((passed + 1))
+    else
+        echo "FAIL $name"
+        cat "$tmp/$name.out"
+        failed=$((failed + 1))
+    fi
+}
+
+# check_replay NAME: replay NAME.cap; it must exit 0 with no frame diverged
+check_replay() {
+    name=$1
+    
+    if "$bin" /replay "$dir/$name.cap" > "$tmp/$name.out" 2>&1 &&
+       grep -q ", 0 diverged$" "$tmp/$name.out"; then
+        echo "ok   $name"
+        passed=$((passed + 1))
+    else
+        echo "FAIL $name"
+        cat "$tmp/$name.out"
+        failed=$((failed + 1))
+    fi
+}
+
+# check_banner NAME: filter NAME-corpus.txt through /banner and compare with
+# golden/NAME.txt. A filter that succeeds must not write to stderr.
+check_banner() {
+    name=$1
+    golden=$dir/golden/$name.txt
+    
+    if ! "$bin" /banner < "$dir/$name-corpus.txt" > "$tmp/$name.txt" 2> "$tmp/$name.err"; then
+        echo "FAIL $name: exited with an error"
+        cat "$tmp/$name.err"
+        failed=$((failed + 1))
+        return
+    fi
+    if [ -s "$tmp/$name.err" ]; then
+        echo "FAIL $name: wrote to stderr"
+        cat "$tmp/$name.err"
+        failed=$((failed + 1))
+        return
+    fi
+    
+    if [ "${UPDATE_GOLDEN:-0}" = 1 ]; then
+        cp "$tmp/$name.txt" "$golden"
+        echo "updated $name"
+    elif diff -u "$golden" "$tmp/$name.txt" > "$tmp/$name.diff"; then
+        echo "ok   $name"
+        passed=$((passed + 1))
+    else
+        echo "FAIL $name"
+        cat "$tmp/$name.diff"
+        failed=$((failed + 1))
+    fi
+}
+
+# report_banner_rate NAME COPIES: time /banner over COPIES of the corpus and
+# print lines/s. Informational only; needs date +%s%N for the timing.
+report_banner_rate() {
+    name=$1
+    copies=$2
+    
+    awk -v copies="$copies" '{ line[NR] = $0 } END { for (i = 0; i < copies; i++) for (j = 1; j <= NR; j++) print line[j] }' \
+        "$dir/$name-corpus.txt" > "$tmp/$name-large.txt"
+    lines=$(wc -l < "$tmp/$name-large.txt")
+    
+    start=$(date +%s%N)
+    "$bin" /banner < "$tmp/$name-large.txt" > /dev/null
+    end=$(date +%s%N)
+    case "$start$end" in
+        *N*) echo "rate $name: $lines lines (no nanosecond clock to time them)" ;;
+        *) awk -v name="$name" -v lines="$lines" -v ns="$((end - start))" \
+               'BEGIN { s = ns / 1e9; if (s <= 0) s = 1e-9; printf "rate %s: %d lines in %.3f s (%.0f lines/s)\n", name, lines, s, lines / s }' ;;
+    esac
+}
+
+# 12-hour clock: morning, afternoon, and the two twelves
+check_render am             /render 2026-10-16T09:05 /rendersize 80x25
+check_render pm             /render 2026-10-16T13:59 /rendersize 80x25
+check_render midnight       /render 2026-01-01T00:00 /rendersize 80x25
+check_render noon           /render 2026-07-04T12:30 /rendersize 80x25
+
+# HH:MM:SS, and the fit check that keeps AM/PM on screen with it
+check_render seconds        /render 2026-10-16T23:59:58 /seconds /rendersize 100x30
+check_render seconds-fit    /render 2026-10-16T13:59:07 /seconds /rendersize 125x50
+
+# Alarm status line under the date
+check_render alarm          /render 2026-10-16T13:59 /alarm 07:30 /repeat /ramp fast /rendersize 80x25
+
+# A console narrower than TIME_AMPM_OFFSET plus a glyph clips AM/PM
+check_render narrow         /render 2026-10-16T09:05 /rendersize 40x12
+
+# Scaled digits, stacked and side by side
+check_render scaled         /render 2026-10-16T13:59 /rendersize 200x60
+check_render side-by-side   /render 2026-10-16T13:59 /layout side /rendersize 200x30
+
+# A FIGlet font in place of the built-in glyphs, parsed and then cached
+check_font font             /render 2026-10-16T13:59:07 /seconds /font "$dir/tiny.flf" /rendersize 60x12
+
+# World-clock panes: UTC, and POSIX TZ rules either side of DST in both
+# hemispheres
+zones="/zone UTC /zone NY=EST5EDT,M3.2.0,M11.1.0 /zone <+0530>-5:30 /zone SYD=AEST-10AEDT,M10.1.0,M4.1.0/3"
+check_render zones-winter   /render 2026-01-15T08:30 $zones /rendersize 100x30
+check_render zones-summer   /render 2026-07-04T12:00 $zones /rendersize 100x30
+
+# Epoch and ISO 8601 timestamps to banners; impossible dates pass through
+check_banner banner
+report_banner_rate banner 20000
+
+# A recorded /seconds run with an alarm, Alt+I on and off, and Alt+C
+check_replay seconds-hotkeys
+
+# A simulated year of alarms: every fire on time, every ramp in order
+check_exit soak             /soak 365
+
+echo "$passed passed, $failed failed"
+[ "$failed" -eq 0 ]